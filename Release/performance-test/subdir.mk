@@ -5,15 +5,18 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
 ../performance-test/grid_performance.cpp \
-../performance-test/kNN_test.cpp
+../performance-test/kNN_test.cpp \
+../performance-test/queue_performance.cpp
 
 OBJS += \
 ./performance-test/grid_performance.o \
-./performance-test/kNN_test.o 
+./performance-test/kNN_test.o \
+./performance-test/queue_performance.o 
 
 CPP_DEPS += \
 ./performance-test/grid_performance.d \
-./performance-test/kNN_test.d
+./performance-test/kNN_test.d \
+./performance-test/queue_performance.d
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -4,14 +4,17 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
+../src/grid/CellOrder.cpp \
 ../src/grid/Grid.cpp \
 ../src/grid/GridMBR.cpp 
 
 OBJS += \
+./src/grid/CellOrder.o \
 ./src/grid/Grid.o \
 ./src/grid/GridMBR.o 
 
 CPP_DEPS += \
+./src/grid/CellOrder.d \
 ./src/grid/Grid.d \
 ./src/grid/GridMBR.d 
 
@@ -5,15 +5,18 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
 ../src/knn/Metrics.cpp \
-../src/knn/NaiveKnn.cpp 
+../src/knn/NaiveKnn.cpp \
+../src/knn/PqKnn.cpp 
 
 OBJS += \
 ./src/knn/Metrics.o \
-./src/knn/NaiveKnn.o 
+./src/knn/NaiveKnn.o \
+./src/knn/PqKnn.o 
 
 CPP_DEPS += \
 ./src/knn/Metrics.d \
-./src/knn/NaiveKnn.d 
+./src/knn/NaiveKnn.d \
+./src/knn/PqKnn.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
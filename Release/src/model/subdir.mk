@@ -8,21 +8,24 @@ CPP_SRCS += \
 ../src/model/PointAccessor.cpp \
 ../src/model/PointArrayAccessor.cpp \
 ../src/model/PointContainer.cpp \
-../src/model/PointVectorAccessor.cpp 
+../src/model/PointVectorAccessor.cpp \
+../src/model/QuantizedPointContainer.cpp 
 
 OBJS += \
 ./src/model/MBR.o \
 ./src/model/PointAccessor.o \
 ./src/model/PointArrayAccessor.o \
 ./src/model/PointContainer.o \
-./src/model/PointVectorAccessor.o 
+./src/model/PointVectorAccessor.o \
+./src/model/QuantizedPointContainer.o 
 
 CPP_DEPS += \
 ./src/model/MBR.d \
 ./src/model/PointAccessor.d \
 ./src/model/PointArrayAccessor.d \
 ./src/model/PointContainer.d \
-./src/model/PointVectorAccessor.d 
+./src/model/PointVectorAccessor.d \
+./src/model/QuantizedPointContainer.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -4,19 +4,28 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
+../src/util/Affinity.cpp \
+../src/util/CacheMissCounter.cpp \
 ../src/util/FileHandler.cpp \
 ../src/util/RandomPointGenerator.cpp \
-../src/util/Representable.cpp 
+../src/util/Representable.cpp \
+../src/util/ThreadPool.cpp 
 
 OBJS += \
+./src/util/Affinity.o \
+./src/util/CacheMissCounter.o \
 ./src/util/FileHandler.o \
 ./src/util/RandomPointGenerator.o \
-./src/util/Representable.o 
+./src/util/Representable.o \
+./src/util/ThreadPool.o 
 
 CPP_DEPS += \
+./src/util/Affinity.d \
+./src/util/CacheMissCounter.d \
 ./src/util/FileHandler.d \
 ./src/util/RandomPointGenerator.d \
-./src/util/Representable.d 
+./src/util/Representable.d \
+./src/util/ThreadPool.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -79,6 +79,50 @@ void determineGridCellFillSize(unsigned k, unsigned dimension,
 	std::cout << "#### Determine Grid Cell Fill Optimum Ended ###" << std::endl;
 }
 
+long gridQueryTime(Grid& grid, unsigned k, PointContainer& queries) {
+	auto start_knn = std::chrono::system_clock::now();
+	for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+		auto&& q = queries[q_idx];
+		grid.kNearestNeighbors(k, &q);
+	}
+
+	return static_cast<long>(std::chrono::duration_cast < mili_sec
+			> (std::chrono::system_clock::now() - start_knn).count());
+}
+
+void compareGridLayouts(unsigned dimension, unsigned k,
+		unsigned numberOfPoints, std::size_t cellFillOptimum,
+		PointContainer& queries, PointContainer& points) {
+	std::cout << "#### Compare Grid Cell Layouts ###" << std::endl;
+
+	auto start_grid_build = std::chrono::system_clock::now();
+	Grid grid(dimension, points.data(), numberOfPoints * dimension,
+			cellFillOptimum);
+	long grid_build_duration = static_cast<long>(std::chrono::duration_cast
+			< mili_sec
+			> (std::chrono::system_clock::now() - start_grid_build).count());
+
+	std::cout << "per-cell build time: " << grid_build_duration << std::endl;
+	std::cout << "per-cell kNN lookup time: "
+			<< gridQueryTime(grid, k, queries) << std::endl;
+	std::cout << "per-cell memory: " << grid.cellMemoryUsage() << std::endl;
+
+	//the compact layout is built from the per-cell one
+	auto start_compaction = std::chrono::system_clock::now();
+	grid.setCompactLayout(true);
+	long compaction_duration = static_cast<long>(std::chrono::duration_cast
+			< mili_sec
+			> (std::chrono::system_clock::now() - start_compaction).count());
+
+	std::cout << "compact build time: "
+			<< grid_build_duration + compaction_duration << std::endl;
+	std::cout << "compact kNN lookup time: "
+			<< gridQueryTime(grid, k, queries) << std::endl;
+	std::cout << "compact memory: " << grid.cellMemoryUsage() << std::endl;
+	std::cout << "k: " << k << std::endl;
+	std::cout << "#### Compare Grid Cell Layouts Ended ###" << std::endl;
+}
+
 //long testNaiveMapReduce(unsigned k, PointAccessor* query,
 //		PointContainer& points, unsigned dimension, unsigned numberOfPoints) {
 //	NaiveMapReduce naiveMR(points.data(), dimension, numberOfPoints);
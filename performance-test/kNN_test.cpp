@@ -1,13 +1,18 @@
 #include "../src/grid/Grid.h"
 #include "../src/knn/BPQ.h"
 #include "../src/knn/NaiveKnn.h"
+#include "../src/knn/PqKnn.h"
 #include "../src/knn/KnnProcessor.h"
+#include "../src/knn/Metrics.h"
 #include "../src/model/PointContainer.h"
 #include "../src/model/PointArrayAccessor.h"
+#include "../src/model/QuantizedPointContainer.h"
 #include "../src/naive-map-reduce/NaiveMapReduce.h"
 #include "../src/util/RandomPointGenerator.h"
+#include "../src/util/CacheMissCounter.h"
 #include "../src/util/FileHandler.h"
 #include "../src/util/StopWatch.h"
+#include "queue_performance.h"
 
 #include <cstddef>
 #include <cstring>
@@ -33,11 +38,25 @@ RandomPointGenerator::DISTRIBUTION refDistrib;
 std::size_t gridCellSize = Grid::CELL_FILL_OPTIMUM_DEFAULT;	// grid bucket size
 unsigned gridMaxNumberOfInsertThreads = Grid::MAX_NUMBER_OF_THREADS_DEFAULT;
 unsigned gridInsertThreadLoad = Grid::THREAD_LOAD_DEFAULT;
+bool gridCompactLayout = false;		// cells in one array ordered by cell
+CELL_ORDER gridCellOrder = ROW_MAJOR;	// memory order of the cells
+GRID_TRAVERSAL gridTraversal = RING;	// order queries visit the cells in
 
 //Naive MapReduce parameters
 unsigned maxNumberOfThreads = NaiveMapReduce::MAX_NUMBER_OF_THREADS;
 unsigned maxThreadLoad = NaiveMapReduce::MAX_THREAD_LOAD;
 unsigned singleThreadedThreshold = NaiveMapReduce::SINGLE_THREADED_THRESHOLD;
+bool persistentThreads = true;		// map tasks on a long-lived pool
+bool numaAware = false;				// pinned map threads, placed points
+
+//Batch parameters
+bool normExpansion = false;			// dot-product distances for batches
+bool singlePrecision = false;		// float candidate selection + re-rank
+unsigned rerankSlack = NaiveKnn::RERANK_SLACK_DEFAULT; // extra candidates
+std::size_t selectionPointsPerK = NaiveKnn::SELECTION_POINTS_PER_K_DEFAULT;
+bool quantize = false;				// integer code filtering + refinement
+QUANTIZATION quantization = INT8;		// code width
+bool pqRerank = true;				// exact re-rank of PQ candidates
 
 //Query parameters
 std::size_t numberOfQueryPoints = 0;			// query size
@@ -49,7 +68,11 @@ RandomPointGenerator::DISTRIBUTION queryDistrib;
 
 //Run kNN Query:
 unsigned k = 1;						// number of near neighbors
+bool resultIds = false;				// flat (id, distance) results
+unsigned batchThreads = 0;			// threads of batch queries, 0: one by one
 bool verboseStats = false;
+bool countCacheMisses = false;			// hardware counter around queries
+long long cacheMisses = -1;			// of the last run, -1: unavailable
 
 enum KNN_APPROACH {
 	NAIVE_KNN, GRID_KNN, NAIVE_MAP_REDUCE_KNN, GRID_MAP_REDUCE_KNN
@@ -111,17 +134,91 @@ StopWatch executeKnn(PointContainer& queries, unsigned k,
 		KnnProcessor<T>* processor) {
 
 	StopWatch watch;
+	static CacheMissCounter counter;
+	if (countCacheMisses) {
+		counter.start();
+	}
+
+	if (batchThreads > 0) {
+		std::vector<std::size_t> ids(queries.size() * k);
+		std::vector<double> distances(queries.size() * k);
+		watch.start();
+		processor->kNearestNeighborIdsBatch(k, queries, batchThreads,
+				ids.data(), distances.data());
+		watch.stop();
+		cacheMisses = counter.available() ? counter.stop() : -1;
+		return watch;
+	}
+
+	std::vector<std::size_t> ids(resultIds ? k : 0);
+	std::vector<double> distances(resultIds ? k : 0);
 	watch.start();
 
 	for (size_t i = 0; i < queries.size(); ++i) {
 		PointVectorAccessor query = queries[i];
-		processor->kNearestNeighbors(k, &query);
+		if (resultIds) {
+			processor->kNearestNeighborIds(k, &query, ids.data(),
+					distances.data());
+		} else {
+			processor->kNearestNeighbors(k, &query);
+		}
 	}
 
 	watch.stop();
+	cacheMisses = counter.available() ? counter.stop() : -1;
 	return watch;
 }
 
+/** Fraction of the exact k nearest neighbors found by the processor,
+ * ties at the k-th distance count as hits. Distances of the results are
+ * recomputed, approximate processors may report estimates. */
+template<class T>
+double measureRecall(PointContainer& queries, unsigned k,
+		KnnProcessor<T>* processor, KnnProcessor<PointArrayAccessor>* exact) {
+	std::size_t hits = 0;
+	std::size_t expected = 0;
+
+	for (size_t i = 0; i < queries.size(); ++i) {
+		PointVectorAccessor query = queries[i];
+		BPQ<PointArrayAccessor> truth = exact->kNearestNeighbors(k, &query);
+		BPQ<T> result = processor->kNearestNeighbors(k, &query);
+		double kthDistance = truth.empty() ? 0.0 : truth.topDistance();
+
+		expected += truth.size();
+		while (!result.empty()) {
+			T point = result.topPoint();
+			if (Metrics::squared_euclidean(point.getData() + point.getOffset(),
+					query.getData() + query.getOffset(), dimension)
+					<= kthDistance) {
+				++hits;
+			}
+			result.pop();
+		}
+	}
+
+	return expected ? static_cast<double>(hits) / expected : 1.0;
+}
+
+//the points stay resident next to the codes, candidates are refined on them
+void printQuantizedMemory(const std::string & indexName,
+		std::size_t quantizedBytes, std::size_t pointBytes) {
+	std::size_t totalBytes = quantizedBytes + pointBytes;
+	std::cout << "Quantized " << indexName << ": " << quantizedBytes
+			<< " bytes of codes + " << pointBytes
+			<< " bytes of points for refinement = " << totalBytes
+			<< " bytes, unquantized: " << pointBytes << " bytes (+"
+			<< 100.0 * static_cast<double>(quantizedBytes) / pointBytes
+			<< "%)\n" << std::endl;
+}
+
+void printNodeBandwidth(const std::vector<double>& bandwidth) {
+	for (std::size_t node = 0; node < bandwidth.size(); ++node) {
+		std::cout << "NUMA node " << node << " read bandwidth (GB/s): "
+				<< bandwidth[node] / 1e9 << "\n";
+	}
+	std::cout << std::endl;
+}
+
 void printStats(const std::string & indexName, bool verbose, StopWatch& watch) {
 	std::cout << "Finished kNN (k=" << k << ") lookup on " << indexName << "\n";
 	std::cout << "Run queries: " << numberOfQueryPoints << "\n";
@@ -132,6 +229,14 @@ void printStats(const std::string & indexName, bool verbose, StopWatch& watch) {
 
 	std::cout << "Query avg. runtime (micro sec.): " << avgRuntime << "\n";
 	std::cout << "Query whole runtime (micro sec.): " << sumRuntimes << "\n";
+	if (countCacheMisses) {
+		if (cacheMisses >= 0) {
+			std::cout << "Cache misses / query: "
+					<< cacheMisses / numberOfQueryPoints << "\n";
+		} else {
+			std::cout << "Cache misses / query: unavailable (perf events)\n";
+		}
+	}
 	if (verbose) {
 		std::cout << "All query runtimes (micro sec.):\n";
 		for (auto split : watch.getSplitTimes()) {
@@ -159,8 +264,14 @@ Grid* buildUpGrid(Grid* grid, StopWatch& watch, double* refPtsArray,
 	}
 
 	watch.start();
-	grid = new Grid { dimension, refPtsArray, numberOfRefPoints * dimension,
-			cellSize, gridMaxNumberOfInsertThreads, gridInsertThreadLoad };
+	grid = Grid::create(dimension, refPtsArray, numberOfRefPoints * dimension,
+			cellSize, gridMaxNumberOfInsertThreads, gridInsertThreadLoad);
+	grid->setRerankSlack(rerankSlack);
+	grid->setSinglePrecision(singlePrecision);
+	grid->setQuantization(quantize, quantization);
+	grid->setCellOrder(gridCellOrder);
+	grid->setTraversal(gridTraversal);
+	grid->setCompactLayout(gridCompactLayout);
 	watch.stop();
 
 	if (!printCSV) {
@@ -169,6 +280,16 @@ Grid* buildUpGrid(Grid* grid, StopWatch& watch, double* refPtsArray,
 	} else {
 		std::cout << cellSize << ',' << watch.getLastSplit() << std::endl;
 	}
+	if (quantize && !printCSV) {
+		printQuantizedMemory("grid", grid->quantizedMemoryUsage(),
+				grid->cellMemoryUsage());
+	}
+	if (!printCSV) {
+		std::cout << "Grid cells ("
+				<< (gridCompactLayout ? "compact" : "per-cell")
+				<< " layout): " << grid->cellMemoryUsage() << " bytes\n"
+				<< std::endl;
+	}
 
 	return grid;
 }
@@ -195,8 +316,8 @@ std::size_t binarySearchThreshold(unsigned realTimeCrit,
 	switch (strategy) {
 	case NAIVE_KNN:
 		binarySearch = false;
-		naiveProcessor = new NaiveKnn { refPoints.data(), dimension,
-				pointThreshold };
+		naiveProcessor = NaiveKnn::create(refPoints.data(), dimension,
+				pointThreshold);
 		while (true) {
 			StopWatch timeResults = executeKnn(queries, k, naiveProcessor);
 			long result = timeResults.averageSplit();
@@ -216,8 +337,8 @@ std::size_t binarySearchThreshold(unsigned realTimeCrit,
 				pointThreshold = refPoints.size();
 				step = pointThreshold / 2;
 				delete (naiveProcessor);
-				naiveProcessor = new NaiveKnn { refPoints.data(), dimension,
-						pointThreshold };
+				naiveProcessor = NaiveKnn::create(refPoints.data(), dimension,
+						pointThreshold);
 				std::cout << "generating more points: " << pointThreshold
 						<< std::endl;
 			} else {
@@ -229,8 +350,8 @@ std::size_t binarySearchThreshold(unsigned realTimeCrit,
 					pointThreshold += step;
 				}
 				delete (naiveProcessor);
-				naiveProcessor = new NaiveKnn { refPoints.data(), dimension,
-						pointThreshold };
+				naiveProcessor = NaiveKnn::create(refPoints.data(), dimension,
+						pointThreshold);
 				step = step / 2;
 
 				if (step == 1) {
@@ -410,6 +531,8 @@ int main(int argc, char** argv) {
 	RandomPointGenerator* rpg = nullptr;
 	Grid* grid = nullptr;
 	NaiveKnn* naive = nullptr;
+	QuantizedPoints* quantizedRefPoints = nullptr;
+	PqKnn* pq = nullptr;
 	NaiveMapReduce* naiveMR = nullptr;
 
 	StopWatch watch { };
@@ -559,8 +682,33 @@ int main(int argc, char** argv) {
 			if (naive) {
 				delete (naive);
 			}
-			naive = new NaiveKnn { refPoints.data(), dimension,
-					numberOfRefPoints };
+			naive = NaiveKnn::create(refPoints.data(), dimension,
+					numberOfRefPoints);
+			if (normExpansion) {
+				refPoints.computeSquaredNorms();
+				naive->setSquaredNorms(refPoints.squaredNorms().data());
+			}
+			if (singlePrecision) {
+				refPoints.computeSinglePrecision();
+				naive->setSinglePrecisionPoints(
+						refPoints.singlePrecision().data());
+			}
+			naive->setRerankSlack(rerankSlack);
+			naive->setSelectionPointsPerK(selectionPointsPerK);
+			if (quantizedRefPoints) {
+				delete (quantizedRefPoints);
+				quantizedRefPoints = nullptr;
+			}
+			if (quantize) {
+				MBR mbr = MBR(dimension).createMBR(refPoints.data(),
+						numberOfRefPoints * dimension);
+				quantizedRefPoints = QuantizedPoints::create(quantization, mbr,
+						refPoints.data(), numberOfRefPoints);
+				naive->setQuantizedPoints(quantizedRefPoints);
+				printQuantizedMemory("reference points",
+						quantizedRefPoints->memoryUsage(),
+						numberOfRefPoints * dimension * sizeof(double));
+			}
 		} else if (!strcmp(token, "buildNaiveMapReduce")) {
 			if (naiveMR) {
 				delete (naiveMR);
@@ -576,6 +724,15 @@ int main(int argc, char** argv) {
 						numberOfRefPoints, maxNumberOfThreads, maxThreadLoad,
 						singleThreadedThreshold, KNN_STRATEGY::NAIVE };
 			}
+			naiveMR->setSelectionPointsPerK(selectionPointsPerK);
+			naiveMR->setPersistentThreads(persistentThreads);
+			if (numaAware) {
+				naiveMR->setNumaAware(true);
+			}
+			if (normExpansion) {
+				refPoints.computeSquaredNorms();
+				naiveMR->setSquaredNorms(refPoints.squaredNorms().data());
+			}
 		} else if (!strcmp(token, "runGridKnn")) {
 			auto gridKnnTime = executeKnn<PointVectorAccessor>(queryPoints, k,
 					grid);
@@ -658,10 +815,169 @@ int main(int argc, char** argv) {
 			auto naiveKnntime = executeKnn<PointArrayAccessor>(queryPoints, k,
 					naive);
 			printStats("Naive Approach", verboseStats, naiveKnntime);
+		} else if (!strcmp(token, "runNaiveBatchKnn")) {
+			//all queries at once, using the blocked multi-query scan
+			StopWatch batchWatch;
+			batchWatch.start();
+			naive->kNearestNeighborsBatch(k, queryPoints);
+			batchWatch.stop();
+			printStats("Naive Approach (blocked batch)", verboseStats,
+					batchWatch);
+		} else if (!strcmp(token, "runNaiveMapReduceBatchKnn")) {
+			StopWatch batchWatch;
+			batchWatch.start();
+			naiveMR->kNearestNeighborsBatch(k, queryPoints);
+			batchWatch.stop();
+			printStats("Naive Map Reduce Approach (blocked batch)",
+					verboseStats, batchWatch);
+		} else if (!strcmp(token, "normExpansion")) {
+			//format: normExpansion <bool>, applies to subsequent builds
+			std::cin >> normExpansion;
+		} else if (!strcmp(token, "gridCompactLayout")) {
+			//format: gridCompactLayout <bool>, applies to subsequent builds
+			std::cin >> gridCompactLayout;
+		} else if (!strcmp(token, "gridCellOrder")) {
+			//format: gridCellOrder <rowMajor|morton|hilbert>, applies to
+			//subsequent builds
+			std::cin >> arg;
+			if (!strcmp(arg, "morton")) {
+				gridCellOrder = MORTON;
+			} else if (!strcmp(arg, "hilbert")) {
+				gridCellOrder = HILBERT;
+			} else {
+				gridCellOrder = ROW_MAJOR;
+			}
+		} else if (!strcmp(token, "gridTraversal")) {
+			//format: gridTraversal <ring|bestFirst>, applies to subsequent
+			//builds
+			std::cin >> arg;
+			gridTraversal = !strcmp(arg, "bestFirst") ? BEST_FIRST : RING;
+		} else if (!strcmp(token, "cacheMisses")) {
+			//format: cacheMisses <bool>, runs report the last level cache
+			//misses per query
+			std::cin >> countCacheMisses;
+		} else if (!strcmp(token, "singlePrecision")) {
+			//format: singlePrecision <bool>, applies to subsequent builds
+			std::cin >> singlePrecision;
+		} else if (!strcmp(token, "quantization")) {
+			//format: quantization <(none|int8|int16)>, applies to subsequent
+			//naive and grid builds
+			std::cin >> arg;
+			quantize = strcmp(arg, "none");
+			quantization = !strcmp(arg, "int16") ? INT16 : INT8;
+		} else if (!strcmp(token, "buildPq")) {
+			//format: buildPq <number of subspaces>
+			std::size_t subspaces;
+			std::cin >> subspaces;
+			if (pq) {
+				delete (pq);
+			}
+			std::cout << "Training product quantizer (" << subspaces
+					<< " subspaces) ... this may take a while ..." << std::endl;
+			watch.start();
+			pq = new PqKnn { refPoints.data(), dimension, numberOfRefPoints,
+					subspaces };
+			watch.stop();
+			pq->setRerank(pqRerank);
+			pq->setRerankSlack(rerankSlack);
+			std::cout << "Finished product quantizer training! ("
+					<< watch.getLastSplit() << " micro sec.)" << std::endl;
+			printQuantizedMemory("PQ codes", pq->memoryUsage(),
+					numberOfRefPoints * dimension * sizeof(double));
+		} else if (!strcmp(token, "pqRerank")) {
+			//format: pqRerank <bool>, applies to subsequent PQ builds
+			std::cin >> pqRerank;
+		} else if (!strcmp(token, "runPqKnn")) {
+			auto pqKnnTime = executeKnn<PointArrayAccessor>(queryPoints, k, pq);
+			printStats("Product Quantization", verboseStats, pqKnnTime);
+		} else if (!strcmp(token, "selectionPointsPerK")) {
+			//format: selectionPointsPerK <points>, exact scans select instead
+			//of using the heap if n <= k * points, 0 disables selection,
+			//applies to subsequent builds
+			std::cin >> selectionPointsPerK;
+		} else if (!strcmp(token, "rerankSlack")) {
+			//format: rerankSlack <candidates>, applies to subsequent builds
+			std::cin >> rerankSlack;
+		} else if (!strcmp(token, "measureRecall")) {
+			//format: measureRecall <(grid|naive|pq)>, compares the built index
+			//against an exact double precision scan
+			std::cin >> arg;
+			//run-time dimension, its distances match the recomputed ones
+			NaiveKnn* exact = new NaiveKnn { refPoints.data(), dimension,
+					numberOfRefPoints };
+			double recall = 0.0;
+			if (!strcmp(arg, "grid")) {
+				recall = measureRecall<PointVectorAccessor>(queryPoints, k,
+						grid, exact);
+			} else if (!strcmp(arg, "pq")) {
+				recall = measureRecall<PointArrayAccessor>(queryPoints, k, pq,
+						exact);
+			} else {
+				recall = measureRecall<PointArrayAccessor>(queryPoints, k,
+						naive, exact);
+			}
+			delete (exact);
+			std::cout << "Recall (k=" << k << ") of " << arg << ": " << recall
+					<< "\n" << std::endl;
 		} else if (!strcmp(token, "runNaiveMapReduceKnn")) {
 			auto naiveMRtime = executeKnn<PointArrayAccessor>(queryPoints, k,
 					naiveMR);
 			printStats("Naive Map Reduce Approach", verboseStats, naiveMRtime);
+			if (numaAware) {
+				printNodeBandwidth(naiveMR->nodeBandwidth());
+			}
+		} else if (!strcmp(token, "simdLevel")) {
+			//format: simdLevel <(scalar|sse2|avx2|avx512)>
+			std::cin >> arg;
+			SIMD_LEVEL level = Metrics::detectSimdLevel();
+			if (!strcmp(arg, "scalar")) {
+				level = SCALAR;
+			} else if (!strcmp(arg, "sse2")) {
+				level = SSE2;
+			} else if (!strcmp(arg, "avx2")) {
+				level = AVX2;
+			} else if (!strcmp(arg, "avx512")) {
+				level = AVX512;
+			}
+			std::cout << "Using SIMD level: " << Metrics::setSimdLevel(level)
+					<< " (detected: " << Metrics::detectSimdLevel() << ")\n"
+					<< std::endl;
+		} else if (!strcmp(token, "runQueueBenchmark")) {
+			//format: runQueueBenchmark <candidates per query> <queries>,
+			//compares BPQ and FixedBPQ for k = 1, 10, ..., 100000
+			std::size_t numberOfCandidates;
+			unsigned numberOfQueries;
+			std::cin >> numberOfCandidates;
+			std::cin >> numberOfQueries;
+			benchmarkQueues( { 1, 10, 100, 1000, 10000, 100000 },
+					numberOfCandidates, numberOfQueries);
+		} else if (!strcmp(token, "runSmallKBenchmark")) {
+			//format: runSmallKBenchmark <candidates per query> <queries>,
+			//compares BPQ and SmallKQueue for k = 1, 2, 4, ..., 32
+			std::size_t numberOfCandidates;
+			unsigned numberOfQueries;
+			std::cin >> numberOfCandidates;
+			std::cin >> numberOfQueries;
+			benchmarkSmallKQueues( { 1, 2, 4, 8, 16, 32 }, numberOfCandidates,
+					numberOfQueries);
+		} else if (!strcmp(token, "resultIds")) {
+			//format: resultIds <bool>, queries write ids and distances into
+			//flat arrays instead of returning a BPQ
+			std::cin >> resultIds;
+		} else if (!strcmp(token, "persistentThreads")) {
+			//format: persistentThreads <bool>, map tasks of subsequent
+			//NaiveMapReduce builds run on a thread pool or on threads
+			//started per query
+			std::cin >> persistentThreads;
+		} else if (!strcmp(token, "numaAware")) {
+			//format: numaAware <bool>, subsequent NaiveMapReduce builds pin
+			//their map threads and place the points on the threads' nodes,
+			//runs report the read bandwidth per node
+			std::cin >> numaAware;
+		} else if (!strcmp(token, "batchThreads")) {
+			//format: batchThreads <threads>, answers all queries with one
+			//parallel batch call, 0 queries one by one
+			std::cin >> batchThreads;
 		} else if (!strcmp(token, "verboseStats")) {
 			std::cin >> verboseStats;
 		} else {
@@ -0,0 +1,114 @@
+#include "queue_performance.h"
+
+#include "../src/knn/BPQ.h"
+#include "../src/knn/FixedBPQ.h"
+#include "../src/knn/SmallKQueue.h"
+#include "../src/model/PointArrayAccessor.h"
+#include "../src/util/StopWatch.h"
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+
+namespace {
+
+std::vector<double> randomDistances(std::size_t numberOfCandidates) {
+	std::default_random_engine engine(42);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::vector<double> distances(numberOfCandidates);
+	for (auto& d : distances) {
+		d = uniform(engine);
+	}
+	return distances;
+}
+
+}
+
+void benchmarkQueues(const std::vector<unsigned>& ks,
+		std::size_t numberOfCandidates, unsigned numberOfQueries) {
+	const std::vector<double> distances = randomDistances(numberOfCandidates);
+	double dummyPoint[1] = { 0.0 };
+	StopWatch watch;
+
+	std::cout << "k,BPQ (micro sec./query),FixedBPQ (micro sec./query),"
+			<< "same k-th distance\n";
+	for (unsigned k : ks) {
+		double bpqMax = 0.0;
+		double fixedMax = 0.0;
+		watch.start();
+		for (unsigned q = 0; q < numberOfQueries; ++q) {
+			BPQ<PointArrayAccessor> queue(k);
+			for (std::size_t i = 0; i < distances.size(); ++i) {
+				if (distances[i] < queue.max_dist()) {
+					queue.push(PointArrayAccessor { dummyPoint, 0, 1 },
+							distances[i]);
+				}
+			}
+			bpqMax = queue.topDistance();
+		}
+		long bpqTime = watch.stop() / numberOfQueries;
+
+		//one queue for all queries, as engines reuse it
+		FixedBPQ<std::uint32_t> fixedQueue(k);
+		watch.start();
+		for (unsigned q = 0; q < numberOfQueries; ++q) {
+			fixedQueue.reset();
+			for (std::size_t i = 0; i < distances.size(); ++i) {
+				if (distances[i] < fixedQueue.max_dist()) {
+					fixedQueue.push(static_cast<std::uint32_t>(i), distances[i]);
+				}
+			}
+			fixedMax = fixedQueue.topDistance();
+		}
+		long fixedTime = watch.stop() / numberOfQueries;
+
+		std::cout << k << ',' << bpqTime << ',' << fixedTime << ','
+				<< (bpqMax == fixedMax) << '\n';
+	}
+
+	std::cout << std::endl;
+}
+
+void benchmarkSmallKQueues(const std::vector<unsigned>& ks,
+		std::size_t numberOfCandidates, unsigned numberOfQueries) {
+	const std::vector<double> distances = randomDistances(numberOfCandidates);
+	double dummyPoint[1] = { 0.0 };
+	StopWatch watch;
+
+	std::cout << "k,BPQ (nano sec./query),SmallKQueue (nano sec./query),"
+			<< "same k-th distance\n";
+	for (unsigned k : ks) {
+		double bpqMax = 0.0;
+		double smallMax = 0.0;
+		watch.start();
+		for (unsigned q = 0; q < numberOfQueries; ++q) {
+			BPQ<PointArrayAccessor> queue(k);
+			for (std::size_t i = 0; i < distances.size(); ++i) {
+				if (distances[i] < queue.max_dist()) {
+					queue.push(PointArrayAccessor { dummyPoint, i, 1 },
+							distances[i]);
+				}
+			}
+			bpqMax = queue.topDistance();
+		}
+		long bpqTime = watch.stop() * 1000 / numberOfQueries;
+
+		watch.start();
+		for (unsigned q = 0; q < numberOfQueries; ++q) {
+			SmallKQueue<PointArrayAccessor> queue(k);
+			for (std::size_t i = 0; i < distances.size(); ++i) {
+				if (distances[i] < queue.max_dist()) {
+					queue.push(PointArrayAccessor { dummyPoint, i, 1 },
+							distances[i]);
+				}
+			}
+			smallMax = queue.distance(queue.size() - 1);
+		}
+		long smallTime = watch.stop() * 1000 / numberOfQueries;
+
+		std::cout << k << ',' << bpqTime << ',' << smallTime << ','
+				<< (bpqMax == smallMax) << '\n';
+	}
+
+	std::cout << std::endl;
+}
@@ -0,0 +1,18 @@
+#ifndef PERFORMANCE_TEST_QUEUE_PERFORMANCE_H_
+#define PERFORMANCE_TEST_QUEUE_PERFORMANCE_H_
+
+#include <cstddef>
+#include <vector>
+
+/** Compares BPQ and FixedBPQ on the same stream of random candidate
+ * distances, filtered by max_dist() like the kNN scans do. Prints the
+ * average runtime per query of numberOfCandidates pushes for each k. */
+void benchmarkQueues(const std::vector<unsigned>& ks,
+		std::size_t numberOfCandidates, unsigned numberOfQueries);
+
+/** Compares BPQ and SmallKQueue like benchmarkQueues, k must not exceed
+ * SMALL_K_MAX. Prints the average runtime per query in nanoseconds. */
+void benchmarkSmallKQueues(const std::vector<unsigned>& ks,
+		std::size_t numberOfCandidates, unsigned numberOfQueries);
+
+#endif
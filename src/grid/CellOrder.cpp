@@ -0,0 +1,125 @@
+#include "CellOrder.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+/** Bits needed for the coordinates 0 .. cells - 1. */
+unsigned bitsFor(std::size_t cells) {
+	unsigned bits = 0;
+	while ((static_cast<std::size_t>(1) << bits) < cells) {
+		++bits;
+	}
+	return bits;
+}
+
+}
+
+std::uint64_t mortonKey(const std::vector<std::size_t>& coordinates,
+		const std::vector<unsigned>& bits) {
+	const unsigned levels = *std::max_element(bits.begin(), bits.end());
+	std::uint64_t key = 0;
+
+	for (unsigned level = levels; level-- > 0;) {
+		for (std::size_t d = 0; d < coordinates.size(); ++d) {
+			if (level < bits[d]) {
+				key = (key << 1) | ((coordinates[d] >> level) & 1);
+			}
+		}
+	}
+
+	return key;
+}
+
+std::uint64_t hilbertKey(std::vector<std::size_t> coordinates,
+		unsigned bits) {
+	std::vector<std::size_t>& x = coordinates;
+	const std::size_t n = x.size();
+	if (bits == 0) {
+		return 0;
+	}
+
+	//inverse undo of the rotations and reflections
+	for (std::size_t q = static_cast<std::size_t>(1) << (bits - 1); q > 1;
+			q >>= 1) {
+		const std::size_t p = q - 1;
+		for (std::size_t i = 0; i < n; ++i) {
+			if (x[i] & q) {
+				x[0] ^= p;
+			} else {
+				const std::size_t t = (x[0] ^ x[i]) & p;
+				x[0] ^= t;
+				x[i] ^= t;
+			}
+		}
+	}
+
+	//gray encode
+	for (std::size_t i = 1; i < n; ++i) {
+		x[i] ^= x[i - 1];
+	}
+	std::size_t t = 0;
+	for (std::size_t q = static_cast<std::size_t>(1) << (bits - 1); q > 1;
+			q >>= 1) {
+		if (x[n - 1] & q) {
+			t ^= q - 1;
+		}
+	}
+	for (std::size_t i = 0; i < n; ++i) {
+		x[i] ^= t;
+	}
+
+	return mortonKey(x, std::vector<unsigned>(n, bits));
+}
+
+std::vector<unsigned> cellRanks(CELL_ORDER order,
+		const std::vector<std::size_t>& cellsPerDimension) {
+	if (order == ROW_MAJOR) {
+		return std::vector<unsigned>();
+	}
+
+	const std::size_t dimension = cellsPerDimension.size();
+	std::vector<unsigned> bits(dimension);
+	unsigned keyBits = 0;
+	unsigned maxBits = 0;
+	std::size_t numberOfCells = 1;
+	for (std::size_t d = 0; d < dimension; ++d) {
+		bits[d] = bitsFor(cellsPerDimension[d]);
+		keyBits += bits[d];
+		maxBits = std::max(maxBits, bits[d]);
+		numberOfCells *= cellsPerDimension[d];
+	}
+	if (order == HILBERT) {
+		keyBits = maxBits * dimension;
+	}
+	if (keyBits > 64) {
+		throw std::invalid_argument("Cell order keys exceed 64 bits.");
+	}
+
+	std::vector<std::pair<std::uint64_t, unsigned>> keys(numberOfCells);
+	std::vector<std::size_t> coordinates(dimension, 0);
+	for (std::size_t cell = 0; cell < numberOfCells; ++cell) {
+		keys[cell].first =
+				order == MORTON ?
+						mortonKey(coordinates, bits) :
+						hilbertKey(coordinates, maxBits);
+		keys[cell].second = cell;
+
+		//next row-major cell, the first dimension varies fastest
+		for (std::size_t d = 0;
+				d < dimension && ++coordinates[d] == cellsPerDimension[d];
+				++d) {
+			coordinates[d] = 0;
+		}
+	}
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<unsigned> ranks(numberOfCells);
+	for (std::size_t rank = 0; rank < numberOfCells; ++rank) {
+		ranks[keys[rank].second] = rank;
+	}
+
+	return ranks;
+}
@@ -0,0 +1,34 @@
+#ifndef GRID_CELLORDER_H_
+#define GRID_CELLORDER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Order in which the cells of a grid are laid out in memory. Row-major
+ * keeps neighbors in the first dimension adjacent only, the space-filling
+ * curves keep most spatially adjacent cells close in every dimension. */
+enum CELL_ORDER {
+	ROW_MAJOR, MORTON, HILBERT
+};
+
+/** Z-order key of a cell: the bits of its coordinates interleaved from
+ * the most significant one down, coordinate i contributing bits[i] bits,
+ * so that uneven cell counts per dimension need no padding. */
+std::uint64_t mortonKey(const std::vector<std::size_t>& coordinates,
+		const std::vector<unsigned>& bits);
+
+/** Hilbert key of a cell in a grid of 2^bits cells per dimension
+ * (Skilling's transposed form, interleaved like mortonKey). Consecutive
+ * keys belong to cells sharing a face. */
+std::uint64_t hilbertKey(std::vector<std::size_t> coordinates,
+		unsigned bits);
+
+/** Position of every cell of a row-major grid in the given order, indexed
+ * by the row-major cell number. Empty for ROW_MAJOR, which is the
+ * identity. Throws std::invalid_argument if the keys need more than 64
+ * bits. */
+std::vector<unsigned> cellRanks(CELL_ORDER order,
+		const std::vector<std::size_t>& cellsPerDimension);
+
+#endif
@@ -1,32 +1,79 @@
 #include "Grid.h"
+#include "GridD.h"
 
+#include "../knn/FixedBPQ.h"
+#include "../knn/FixedDimension.h"
+#include "../knn/Neighbor.h"
+#include "../knn/Rerank.h"
+#include "../knn/SmallKQueue.h"
 #include "../model/PointArrayAccessor.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <chrono>
+#include <cstdint>
+#include <functional>
 #include <iterator>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <stdexcept>
 #include <string>
-#include <thread>
 #include <utility>
 #include <vector>
 
-std::size_t Grid::determineCellSize(unsigned k) {
+template<class Metric>
+BasicGrid<Metric>* BasicGrid<Metric>::create(const std::size_t dimension,
+		double * coordinates, std::size_t size, std::size_t cellFillOptimum,
+		unsigned maxNumberOfThreads, unsigned threadLoad,
+		ThreadPool* insertPool) {
+	switch (dimension) {
+	case 1:
+		return new GridD<1, Metric> { coordinates, size, cellFillOptimum,
+				maxNumberOfThreads, threadLoad, insertPool };
+	case 2:
+		return new GridD<2, Metric> { coordinates, size, cellFillOptimum,
+				maxNumberOfThreads, threadLoad, insertPool };
+	case 3:
+		return new GridD<3, Metric> { coordinates, size, cellFillOptimum,
+				maxNumberOfThreads, threadLoad, insertPool };
+	case 4:
+		return new GridD<4, Metric> { coordinates, size, cellFillOptimum,
+				maxNumberOfThreads, threadLoad, insertPool };
+	case 5:
+		return new GridD<5, Metric> { coordinates, size, cellFillOptimum,
+				maxNumberOfThreads, threadLoad, insertPool };
+	case 6:
+		return new GridD<6, Metric> { coordinates, size, cellFillOptimum,
+				maxNumberOfThreads, threadLoad, insertPool };
+	case 7:
+		return new GridD<7, Metric> { coordinates, size, cellFillOptimum,
+				maxNumberOfThreads, threadLoad, insertPool };
+	case 8:
+		return new GridD<8, Metric> { coordinates, size, cellFillOptimum,
+				maxNumberOfThreads, threadLoad, insertPool };
+	default:
+		return new BasicGrid { dimension, coordinates, size, cellFillOptimum,
+				maxNumberOfThreads, threadLoad, insertPool };
+	}
+}
+
+template<class Metric>
+std::size_t BasicGrid<Metric>::determineCellSize(unsigned k) {
 	//Magic *hukuspukus fidibus!*
 	return std::floor(0.27 * k + 1.4);
 }
 
-MBR Grid::initGridMBR(double * coordinates, std::size_t dimension,
+template<class Metric>
+MBR BasicGrid<Metric>::initGridMBR(double * coordinates, std::size_t dimension,
 		std::size_t size) {
 	GridMBR m = GridMBR(dimension);
 	return m.createMBR(coordinates, size);
 }
 
-std::vector<std::size_t> Grid::initProductOfCellsUpToDimension(
+template<class Metric>
+std::vector<std::size_t> BasicGrid<Metric>::initProductOfCellsUpToDimension(
 		std::size_t dimension) const {
 	assert(dimension <= dimension_);
 	std::vector<std::size_t> pOfCellsUpToD(dimension + 1);
@@ -39,103 +86,223 @@ std::vector<std::size_t> Grid::initProductOfCellsUpToDimension(
 	return pOfCellsUpToD;
 }
 
-void Grid::allocPointContainers() {
+template<class Metric>
+void BasicGrid<Metric>::allocPointContainers() {
 	std::size_t numberOfCells = productOfCellsUpToDimension_.at(dimension_);
 	grid_.resize(numberOfCells, PointContainer(dimension_));
+	cellIds_.resize(numberOfCells);
 }
 
-void Grid::insertMultiThreaded(double* coordinates, std::size_t size) {
-	for (std::size_t i = 0; i < size; i += dimension_) {
-		insert(&coordinates[i], true);
-	}
+template<class Metric>
+std::size_t BasicGrid<Metric>::numberOfCells() const {
+	return productOfCellsUpToDimension_[dimension_];
 }
 
-void Grid::insert(double * coordinates, std::size_t size) {
-	assert((size % dimension_) == 0);
+template<class Metric>
+std::size_t BasicGrid<Metric>::cellSlot(unsigned cNumber) const {
+	return cellRank_.empty() ? cNumber : cellRank_[cNumber];
+}
 
-	if (size > threadLoad_) {
-		std::vector<std::thread> insertThreads;
+template<class Metric>
+std::vector<unsigned> BasicGrid<Metric>::cellsInOrder() const {
+	std::vector<unsigned> cells(numberOfCells());
+	for (unsigned cNumber = 0; cNumber < cells.size(); ++cNumber) {
+		cells[cellSlot(cNumber)] = cNumber;
+	}
+	return cells;
+}
 
-		unsigned numberOfThreads =
-				(size / threadLoad_) > maxNumberOfThreads_ ?
-						maxNumberOfThreads_ : (size / threadLoad_);
+template<class Metric>
+std::size_t BasicGrid<Metric>::cellSize(unsigned cNumber) const {
+	if (compact_) {
+		const std::size_t slot = cellSlot(cNumber);
+		return cellOffsets_[slot + 1] - cellOffsets_[slot];
+	}
+	return grid_[cNumber].size();
+}
 
-		//Init locks
-		for (unsigned i = 0; i < grid_.size(); i++) {
-			insertLocks_.push_back(new std::mutex());
-		}
+template<class Metric>
+double* BasicGrid<Metric>::cellData(unsigned cNumber) {
+	return compact_ ?
+			cellCoordinates_.data()
+					+ cellOffsets_[cellSlot(cNumber)] * dimension_ :
+			grid_[cNumber].data();
+}
 
-		//Make some offset calculations
-		std::size_t thread_offset = (size / numberOfThreads);
-		std::size_t step = thread_offset + dimension_
-				- (thread_offset % dimension_);
-		std::size_t lastFullStepOffset = (numberOfThreads - 1) * step;
-		std::size_t endStep = size - lastFullStepOffset;
+template<class Metric>
+const float* BasicGrid<Metric>::cellSinglePrecision(unsigned cNumber) const {
+	if (compact_) {
+		return cellFloats_.empty() ?
+				nullptr :
+				cellFloats_.data()
+						+ cellOffsets_[cellSlot(cNumber)] * dimension_;
+	}
+	return grid_[cNumber].hasSinglePrecision() ?
+			grid_[cNumber].singlePrecision().data() : nullptr;
+}
 
-		//Start the first n-1 threads
-		for (unsigned threadId = 0; threadId < numberOfThreads - 1;
-				++threadId) {
-			insertThreads.push_back(
-					std::thread(&Grid::insertMultiThreaded, this,
-							&coordinates[threadId * step], step));
+template<class Metric>
+std::size_t BasicGrid<Metric>::idInCell(unsigned cNumber,
+		std::size_t p_idx) const {
+	return compact_ ?
+			cellPointIds_[cellOffsets_[cellSlot(cNumber)] + p_idx] :
+			cellIds_[cNumber][p_idx];
+}
 
-		}
+template<class Metric>
+PointVectorAccessor BasicGrid<Metric>::pointInCell(unsigned cNumber,
+		std::size_t p_idx) {
+	if (compact_) {
+		return PointVectorAccessor(cellCoordinates_,
+				(cellOffsets_[cellSlot(cNumber)] + p_idx) * dimension_,
+				dimension_);
+	}
+	return grid_[cNumber][p_idx];
+}
 
-		//Handle last thread separately
-		insertThreads.push_back(
-				std::thread(&Grid::insertMultiThreaded, this,
-						&coordinates[lastFullStepOffset], endStep));
+template<class Metric>
+void BasicGrid<Metric>::insert(double * coordinates, std::size_t size,
+		std::size_t firstId) {
+	assert((size % dimension_) == 0);
+	if (compact_) {
+		throw std::logic_error("Cannot insert into a compact grid.");
+	}
+	//the codes would miss the new points
+	setQuantization(false);
 
-		//Join threads
-		for (unsigned threadId = 0; threadId < numberOfThreads; ++threadId) {
-			insertThreads[threadId].join();
+	const std::size_t numberOfPoints = size / dimension_;
+	const std::size_t cells = numberOfCells();
+	std::size_t numberOfChunks = 1;
+	if (size > threadLoad_) {
+		numberOfChunks =
+				(size / threadLoad_) > maxNumberOfThreads_ ?
+						maxNumberOfThreads_ : (size / threadLoad_);
+	}
+	//every chunk counts all cells, which bounds the counters by the points.
+	//With more cells than points a single histogram is left.
+	numberOfChunks = std::max<std::size_t>(1,
+			std::min(numberOfChunks,
+					numberOfPoints * HISTOGRAM_SLOTS_PER_POINT / cells));
+	const std::size_t chunkPoints = (numberOfPoints + numberOfChunks - 1)
+			/ numberOfChunks;
+	auto runChunks = [&](const std::function<void(std::size_t)>& body) {
+		if (insertPool_) {
+			insertPool_->parallelFor(numberOfChunks, body);
+		} else {
+			parallelFor(numberOfChunks, numberOfChunks, body);
 		}
-	} else {
-		for (std::size_t i = 0; i < size; i += dimension_) {
-			insert(&coordinates[i], false);
+	};
+
+	//first pass: cell of every point, counted per chunk
+	std::vector<unsigned> pointCells(numberOfPoints);
+	std::vector<std::uint32_t> slots(numberOfChunks * cells, 0);
+	runChunks([&](std::size_t chunk) {
+		std::uint32_t* counts = &slots[chunk * cells];
+		const std::size_t last = std::min(numberOfPoints,
+				(chunk + 1) * chunkPoints);
+
+		for (std::size_t p = chunk * chunkPoints; p < last; ++p) {
+			const double* point = &coordinates[p * dimension_];
+			if (!isWithinBounds<0>(point)) {
+				throw std::runtime_error("Point is not within MBR bounds.");
+			}
+			pointCells[p] = cellNumberOf<0>(point);
+			++counts[pointCells[p]];
+		}
+	});
+
+	//prefix sums turn the counts into the first slot of each chunk, cells
+	//grow in memory order
+	for (unsigned cNumber : cellsInOrder()) {
+		std::size_t slot = grid_[cNumber].size();
+		for (std::size_t chunk = 0; chunk < numberOfChunks; ++chunk) {
+			const std::size_t count = slots[chunk * cells + cNumber];
+			slots[chunk * cells + cNumber] = slot;
+			slot += count;
+		}
+		if (slot > std::numeric_limits<std::uint32_t>::max()) {
+			throw std::length_error("Grid cell exceeds 2^32 points.");
+		}
+		if (slot != grid_[cNumber].size()) {
+			grid_[cNumber].resize(slot);
+			cellIds_[cNumber].resize(slot);
 		}
 	}
 
+	//second pass: every chunk writes to its own slots
+	runChunks([&](std::size_t chunk) {
+		std::uint32_t* next = &slots[chunk * cells];
+		const std::size_t last = std::min(numberOfPoints,
+				(chunk + 1) * chunkPoints);
+
+		for (std::size_t p = chunk * chunkPoints; p < last; ++p) {
+			const unsigned cNumber = pointCells[p];
+			const std::size_t slot = next[cNumber]++;
+			std::copy(&coordinates[p * dimension_],
+					&coordinates[(p + 1) * dimension_],
+					grid_[cNumber].data() + slot * dimension_);
+			cellIds_[cNumber][slot] = firstId + p;
+		}
+	});
 }
 
-unsigned Grid::cellNumber(double * point) {
+template<class Metric>
+unsigned BasicGrid<Metric>::cellNumber(double * point) {
+	return cellNumberOf<0>(point);
+}
+
+template<class Metric>
+template<std::size_t D>
+unsigned BasicGrid<Metric>::cellNumberOf(const double * point) const {
+	const std::size_t dimension = FixedDimension<D>::dimension(dimension_);
 	unsigned cellNr = 0;
-	for (std::size_t i = 0; i < dimension_; i++) {
+	for (std::size_t i = 0; i < dimension; i++) {
 
-		cellNr +=
-				productOfCellsUpToDimension_.at(i)
-						* std::floor(
-								(point[i] - mbr_.getLowPoint()[i])
-										/ (gridWidthPerDim_[i]
-												/ cellsPerDimension_[i]));
+		cellNr += productOfCellsUpToDimension_[i]
+				* std::floor((point[i] - lowPoint_[i]) / cellWidthPerDim_[i]);
 
 	}
 
 	return cellNr;
 }
 
-unsigned Grid::cellNumber(PointAccessor* pa) {
+template<class Metric>
+template<std::size_t D>
+bool BasicGrid<Metric>::isWithinBounds(const double * point) const {
+	const std::size_t dimension = FixedDimension<D>::dimension(dimension_);
+	bool isWithin = true;
+
+	for (std::size_t i = 0; i < dimension; i++) {
+		isWithin = isWithin && point[i] >= lowPoint_[i];
+		isWithin = isWithin && point[i] <= highPoint_[i];
+	}
+
+	return isWithin;
+}
+
+template<class Metric>
+unsigned BasicGrid<Metric>::cellNumber(PointAccessor* pa) {
 	return cellNumber(pa->getData() + pa->getOffset());
 }
 
-void Grid::insert(double * point, bool isMultiThreaded) {
-	if (!mbr_.isWithin(point)) {
+template<class Metric>
+void BasicGrid<Metric>::insertPoint(double * point, std::size_t id) {
+	if (compact_) {
+		throw std::logic_error("Cannot insert into a compact grid.");
+	}
+	if (!isWithinBounds<0>(point)) {
 		throw std::runtime_error("Point is not within MBR bounds.");
 	} else {
 		int cellNr = cellNumber(point);
+		setQuantization(false);
 
-		if (isMultiThreaded) {
-			insertLocks_[cellNr]->lock();
-			grid_[cellNr].addPoint(point);
-			insertLocks_[cellNr]->unlock();
-		} else {
-			grid_[cellNr].addPoint(point);
-		}
-
+		grid_[cellNr].addPoint(point);
+		cellIds_[cellNr].push_back(id);
 	}
 }
 
-const std::vector<double> Grid::widthPerDimension() {
+template<class Metric>
+const std::vector<double> BasicGrid<Metric>::widthPerDimension() {
 	std::vector<double> widthPerDim;
 
 	for (std::size_t i = 0; i < dimension_; i++) {
@@ -146,7 +313,31 @@ const std::vector<double> Grid::widthPerDimension() {
 	return widthPerDim;
 }
 
-const std::vector<std::size_t> Grid::calculateCellsPerDimension(
+template<class Metric>
+const std::vector<double> BasicGrid<Metric>::calculateCellWidthPerDimension() const {
+	std::vector<double> cellWidthPerDim(dimension_);
+
+	for (std::size_t i = 0; i < dimension_; i++) {
+		cellWidthPerDim[i] = gridWidthPerDim_[i] / cellsPerDimension_[i];
+	}
+
+	return cellWidthPerDim;
+}
+
+template<class Metric>
+const std::vector<double> BasicGrid<Metric>::boundsOf(
+		PointVectorAccessor corner) {
+	std::vector<double> bounds(corner.dimension());
+
+	for (std::size_t i = 0; i < corner.dimension(); i++) {
+		bounds[i] = corner[i];
+	}
+
+	return bounds;
+}
+
+template<class Metric>
+const std::vector<std::size_t> BasicGrid<Metric>::calculateCellsPerDimension(
 		std::size_t cellFillOptimum) const {
 	std::vector<std::size_t> cellsPerDim(dimension_);
 	double volume = 1.0;
@@ -166,20 +357,29 @@ const std::vector<std::size_t> Grid::calculateCellsPerDimension(
 	return cellsPerDim;
 }
 
-double Grid::findNextClosestCellBorder(PointAccessor* query, int kNNiteration) {
-	assert(mbr_.isWithin(query));
+template<class Metric>
+double BasicGrid<Metric>::findNextClosestCellBorder(PointAccessor* query,
+		int kNNiteration) {
+	return cellBorderDistance<0>(query->getData() + query->getOffset(),
+			kNNiteration);
+}
+
+template<class Metric>
+template<std::size_t D>
+double BasicGrid<Metric>::cellBorderDistance(const double * query,
+		int kNNiteration) const {
+	assert(isWithinBounds<D>(query));
 	assert(kNNiteration >= 0);
 
+	const std::size_t dimension = FixedDimension<D>::dimension(dimension_);
 	double infinity = std::numeric_limits<double>::infinity();
 	double closestDist = infinity;
-	PointVectorAccessor lowPoint = mbr_.getLowPoint();
-	PointVectorAccessor highPoint = mbr_.getHighPoint();
 
-	for (std::size_t d = 0; d < dimension_; d++) {
-		double cellWidth = gridWidthPerDim_[d] / cellsPerDimension_[d];
-		double queryCoordInDim_d = (*query)[d];
-		double queryDistToLowPoint = queryCoordInDim_d - lowPoint[d];
-		double queryDistToHighPoint = highPoint[d] - queryCoordInDim_d;
+	for (std::size_t d = 0; d < dimension; d++) {
+		double cellWidth = cellWidthPerDim_[d];
+		double queryCoordInDim_d = query[d];
+		double queryDistToLowPoint = queryCoordInDim_d - lowPoint_[d];
+		double queryDistToHighPoint = highPoint_[d] - queryCoordInDim_d;
 
 		//row number of cell containing query point
 		unsigned numberOfCellsToLeftBorder = std::floor(
@@ -234,16 +434,14 @@ double Grid::findNextClosestCellBorder(PointAccessor* query, int kNNiteration) {
 		}
 	}
 
-	if (closestDist == infinity) {
-		//This should only happen in last iteration
-		return infinity;
-	} else {
-		return closestDist * closestDist;
-	}
+	//infinity should only happen in the last iteration
+	//and is kept by all metric bounds
+	return Metric::axisBound(closestDist);
 }
 
-void Grid::initMinAndMax(std::vector<int>& min, std::vector<int>& max,
-		int kNN_iteration,
+template<class Metric>
+void BasicGrid<Metric>::initMinAndMax(std::vector<int>& min,
+		std::vector<int>& max, int kNN_iteration,
 		const std::vector<unsigned>& cartesionQueryCoordinates) {
 
 	for (std::size_t d = 0; d < dimension_; d++) {
@@ -268,7 +466,8 @@ void Grid::initMinAndMax(std::vector<int>& min, std::vector<int>& max,
 	}
 }
 
-unsigned Grid::calculateCellNumber(
+template<class Metric>
+unsigned BasicGrid<Metric>::calculateCellNumber(
 		const std::vector<int>& gridCartesianCoords) {
 	unsigned cellNumber = 0;
 
@@ -278,11 +477,12 @@ unsigned Grid::calculateCellNumber(
 	}
 
 	assert(cellNumber >= 0);
-	assert(cellNumber < grid_.size());
+	assert(cellNumber < numberOfCells());
 
 	return cellNumber;
 }
-void Grid::addToResult(const std::vector<int>& shifts,
+template<class Metric>
+void BasicGrid<Metric>::addToResult(const std::vector<int>& shifts,
 		const std::vector<unsigned>& query,
 		std::vector<unsigned>& cellNumbers) {
 	std::vector<int> query_cp(std::begin(query), std::end(query));
@@ -294,9 +494,124 @@ void Grid::addToResult(const std::vector<int>& shifts,
 	cellNumbers.push_back(calculateCellNumber(query_cp));
 }
 
-std::vector<unsigned> Grid::getHyperSquareCellEnvironment(int kNN_iteration,
-		unsigned queryCellNumber, std::vector<unsigned>& cartesianQueryCoords) {
+template<class Metric>
+void BasicGrid<Metric>::initRingTable() {
+	std::size_t maxCells = 0;
+	for (std::size_t cells : cellsPerDimension_) {
+		maxCells = std::max(maxCells, cells);
+	}
+
+	//largest radius whose cube of offsets fits the table
+	int radius = 0;
+	std::size_t side = 1;
+	while (static_cast<std::size_t>(radius + 1) < maxCells) {
+		std::size_t entries = 1;
+		for (std::size_t d = 0; d < dimension_ && entries
+				<= RING_TABLE_ENTRIES_MAX; ++d) {
+			entries *= side + 2;
+		}
+		if (entries > RING_TABLE_ENTRIES_MAX) {
+			break;
+		}
+		++radius;
+		side += 2;
+	}
+
+	std::size_t entries = 1;
+	for (std::size_t d = 0; d < dimension_; ++d) {
+		entries *= side;
+	}
+	std::vector<std::vector<std::pair<long, std::size_t>>> rings(radius + 1);
+	std::vector<int> cube;
+	cube.reserve(entries * dimension_);
+	std::vector<int> shift(dimension_, -radius);
+	for (std::size_t entry = 0; entry < entries; ++entry) {
+		long delta = 0;
+		int ring = 0;
+		for (std::size_t d = 0; d < dimension_; ++d) {
+			delta += shift[d] * static_cast<long>(productOfCellsUpToDimension_[d]);
+			ring = std::max(ring, std::abs(shift[d]));
+			cube.push_back(shift[d]);
+		}
+		rings[ring].push_back(std::make_pair(delta, entry));
+
+		for (std::size_t d = 0; d < dimension_ && ++shift[d] > radius; ++d) {
+			shift[d] = -radius;
+		}
+	}
+
+	ringShifts_.clear();
+	ringDeltas_.clear();
+	ringStarts_.assign(1, 0);
+	for (std::vector<std::pair<long, std::size_t>>& ring : rings) {
+		std::sort(ring.begin(), ring.end());
+		for (const std::pair<long, std::size_t>& offset : ring) {
+			ringDeltas_.push_back(offset.first);
+			ringShifts_.insert(ringShifts_.end(),
+					cube.begin() + offset.second * dimension_,
+					cube.begin() + (offset.second + 1) * dimension_);
+		}
+		ringStarts_.push_back(ringDeltas_.size());
+	}
+}
+
+template<class Metric>
+std::vector<unsigned> BasicGrid<Metric>::getHyperSquareCellEnvironment(
+		int kNN_iteration, unsigned queryCellNumber,
+		std::vector<unsigned>& cartesianQueryCoords) {
 	std::vector<unsigned> cellNumbers;
+	ringCells(kNN_iteration, queryCellNumber, cartesianQueryCoords,
+			cellNumbers);
+	return cellNumbers;
+}
+
+template<class Metric>
+void BasicGrid<Metric>::ringCells(int kNN_iteration, unsigned queryCellNumber,
+		const std::vector<unsigned>& cartesianQueryCoordinates,
+		std::vector<unsigned>& cells) {
+	cells.clear();
+	if (kNN_iteration + 2 > static_cast<int>(ringStarts_.size())) {
+		boundedRingCells(kNN_iteration, queryCellNumber,
+				cartesianQueryCoordinates, cells);
+		return;
+	}
+
+	const std::size_t first = ringStarts_[kNN_iteration];
+	const std::size_t last = ringStarts_[kNN_iteration + 1];
+	bool inside = true;
+	for (std::size_t d = 0; d < dimension_; ++d) {
+		const int coordinate = cartesianQueryCoordinates[d];
+		inside = inside && coordinate >= kNN_iteration
+				&& coordinate + kNN_iteration
+						< static_cast<int>(cellsPerDimension_[d]);
+	}
+
+	if (inside) {
+		for (std::size_t offset = first; offset < last; ++offset) {
+			cells.push_back(queryCellNumber + ringDeltas_[offset]);
+		}
+		return;
+	}
+
+	for (std::size_t offset = first; offset < last; ++offset) {
+		const int* shift = &ringShifts_[offset * dimension_];
+		bool clipped = false;
+		for (std::size_t d = 0; d < dimension_ && !clipped; ++d) {
+			const int coordinate = cartesianQueryCoordinates[d] + shift[d];
+			clipped = coordinate < 0
+					|| coordinate >= static_cast<int>(cellsPerDimension_[d]);
+		}
+		if (!clipped) {
+			cells.push_back(queryCellNumber + ringDeltas_[offset]);
+		}
+	}
+}
+
+template<class Metric>
+void BasicGrid<Metric>::boundedRingCells(int kNN_iteration,
+		unsigned queryCellNumber,
+		const std::vector<unsigned>& cartesianQueryCoordinates,
+		std::vector<unsigned>& cellNumbers) {
 	std::vector<int> min(dimension_);
 	std::vector<int> max(std::begin(cellsPerDimension_),
 			std::end(cellsPerDimension_));
@@ -304,7 +619,7 @@ std::vector<unsigned> Grid::getHyperSquareCellEnvironment(int kNN_iteration,
 		cellNumbers.push_back(queryCellNumber);
 	} else {
 		//determine cell environment for non-trivial cases:
-		initMinAndMax(min, max, kNN_iteration, cartesianQueryCoords);
+		initMinAndMax(min, max, kNN_iteration, cartesianQueryCoordinates);
 		std::vector<int> fix_bounds;
 
 		unsigned last_idx = dimension_ - 1;
@@ -333,7 +648,7 @@ std::vector<unsigned> Grid::getHyperSquareCellEnvironment(int kNN_iteration,
 
 				while (coordinateShifts[overflow_idx] <= max[overflow_idx]) {
 
-					addToResult(coordinateShifts, cartesianQueryCoords,
+					addToResult(coordinateShifts, cartesianQueryCoordinates,
 							cellNumbers);
 
 					++coordinateShifts[last_it_idx];
@@ -362,11 +677,21 @@ std::vector<unsigned> Grid::getHyperSquareCellEnvironment(int kNN_iteration,
 
 	}
 
-	return cellNumbers;
+	//memory order, like the table rings
+	std::sort(cellNumbers.begin(), cellNumbers.end());
 }
 
-std::vector<unsigned> Grid::getCartesian(unsigned cellNumber) {
-	std::vector<unsigned> cartesianCoordinates(dimension_);
+template<class Metric>
+std::vector<unsigned> BasicGrid<Metric>::getCartesian(unsigned cellNumber) {
+	std::vector<unsigned> cartesianCoordinates;
+	getCartesian(cellNumber, cartesianCoordinates);
+	return cartesianCoordinates;
+}
+
+template<class Metric>
+void BasicGrid<Metric>::getCartesian(unsigned cellNumber,
+		std::vector<unsigned>& cartesianCoordinates) {
+	cartesianCoordinates.assign(dimension_, 0);
 	for (std::size_t i = 0; i < dimension_; i++) {
 		cartesianCoordinates[i] = cellNumber % cellsPerDimension_[i];
 		cellNumber = cellNumber / cellsPerDimension_[i];
@@ -374,42 +699,477 @@ std::vector<unsigned> Grid::getCartesian(unsigned cellNumber) {
 			break;
 		}
 	}
+}
 
-	return cartesianCoordinates;
+template<class Metric>
+BPQ<PointVectorAccessor> BasicGrid<Metric>::kNearestNeighbors(unsigned k,
+		PointAccessor* query) {
+	return ringSearch<0>(k, query);
+}
+
+template<class Metric>
+std::size_t BasicGrid<Metric>::kNearestNeighborIds(unsigned k,
+		PointAccessor* query, std::size_t* ids, double* distances,
+		bool finalDistances) {
+	return ringSearchIds<0>(k, query, ids, distances, finalDistances);
 }
 
-BPQ<PointVectorAccessor> Grid::kNearestNeighbors(unsigned k,
+template<class Metric>
+template<std::size_t D>
+BPQ<PointVectorAccessor> BasicGrid<Metric>::ringSearch(unsigned k,
 		PointAccessor* query) {
-	BPQ<PointVectorAccessor> candidates(k);
+	const bool approximate = quantizedPoints_ || singlePrecision_;
 
+	//the queues need room for a candidate
+	if (k == 0) {
+		return BPQ<PointVectorAccessor>(0);
+	}
+	if ((approximate ? k + rerankSlack_ : k) <= SMALL_K_MAX) {
+		return ringSearchWith<D, SmallKQueue<PointVectorAccessor>>(k, query);
+	}
+	return ringSearchWith<D, BPQ<PointVectorAccessor>>(k, query);
+}
+
+template<class Metric>
+template<std::size_t D, class Queue>
+BPQ<PointVectorAccessor> BasicGrid<Metric>::ringSearchWith(unsigned k,
+		PointAccessor* query) {
+	assert(D == 0 || D == dimension_);
+	const bool approximate = quantizedPoints_ || singlePrecision_;
+	Queue candidates(approximate ? k + rerankSlack_ : k);
+	const double* queryCoords = query->getData() + query->getOffset();
+
+	collectCandidates<D>(queryCoords, candidates,
+			[this](unsigned cNumber, std::size_t p_idx) {
+				return pointInCell(cNumber, p_idx);
+			});
+
+	if (approximate) {
+		return rerank<Metric, D>(k, queryCoords,
+				FixedDimension<D>::dimension(dimension_), candidates);
+	}
+
+	return toBPQ(candidates);
+}
+
+template<class Metric>
+template<std::size_t D, class Queue, class MakePoint>
+void BasicGrid<Metric>::collectCandidates(const double* queryCoords,
+		Queue& candidates, MakePoint makePoint) {
+	//encoded once per search for all visited cells
+	static thread_local QueryCodes queryCodes;
+	if (quantizedPoints_) {
+		quantizedPoints_->encodeQuery(queryCoords, queryCodes);
+	}
+
+	if (traversal_ == BEST_FIRST) {
+		collectBestFirst<D>(queryCoords, queryCodes, candidates, makePoint);
+	} else {
+		collectRings<D>(queryCoords, queryCodes, candidates, makePoint);
+	}
+}
+
+template<class Metric>
+template<std::size_t D, class Queue, class MakePoint>
+void BasicGrid<Metric>::scanCell(unsigned cNumber, const double* queryCoords,
+		const QueryCodes& queryCodes, Queue& candidates,
+		MakePoint& makePoint) {
+	const std::size_t dimension = FixedDimension<D>::dimension(dimension_);
+	const std::size_t cellPoints = cellSize(cNumber);
+	const double* cellCoords = cellData(cNumber);
+
+	if (quantizedPoints_) {
+		static thread_local std::vector<double> quantizedDistances;
+		const std::size_t firstCode = quantizedOffsets_[cNumber];
+		assert(quantizedOffsets_[cNumber + 1] - firstCode == cellPoints);
+		quantizedDistances.resize(cellPoints);
+		quantizedPoints_->squaredDistances(queryCodes, firstCode,
+				firstCode + cellPoints, quantizedDistances.data());
+
+		for (std::size_t p_idx = 0; p_idx < cellPoints; ++p_idx) {
+			double current_dist = quantizedDistances[p_idx];
+			if (current_dist < candidates.max_dist()) {
+				candidates.push(makePoint(cNumber, p_idx), current_dist);
+			}
+		}
+		return;
+	}
+
+	const float* cellFloats =
+			singlePrecision_ ? cellSinglePrecision(cNumber) : nullptr;
+	if (cellFloats) {
+		for (std::size_t p_idx = 0; p_idx < cellPoints; ++p_idx) {
+			double current_dist = Metric::distance(
+					&cellFloats[p_idx * dimension], queryCoords, dimension);
+			if (current_dist < candidates.max_dist()) {
+				candidates.push(makePoint(cNumber, p_idx), current_dist);
+			}
+		}
+		return;
+	}
+
+	for (std::size_t p_idx = 0; p_idx < cellPoints; ++p_idx) {
+		double current_dist = FixedDimensionDistance<Metric, D>::distance(
+				&cellCoords[p_idx * dimension], queryCoords, dimension,
+				candidates.max_dist());
+		if (current_dist < candidates.max_dist()) {
+			candidates.push(makePoint(cNumber, p_idx), current_dist);
+		}
+	}
+}
+
+template<class Metric>
+template<std::size_t D, class Queue, class MakePoint>
+void BasicGrid<Metric>::collectRings(const double* queryCoords,
+		const QueryCodes& queryCodes, Queue& candidates,
+		MakePoint makePoint) {
 	int kNN_iteration = 0;
 	double closestDistToCellBorder;
-	std::multimap<double, PointVectorAccessor> unconsidered_pts;
-	unsigned queryCellNo = cellNumber(query);
-	std::vector<unsigned> cartesianQueryCoords = getCartesian(queryCellNo);
+	unsigned queryCellNo = cellNumberOf<D>(queryCoords);
+	//buffers of the calling thread, no allocations once they fit
+	static thread_local std::vector<unsigned> cartesianQueryCoords;
+	static thread_local std::vector<unsigned> cells;
+	getCartesian(queryCellNo, cartesianQueryCoords);
 	do {
-		closestDistToCellBorder = findNextClosestCellBorder(query,
+		closestDistToCellBorder = cellBorderDistance<D>(queryCoords,
 				kNN_iteration);
 
-		for (unsigned cNumber : getHyperSquareCellEnvironment(kNN_iteration,
-				queryCellNo, cartesianQueryCoords)) {
-			PointContainer& pc = grid_[cNumber];
+		ringCells(kNN_iteration, queryCellNo, cartesianQueryCoords, cells);
+		if (!cellRank_.empty()) {
+			//visit the cells in the order they are laid out in memory,
+			//rings come in row-major order
+			std::sort(cells.begin(), cells.end(),
+					[this](unsigned left, unsigned right) {
+						return cellSlot(left) < cellSlot(right);
+					});
+		}
 
-			for (std::size_t p_idx = 0; p_idx < pc.size(); ++p_idx) {
-				auto point = pc[p_idx];
-				double current_dist = Metrics::squared_euclidean(point, query);
-				if (current_dist < candidates.max_dist()) {
-					candidates.push(point, current_dist);
-				}
-			}
+		for (unsigned cNumber : cells) {
+			scanCell<D>(cNumber, queryCoords, queryCodes, candidates,
+					makePoint);
 		}
 		++kNN_iteration;
 	} while (candidates.max_dist() > closestDistToCellBorder);
+}
+
+template<class Metric>
+template<std::size_t D>
+double BasicGrid<Metric>::cellBound(const double* queryCoords,
+		const unsigned* cartesian) const {
+	const std::size_t dimension = FixedDimension<D>::dimension(dimension_);
+	double bound = 0.0;
+
+	for (std::size_t d = 0; d < dimension; ++d) {
+		const double low = lowPoint_[d] + cartesian[d] * cellWidthPerDim_[d];
+		const double high = low + cellWidthPerDim_[d];
+		double axisDistance = 0.0;
+		if (queryCoords[d] < low) {
+			axisDistance = low - queryCoords[d];
+		} else if (queryCoords[d] > high) {
+			axisDistance = queryCoords[d] - high;
+		}
+		bound = Metric::boxBound(bound, axisDistance);
+	}
 
-	return candidates;
+	return bound;
+}
+
+template<class Metric>
+template<std::size_t D, class Queue, class MakePoint>
+void BasicGrid<Metric>::collectBestFirst(const double* queryCoords,
+		const QueryCodes& queryCodes, Queue& candidates,
+		MakePoint makePoint) {
+	const std::size_t dimension = FixedDimension<D>::dimension(dimension_);
+	typedef std::pair<double, unsigned> BoundedCell;
+	const auto closestFirst = [](const BoundedCell& left,
+			const BoundedCell& right) {
+		return left.first > right.first;
+	};
+	//buffers of the calling thread, no allocations once they fit
+	static thread_local std::vector<BoundedCell> heap;
+	static thread_local std::vector<unsigned> cartesian;
+	//cells reached by the current query carry its stamp
+	static thread_local std::vector<unsigned> stamps;
+	static thread_local unsigned stamp = 0;
+
+	if (stamps.size() < numberOfCells()) {
+		stamps.resize(numberOfCells(), 0);
+	}
+	if (++stamp == 0) {
+		std::fill(stamps.begin(), stamps.end(), 0);
+		stamp = 1;
+	}
+	heap.clear();
+
+	const unsigned queryCellNo = cellNumberOf<D>(queryCoords);
+	heap.push_back(BoundedCell(0.0, queryCellNo));
+	stamps[queryCellNo] = stamp;
+
+	//a cell is reached through face neighbors whose bounds do not grow
+	//beyond its own, so cells leave the heap in the order of their bounds
+	while (!heap.empty() && heap.front().first < candidates.max_dist()) {
+		std::pop_heap(heap.begin(), heap.end(), closestFirst);
+		const unsigned cNumber = heap.back().second;
+		heap.pop_back();
+
+		scanCell<D>(cNumber, queryCoords, queryCodes, candidates,
+				makePoint);
+
+		getCartesian(cNumber, cartesian);
+		for (std::size_t d = 0; d < dimension; ++d) {
+			const unsigned coordinate = cartesian[d];
+			for (int step = -1; step <= 1; step += 2) {
+				if ((step < 0 && coordinate == 0)
+						|| (step > 0 && coordinate + 1 == cellsPerDimension_[d])) {
+					continue;
+				}
+				const unsigned neighbor = step < 0 ?
+						cNumber - productOfCellsUpToDimension_[d] :
+						cNumber + productOfCellsUpToDimension_[d];
+				if (stamps[neighbor] == stamp) {
+					continue;
+				}
+				stamps[neighbor] = stamp;
+
+				cartesian[d] = coordinate + step;
+				const double bound = cellBound<D>(queryCoords,
+						cartesian.data());
+				cartesian[d] = coordinate;
+				if (bound < candidates.max_dist()) {
+					heap.push_back(BoundedCell(bound, neighbor));
+					std::push_heap(heap.begin(), heap.end(), closestFirst);
+				}
+			}
+		}
+	}
 }
 
-void Grid::to_stream(std::ostream& os) {
+template<class Metric>
+template<std::size_t D>
+std::size_t BasicGrid<Metric>::ringSearchIds(unsigned k, PointAccessor* query,
+		std::size_t* ids, double* distances, bool finalDistances) {
+	assert(D == 0 || D == dimension_);
+	if (k == 0) {
+		return 0;
+	}
+	const std::size_t dimension = FixedDimension<D>::dimension(dimension_);
+	const bool approximate = quantizedPoints_ || singlePrecision_;
+	const unsigned numberOfCandidates = approximate ? k + rerankSlack_ : k;
+	const double* queryCoords = query->getData() + query->getOffset();
+	NeighborScratch<std::uint64_t>& scratch =
+			NeighborScratch<std::uint64_t>::local();
+	std::vector<Neighbor>& neighbors = scratch.neighbors;
+	neighbors.clear();
+
+	//candidates are identified by cell number and index in the cell
+	auto cellPoint = [](unsigned cNumber, std::size_t p_idx) {
+		return static_cast<std::uint64_t>(cNumber) << 32 | p_idx;
+	};
+	if (numberOfCandidates <= SMALL_K_MAX) {
+		SmallKQueue<std::uint64_t> candidates(numberOfCandidates);
+		collectCandidates<D>(queryCoords, candidates, cellPoint);
+		appendNeighbors(candidates, neighbors);
+	} else {
+		FixedBPQ<std::uint64_t>& candidates = scratch.candidates;
+		candidates.reset(numberOfCandidates);
+		collectCandidates<D>(queryCoords, candidates, cellPoint);
+		appendNeighbors(candidates, neighbors);
+	}
+
+	for (Neighbor& neighbor : neighbors) {
+		const unsigned cNumber = neighbor.id >> 32;
+		const std::size_t p_idx = neighbor.id & 0xFFFFFFFFu;
+
+		if (approximate) {
+			neighbor.distance = FixedDimensionDistance<Metric, D>::distance(
+					cellData(cNumber) + p_idx * dimension, queryCoords,
+					dimension, std::numeric_limits<double>::infinity());
+		}
+		neighbor.id = idInCell(cNumber, p_idx);
+	}
+
+	sortNeighbors(k, neighbors);
+	return writeNeighbors<Metric>(neighbors, ids, distances, finalDistances);
+}
+
+template<class Metric>
+void BasicGrid<Metric>::setSinglePrecision(bool singlePrecision) {
+	singlePrecision_ = singlePrecision;
+
+	if (singlePrecision_) {
+		if (compact_) {
+			cellFloats_.assign(cellCoordinates_.begin(),
+					cellCoordinates_.end());
+		}
+		for (PointContainer& pc : grid_) {
+			pc.computeSinglePrecision();
+		}
+	}
+}
+
+template<class Metric>
+void BasicGrid<Metric>::setQuantization(bool enabled,
+		QUANTIZATION quantization) {
+	quantizedPoints_.reset();
+	quantizedOffsets_.clear();
+	if (!enabled) {
+		return;
+	}
+	if (!Metric::TILED) {
+		throw std::invalid_argument(
+				"Quantized cells require the squared euclidean metric.");
+	}
+
+	const unsigned cells = numberOfCells();
+	std::vector<std::size_t> offsets(cells + 1, 0);
+	for (unsigned cNumber = 0; cNumber < cells; ++cNumber) {
+		offsets[cNumber + 1] = offsets[cNumber] + cellSize(cNumber);
+	}
+	std::unique_ptr<QuantizedPoints> codes(
+			QuantizedPoints::create(quantization, mbr_, offsets[cells]));
+	for (unsigned cNumber = 0; cNumber < cells; ++cNumber) {
+		codes->encodePoints(offsets[cNumber], cellData(cNumber),
+				cellSize(cNumber));
+	}
+
+	quantizedOffsets_.swap(offsets);
+	quantizedPoints_ = std::move(codes);
+}
+
+template<class Metric>
+std::size_t BasicGrid<Metric>::quantizedMemoryUsage() const {
+	if (!quantizedPoints_) {
+		return 0;
+	}
+	return quantizedPoints_->memoryUsage()
+			+ quantizedOffsets_.capacity() * sizeof(std::size_t);
+}
+
+template<class Metric>
+void BasicGrid<Metric>::setCompactLayout(bool compact) {
+	if (compact == compact_) {
+		return;
+	}
+	const std::size_t cells = numberOfCells();
+
+	const std::vector<unsigned> ordered = cellsInOrder();
+
+	if (compact) {
+		//offsets and data are indexed by the slot of a cell
+		cellOffsets_.assign(cells + 1, 0);
+		for (std::size_t slot = 0; slot < cells; ++slot) {
+			cellOffsets_[slot + 1] = cellOffsets_[slot]
+					+ grid_[ordered[slot]].size();
+		}
+		cellCoordinates_.resize(cellOffsets_[cells] * dimension_);
+		cellPointIds_.resize(cellOffsets_[cells]);
+
+		for (std::size_t slot = 0; slot < cells; ++slot) {
+			const unsigned cNumber = ordered[slot];
+			std::copy(grid_[cNumber].begin(), grid_[cNumber].end(),
+					cellCoordinates_.begin() + cellOffsets_[slot] * dimension_);
+			std::copy(cellIds_[cNumber].begin(), cellIds_[cNumber].end(),
+					cellPointIds_.begin() + cellOffsets_[slot]);
+		}
+		if (singlePrecision_) {
+			cellFloats_.assign(cellCoordinates_.begin(),
+					cellCoordinates_.end());
+		}
+
+		//swapping releases the per-cell storage, clear() would keep it
+		std::vector<PointContainer>().swap(grid_);
+		std::vector<std::vector<std::size_t>>().swap(cellIds_);
+	} else {
+		//cells are allocated in slot order
+		allocPointContainers();
+		for (std::size_t slot = 0; slot < cells; ++slot) {
+			const unsigned cNumber = ordered[slot];
+			grid_[cNumber].add(cellData(cNumber),
+					cellSize(cNumber) * dimension_);
+			cellIds_[cNumber].assign(
+					cellPointIds_.begin() + cellOffsets_[slot],
+					cellPointIds_.begin() + cellOffsets_[slot + 1]);
+			if (singlePrecision_) {
+				grid_[cNumber].computeSinglePrecision();
+			}
+		}
+
+		std::vector<double>().swap(cellCoordinates_);
+		std::vector<std::size_t>().swap(cellOffsets_);
+		std::vector<std::size_t>().swap(cellPointIds_);
+		std::vector<float>().swap(cellFloats_);
+	}
+	compact_ = compact;
+}
+
+template<class Metric>
+void BasicGrid<Metric>::setCellOrder(CELL_ORDER order) {
+	if (order == cellOrder_) {
+		return;
+	}
+	const bool compact = compact_;
+	setCompactLayout(false);
+	cellRank_ = cellRanks(order, cellsPerDimension_);
+	cellOrder_ = order;
+
+	if (compact) {
+		setCompactLayout(true);
+		return;
+	}
+
+	//reallocate the cells one after the other in the new order
+	std::vector<PointContainer> reordered(numberOfCells(),
+			PointContainer(dimension_));
+	std::vector<std::vector<std::size_t>> reorderedIds(numberOfCells());
+	for (unsigned cNumber : cellsInOrder()) {
+		reordered[cNumber] = grid_[cNumber];
+		reorderedIds[cNumber] = cellIds_[cNumber];
+	}
+	grid_.swap(reordered);
+	cellIds_.swap(reorderedIds);
+}
+
+template<class Metric>
+CELL_ORDER BasicGrid<Metric>::cellOrder() const {
+	return cellOrder_;
+}
+
+template<class Metric>
+void BasicGrid<Metric>::setTraversal(GRID_TRAVERSAL traversal) {
+	traversal_ = traversal;
+}
+
+template<class Metric>
+GRID_TRAVERSAL BasicGrid<Metric>::traversal() const {
+	return traversal_;
+}
+
+template<class Metric>
+std::size_t BasicGrid<Metric>::cellMemoryUsage() const {
+	std::size_t bytes = cellCoordinates_.capacity() * sizeof(double)
+			+ cellOffsets_.capacity() * sizeof(std::size_t)
+			+ cellPointIds_.capacity() * sizeof(std::size_t)
+			+ cellFloats_.capacity() * sizeof(float);
+
+	bytes += grid_.capacity() * sizeof(PointContainer)
+			+ cellIds_.capacity() * sizeof(std::vector<std::size_t>);
+	for (const PointContainer& pc : grid_) {
+		bytes += pc.memoryUsage();
+	}
+	for (const std::vector<std::size_t>& ids : cellIds_) {
+		bytes += ids.capacity() * sizeof(std::size_t);
+	}
+
+	return bytes;
+}
+
+template<class Metric>
+void BasicGrid<Metric>::setRerankSlack(unsigned slack) {
+	rerankSlack_ = slack;
+}
+
+template<class Metric>
+void BasicGrid<Metric>::to_stream(std::ostream& os) {
 	os << "Grid[\n";
 	int bucketCounter = 0;
 	os << "dimension: " << dimension_ << +'\n';
@@ -420,11 +1180,12 @@ void Grid::to_stream(std::ostream& os) {
 	}
 
 	os << "]\n";
-	os << "number of buckets: " << grid_.size() << '\n';
-	os << "points / bucket: " << (numberOfPoints_ / grid_.size()) << '\n';
+	os << "number of buckets: " << numberOfCells() << '\n';
+	os << "points / bucket: " << (numberOfPoints_ / numberOfCells()) << '\n';
 	mbr_.to_stream(os);
 
-	for (PointContainer bucket : grid_) {
+	for (unsigned cNumber = 0; cNumber < numberOfCells(); ++cNumber) {
+		PointContainer bucket(dimension_, cellData(cNumber), cellSize(cNumber));
 		if (!bucket.empty()) {
 			os << "bucket " << bucketCounter << "[\n";
 			bucket.to_stream(os);
@@ -435,3 +1196,35 @@ void Grid::to_stream(std::ostream& os) {
 
 	os << "\n]";
 }
+
+//Run-time dimension and all specializations used by GridD.
+#define INSTANTIATE_GRID_DIMENSION(METRIC, D) \
+	template bool BasicGrid<METRIC>::isWithinBounds<D>(const double *) const; \
+	template unsigned BasicGrid<METRIC>::cellNumberOf<D>(const double *) const; \
+	template double BasicGrid<METRIC>::cellBorderDistance<D>(const double *, \
+			int) const; \
+	template BPQ<PointVectorAccessor> BasicGrid<METRIC>::ringSearch<D>( \
+			unsigned, PointAccessor*); \
+	template std::size_t BasicGrid<METRIC>::ringSearchIds<D>(unsigned, \
+			PointAccessor*, std::size_t*, double*, bool);
+
+#define INSTANTIATE_GRID(METRIC) \
+	template class BasicGrid<METRIC>; \
+	INSTANTIATE_GRID_DIMENSION(METRIC, 0) \
+	INSTANTIATE_GRID_DIMENSION(METRIC, 1) \
+	INSTANTIATE_GRID_DIMENSION(METRIC, 2) \
+	INSTANTIATE_GRID_DIMENSION(METRIC, 3) \
+	INSTANTIATE_GRID_DIMENSION(METRIC, 4) \
+	INSTANTIATE_GRID_DIMENSION(METRIC, 5) \
+	INSTANTIATE_GRID_DIMENSION(METRIC, 6) \
+	INSTANTIATE_GRID_DIMENSION(METRIC, 7) \
+	INSTANTIATE_GRID_DIMENSION(METRIC, 8)
+
+INSTANTIATE_GRID(SquaredEuclidean)
+INSTANTIATE_GRID(Manhattan)
+INSTANTIATE_GRID(Chebyshev)
+INSTANTIATE_GRID(Minkowski<1>)
+INSTANTIATE_GRID(Minkowski<2>)
+INSTANTIATE_GRID(Minkowski<3>)
+INSTANTIATE_GRID(Minkowski<4>)
+INSTANTIATE_GRID(Cosine)
@@ -4,14 +4,31 @@
 #include "../util/Representable.h"
 #include "../model/PointAccessor.h"
 #include "../knn/KnnProcessor.h"
+#include "../knn/MetricPolicies.h"
+#include "../model/QuantizedPointContainer.h"
+#include "../util/ThreadPool.h"
+#include "CellOrder.h"
 #include "GridMBR.h"
 
 #include <cstddef>
-#include <mutex>
+#include <memory>
 #include <vector>
 #include <utility>
 
-class Grid: public Representable, public KnnProcessor<PointVectorAccessor> {
+/** Order in which a kNN query visits the cells of a grid: RING scans
+ * whole hyper-square shells around the query cell, BEST_FIRST the single
+ * cells by their distance bounds, which skips the corners of the shells
+ * that lie outside the final k-ball. */
+enum GRID_TRAVERSAL {
+	RING, BEST_FIRST
+};
+
+/** Uniform grid index, distances and cell pruning bounds are provided by
+ * the Metric policy (see MetricPolicies.h). Grid is the squared euclidean
+ * instantiation. */
+template<class Metric>
+class BasicGrid: public Representable,
+		public KnnProcessor<PointVectorAccessor> {
 public:
 	/** Dimension of the grid space. */
 	const std::size_t dimension_;
@@ -26,21 +43,76 @@ public:
 	/** Product of cells up to dimension,
 	 * necessary for several numerical calculations. */
 	const std::vector<std::size_t> productOfCellsUpToDimension_;
+	/** Cell width in each dimension. */
+	const std::vector<double> cellWidthPerDim_;
+	/** Lower and upper grid bounds, cached from mbr_ for the hot paths. */
+	const std::vector<double> lowPoint_;
+	const std::vector<double> highPoint_;
 	/** The grid is modeled as a vector of buckets containing points. */
 	std::vector<PointContainer> grid_;
-	/** Locks for multi-threaded insert operation. */
-	std::vector<std::mutex*> insertLocks_;
+	/** Ids of the points of each bucket, i.e. their positions in the
+	 * inserted coordinates. */
+	std::vector<std::vector<std::size_t>> cellIds_;
+	/** Whether the cells are stored in the compact layout below instead of
+	 * grid_ and cellIds_ (see setCompactLayout). */
+	bool compact_;
+	/** Compact layout: coordinates of all points ordered by cell, cell c
+	 * holds the points [cellOffsets_[c], cellOffsets_[c + 1]). */
+	std::vector<double> cellCoordinates_;
+	/** Prefix sums of the cell sizes, one entry per cell plus one. */
+	std::vector<std::size_t> cellOffsets_;
+	/** Ids of the points in cellCoordinates_. */
+	std::vector<std::size_t> cellPointIds_;
+	/** Single precision copy of cellCoordinates_, empty unless single
+	 * precision is enabled. */
+	std::vector<float> cellFloats_;
+	/** Order in which queries visit the cells (see setTraversal). */
+	GRID_TRAVERSAL traversal_;
+	/** Memory order of the cells (see setCellOrder). */
+	CELL_ORDER cellOrder_;
+	/** Slot of every cell in memory order, indexed by cell number. Empty
+	 * for ROW_MAJOR, where the slot is the cell number. */
+	std::vector<unsigned> cellRank_;
 	/** We assume this the optimal number points per cell.
 	 *  Tests revealed this thresholds works good for k < 1000. */
 	static const std::size_t CELL_FILL_OPTIMUM_DEFAULT = 200;
 	/** Default value for max number of insert threads. */
 	static const unsigned MAX_NUMBER_OF_THREADS_DEFAULT = 20;
-	/** Default value for max points to be inserted single-threaded. */
-	static const unsigned THREAD_LOAD_DEFAULT = 100000000;
+	/** Default value for the coordinates inserted per insert thread. */
+	static const unsigned THREAD_LOAD_DEFAULT = 1 << 21;
+	/** Per-chunk cell counters of an insert per inserted point, fewer
+	 * chunks are used where the grid has more cells. */
+	static const std::size_t HISTOGRAM_SLOTS_PER_POINT = 4;
 	/** Maximum number of insert threads. */
 	unsigned maxNumberOfThreads_;
-	/** Threshold to switch from single- to multi-threaded. */
+	/** Coordinates per insert thread, smaller inserts are single-threaded. */
 	unsigned threadLoad_;
+	/** Runs multi-threaded inserts if set, threads are started per insert
+	 * otherwise. */
+	ThreadPool* insertPool_;
+	/** Whether cells are scanned on their single precision copies. */
+	bool singlePrecision_;
+	/** Quantized codes of all cells, one after the other by cell number,
+	 * null unless quantization is enabled. */
+	std::unique_ptr<QuantizedPoints> quantizedPoints_;
+	/** First code of every cell in quantizedPoints_ and the end of the
+	 * last one. */
+	std::vector<std::size_t> quantizedOffsets_;
+	/** Additional candidates re-ranked after a single precision or
+	 * quantized search. */
+	unsigned rerankSlack_;
+	/** Default value for rerankSlack_. */
+	static const unsigned RERANK_SLACK_DEFAULT = 16;
+	/** Upper bound on the cell offsets of the ring table, rings beyond it
+	 * are enumerated on the fly. */
+	static const std::size_t RING_TABLE_ENTRIES_MAX = 1 << 15;
+	/** Cell offsets of the rings 0 .. ringStarts_.size() - 2 around a cell,
+	 * dimension_ shifts per offset. Ring r holds the offsets
+	 * [ringStarts_[r], ringStarts_[r + 1]), sorted by their deltas. */
+	std::vector<int> ringShifts_;
+	/** Cell number delta of every offset, valid unless it is clipped. */
+	std::vector<long> ringDeltas_;
+	std::vector<std::size_t> ringStarts_;
 	/** Create an MBR around the grid points. */
 	static MBR initGridMBR(double * coordinates, std::size_t dimension,
 			std::size_t size);
@@ -48,12 +120,17 @@ public:
 	/** Caveat: Only works properly with uniformly distributed points
 	 * and k < 1000-ish. */
 	static std::size_t determineCellSize(unsigned k);
-	/** Insert a set of points into the grid. */
-	void insert(double * coordinates, std::size_t size);
+	/** Insert a set of points into the grid, the first one gets id
+	 * firstId. A counting sort without locks: chunks of the points are
+	 * counted per cell in parallel, the prefix sums of the counts give
+	 * every chunk its own slots in each cell, and the chunks copy their
+	 * points there in parallel. Points keep their order within a cell.
+	 * The 32-bit counters of all chunks are limited to
+	 * HISTOGRAM_SLOTS_PER_POINT per point. */
+	void insert(double * coordinates, std::size_t size,
+			std::size_t firstId = 0);
 	/** Insert single point into grid. */
-	void insert(double * point, bool isMultiThreaded);
-	/** Insert, using locks. */
-	void insertMultiThreaded(double* coordinates, std::size_t size);
+	void insertPoint(double * point, std::size_t id = 0);
 	/** Calculates grid width per dimension. */
 	const std::vector<double> widthPerDimension();
 	/** Returns vector containing number of cells per dimension. */
@@ -69,15 +146,102 @@ public:
 	unsigned cellNumber(PointAccessor * point);
 	/** Allocates memory for grid_ vector. */
 	void allocPointContainers();
+	/** Number of cells of the grid. */
+	std::size_t numberOfCells() const;
+	/** Position of a cell in memory order. */
+	std::size_t cellSlot(unsigned cNumber) const;
+	/** Cell numbers ordered by their slots. */
+	std::vector<unsigned> cellsInOrder() const;
+	/** Cell accessors for both layouts. */
+	std::size_t cellSize(unsigned cNumber) const;
+	double* cellData(unsigned cNumber);
+	/** Single precision coordinates of a cell, nullptr if it has none. */
+	const float* cellSinglePrecision(unsigned cNumber) const;
+	/** Id and accessor of the p_idx-th point of a cell. */
+	std::size_t idInCell(unsigned cNumber, std::size_t p_idx) const;
+	PointVectorAccessor pointInCell(unsigned cNumber, std::size_t p_idx);
+	/** Calculates cell width per dimension. */
+	const std::vector<double> calculateCellWidthPerDimension() const;
+	/** Copies the coordinates of an MBR corner. */
+	static const std::vector<double> boundsOf(PointVectorAccessor corner);
+
+	/** Dimension-specializable hot paths, D > 0 fixes the dimension at
+	 * compile time (see GridD), D == 0 uses dimension_. */
+	/** Checks whether a point lies within the grid bounds. */
+	template<std::size_t D>
+	bool isWithinBounds(const double * point) const;
+	/** Calculates the grid index (cell number) for a point. */
+	template<std::size_t D>
+	unsigned cellNumberOf(const double * point) const;
+	/** Returns the metric's lower bound for points beyond the closest
+	 * border of the cell environment visited in a particular kNN iteration,
+	 * infinity if no border is left. */
+	template<std::size_t D>
+	double cellBorderDistance(const double * query, int kNNiteration) const;
+	/** Ring-by-ring kNN search around the query cell. Candidates are
+	 * collected in a SmallKQueue if at most SMALL_K_MAX are needed, in a
+	 * BPQ otherwise. */
+	template<std::size_t D>
+	BPQ<PointVectorAccessor> ringSearch(unsigned k, PointAccessor* query);
+	/** Ring search collecting the candidates in a Queue (BPQ or
+	 * SmallKQueue). */
+	template<std::size_t D, class Queue>
+	BPQ<PointVectorAccessor> ringSearchWith(unsigned k, PointAccessor* query);
+	/** Collects the candidates with the traversal of the grid, pushing
+	 * points as makePoint(cell number, index in cell). */
+	template<std::size_t D, class Queue, class MakePoint>
+	void collectCandidates(const double* queryCoords, Queue& candidates,
+			MakePoint makePoint);
+	/** Pushes the points of a cell that beat the candidates, filtered on
+	 * queryCodes if the cells are quantized. */
+	template<std::size_t D, class Queue, class MakePoint>
+	void scanCell(unsigned cNumber, const double* queryCoords,
+			const QueryCodes& queryCodes, Queue& candidates,
+			MakePoint& makePoint);
+	/** Visits the rings around the query cell until the candidates are
+	 * final. */
+	template<std::size_t D, class Queue, class MakePoint>
+	void collectRings(const double* queryCoords,
+			const QueryCodes& queryCodes, Queue& candidates,
+			MakePoint makePoint);
+	/** Lower bound of the distance from the query to the cell at the given
+	 * cartesian coordinates. */
+	template<std::size_t D>
+	double cellBound(const double* queryCoords,
+			const unsigned* cartesian) const;
+	/** Visits the cells closest first by their lower bounds, expanding the
+	 * face neighbors of every visited cell, until the closest unvisited
+	 * bound reaches the k-th candidate distance. */
+	template<std::size_t D, class Queue, class MakePoint>
+	void collectBestFirst(const double* queryCoords,
+			const QueryCodes& queryCodes, Queue& candidates,
+			MakePoint makePoint);
+	/** Index-based ring search (see kNearestNeighborIds). */
+	template<std::size_t D>
+	std::size_t ringSearchIds(unsigned k, PointAccessor* query,
+			std::size_t* ids, double* distances, bool finalDistances);
 
 	/** kNN utility methods: */
-	/** Returns squared distance to query point. */
+	/** Returns the lower bound of cellBorderDistance for a query point. */
 	double findNextClosestCellBorder(PointAccessor* query, int kNNiteration);
 	/** Return a list of cell numbers for certain kNN iteration. */
 	std::vector<unsigned> getHyperSquareCellEnvironment(int kNN_iteration,
 			unsigned queryCell, std::vector<unsigned>& cartesianQueryCoords);
+	/** Fills the buffer cells with the cells of a ring, without allocating
+	 * once it fits them: table rings are a walk over the precomputed
+	 * offsets, clipped at the grid bounds unless the whole ring is inside. */
+	void ringCells(int kNN_iteration, unsigned queryCell,
+			const std::vector<unsigned>& cartesianQueryCoords,
+			std::vector<unsigned>& cells);
+	/** Enumerates a ring beyond the table from its clipped bounds. */
+	void boundedRingCells(int kNN_iteration, unsigned queryCell,
+			const std::vector<unsigned>& cartesianQueryCoords,
+			std::vector<unsigned>& cells);
+	/** Precomputes the ring offsets up to RING_TABLE_ENTRIES_MAX. */
+	void initRingTable();
 	/** Returns Cartesian coordinate for a given cell number. */
 	std::vector<unsigned> getCartesian(unsigned cellNumber);
+	void getCartesian(unsigned cellNumber, std::vector<unsigned>& coordinates);
 	void initMinAndMax(std::vector<int>& min, std::vector<int>& max,
 			int kNN_iteration,
 			const std::vector<unsigned>& cartesionQueryCoordinates);
@@ -87,26 +251,83 @@ public:
 	unsigned calculateCellNumber(const std::vector<int>& gridCartesianCoords);
 
 //public:
-	Grid(const std::size_t dimension, double * coordinates, std::size_t size,
-			std::size_t cellFillOptimum = Grid::CELL_FILL_OPTIMUM_DEFAULT,
+	BasicGrid(const std::size_t dimension, double * coordinates,
+			std::size_t size, std::size_t cellFillOptimum =
+					CELL_FILL_OPTIMUM_DEFAULT,
 			unsigned maxNumberOfThreads = MAX_NUMBER_OF_THREADS_DEFAULT,
-			unsigned threadLoad = THREAD_LOAD_DEFAULT) :
+			unsigned threadLoad = THREAD_LOAD_DEFAULT, ThreadPool* insertPool =
+					nullptr) :
 			dimension_(dimension), mbr_(
-					Grid::initGridMBR(coordinates, dimension, size)), numberOfPoints_(
+					initGridMBR(coordinates, dimension, size)), numberOfPoints_(
 					size / dimension), gridWidthPerDim_(widthPerDimension()), cellsPerDimension_(
 					calculateCellsPerDimension(cellFillOptimum)), productOfCellsUpToDimension_(
-					initProductOfCellsUpToDimension(dimension)), maxNumberOfThreads_(
-					maxNumberOfThreads), threadLoad_(threadLoad) {
+					initProductOfCellsUpToDimension(dimension)), cellWidthPerDim_(
+					calculateCellWidthPerDimension()), lowPoint_(
+					boundsOf(mbr_.getLowPoint())), highPoint_(
+					boundsOf(mbr_.getHighPoint())), compact_(false), traversal_(
+					RING), cellOrder_(ROW_MAJOR), maxNumberOfThreads_(
+					maxNumberOfThreads), threadLoad_(threadLoad), insertPool_(
+					insertPool), singlePrecision_(
+					false), rerankSlack_(RERANK_SLACK_DEFAULT) {
 
 		allocPointContainers();
+		initRingTable();
 		insert(coordinates, size);
 	}
 
+	/** Creates a dimension-specialized grid (GridD) for dimensions up to
+	 * MAX_FIXED_DIMENSION, a BasicGrid otherwise. */
+	static BasicGrid* create(const std::size_t dimension,
+			double * coordinates, std::size_t size, std::size_t cellFillOptimum =
+					CELL_FILL_OPTIMUM_DEFAULT, unsigned maxNumberOfThreads =
+					MAX_NUMBER_OF_THREADS_DEFAULT, unsigned threadLoad =
+					THREAD_LOAD_DEFAULT, ThreadPool* insertPool = nullptr);
+
 	/** Returns a vector of the k-nearest neighbors for a given query point. */
 	BPQ<PointVectorAccessor> kNearestNeighbors(unsigned k, PointAccessor* query)
 			override;
+	std::size_t kNearestNeighborIds(unsigned k, PointAccessor* query,
+			std::size_t* ids, double* distances, bool finalDistances = false)
+					override;
+	/** Creates single precision copies of all cells and scans them from
+	 * now on. Each search collects k + slack candidates on floats and
+	 * re-ranks them with double precision distances. Cells modified later
+	 * fall back to double precision. */
+	void setSinglePrecision(bool singlePrecision);
+	/** Encodes all cells relative to the grid MBR into one array of codes
+	 * and filters them on the codes from now on, refining k + slack
+	 * candidates with the exact distances of the points, which stay
+	 * resident. Takes precedence over single precision. Inserts drop the
+	 * codes, searches are exact again until the next call. Throws
+	 * std::invalid_argument unless the metric is squared euclidean. */
+	void setQuantization(bool enabled, QUANTIZATION quantization = INT8);
+	/** Bytes occupied by the codes of the quantized cells and their
+	 * offsets, without the points. */
+	std::size_t quantizedMemoryUsage() const;
+	/** Moves the points from one growable container per cell into a single
+	 * array ordered by cell (compact), or back. Compact cells take no
+	 * capacity slack and the cells of a ring row are adjacent in memory.
+	 * Points cannot be inserted into a compact grid. */
+	void setCompactLayout(bool compact);
+	/** Lays the cells out in memory along a space-filling curve, so that
+	 * the cells of a ring search are close to each other in every
+	 * dimension. Cell numbers stay row-major, the order decides where a
+	 * cell is stored and in which order the cells of a ring are scanned.
+	 * Applies to both layouts, per-cell containers are reallocated in the
+	 * new order. */
+	void setCellOrder(CELL_ORDER order);
+	CELL_ORDER cellOrder() const;
+	/** Selects how queries visit the cells, RING by default. */
+	void setTraversal(GRID_TRAVERSAL traversal);
+	GRID_TRAVERSAL traversal() const;
+	/** Bytes occupied by the cells in the current layout, including unused
+	 * capacity and per-cell containers. */
+	std::size_t cellMemoryUsage() const;
+	void setRerankSlack(unsigned slack);
 	/** Returns string representation of grid object. */
 	void to_stream(std::ostream& os) override;
 };
 
+typedef BasicGrid<SquaredEuclidean> Grid;
+
 #endif
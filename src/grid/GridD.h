@@ -0,0 +1,41 @@
+#ifndef GRID_GRIDD_H_
+#define GRID_GRIDD_H_
+
+#include "Grid.h"
+#include "../knn/FixedDimension.h"
+
+#include <cstddef>
+
+/** BasicGrid with the dimension fixed at compile time: cell number, bounds
+ * checks, cell border distances and point distances of the kNN search are
+ * fully unrolled. Available for D up to MAX_FIXED_DIMENSION. */
+template<std::size_t D, class Metric = SquaredEuclidean>
+class GridD: public BasicGrid<Metric> {
+	static_assert(D > 0 && D <= MAX_FIXED_DIMENSION,
+			"GridD is only instantiated for D in [1, MAX_FIXED_DIMENSION]");
+
+public:
+	GridD(double * coordinates, std::size_t size, std::size_t cellFillOptimum =
+			BasicGrid<Metric>::CELL_FILL_OPTIMUM_DEFAULT,
+			unsigned maxNumberOfThreads =
+					BasicGrid<Metric>::MAX_NUMBER_OF_THREADS_DEFAULT,
+			unsigned threadLoad = BasicGrid<Metric>::THREAD_LOAD_DEFAULT,
+			ThreadPool* insertPool = nullptr) :
+			BasicGrid<Metric>(D, coordinates, size, cellFillOptimum,
+					maxNumberOfThreads, threadLoad, insertPool) {
+	}
+
+	BPQ<PointVectorAccessor> kNearestNeighbors(unsigned k, PointAccessor* query)
+			override {
+		return this->template ringSearch<D>(k, query);
+	}
+
+	std::size_t kNearestNeighborIds(unsigned k, PointAccessor* query,
+			std::size_t* ids, double* distances, bool finalDistances = false)
+					override {
+		return this->template ringSearchIds<D>(k, query, ids, distances,
+				finalDistances);
+	}
+};
+
+#endif
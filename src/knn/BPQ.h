@@ -10,6 +10,7 @@
 #include <limits>
 #include <queue>
 #include <utility>
+#include <vector>
 
 template<class T>
 class BPQ {
@@ -37,6 +38,18 @@ public:
 
 	}
 
+	/** Builds a full or partial queue from at most max_size candidates at
+	 * once, heapifying them in linear time. */
+	BPQ(std::size_t max_size, std::vector<std::pair<T, double>>&& candidates) :
+			BPQ(max_size) {
+		assert(candidates.size() <= max_size);
+		candidates_ = kNNResultQueue(cmp_, std::move(candidates));
+
+		if (!candidates_.empty() && candidates_.size() == max_size_) {
+			max_distance_ = topDistance();
+		}
+	}
+
 	void push(T pa, double distance);
 	void pop();
 	T topPoint();
@@ -0,0 +1,298 @@
+#ifndef KNN_DISTANCEKERNELS_H_
+#define KNN_DISTANCEKERNELS_H_
+
+#include "SimdLanes.h"
+
+#include <cmath>
+#include <cstddef>
+
+//Kernels are only instantiated within target specific wrappers,
+//vector ABI notes for the generic target do not apply.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+/** Squared euclidean distance of two contiguous coordinate rows.
+ * Full vectors are accumulated lane-wise, the remaining coordinates are
+ * handled by a single partial (zero-padded) vector. Single precision
+ * points (T = float) are widened on load and accumulated in double. */
+template<class L, class T>
+KNN_INLINE double squaredEuclideanKernel(const T* p, const double* q,
+		std::size_t dimension) {
+	typename L::Vec acc = L::zero();
+	std::size_t d = 0;
+
+	for (; d + L::WIDTH <= dimension; d += L::WIDTH) {
+		typename L::Vec diff = L::sub(L::load(p + d), L::load(q + d));
+		acc = L::fmadd(diff, diff, acc);
+	}
+
+	if (d < dimension) {
+		std::size_t rest = dimension - d;
+		typename L::Vec diff = L::sub(L::loadPartial(p + d, rest),
+				L::loadPartial(q + d, rest));
+		acc = L::fmadd(diff, diff, acc);
+	}
+
+	return L::hsum(acc);
+}
+
+/** Manhattan (L1) distance of two contiguous coordinate rows. */
+template<class L>
+KNN_INLINE double manhattanKernel(const double* p, const double* q,
+		std::size_t dimension) {
+	typename L::Vec acc = L::zero();
+	std::size_t d = 0;
+
+	for (; d + L::WIDTH <= dimension; d += L::WIDTH) {
+		acc = L::add(acc, L::abs(L::sub(L::load(p + d), L::load(q + d))));
+	}
+
+	if (d < dimension) {
+		std::size_t rest = dimension - d;
+		acc = L::add(acc,
+				L::abs(L::sub(L::loadPartial(p + d, rest),
+						L::loadPartial(q + d, rest))));
+	}
+
+	return L::hsum(acc);
+}
+
+/** Chebyshev (L-infinity) distance of two contiguous coordinate rows. Zero
+ * padded tail lanes do not affect the maximum of absolute values. */
+template<class L>
+KNN_INLINE double chebyshevKernel(const double* p, const double* q,
+		std::size_t dimension) {
+	typename L::Vec acc = L::zero();
+	std::size_t d = 0;
+
+	for (; d + L::WIDTH <= dimension; d += L::WIDTH) {
+		acc = L::max(acc, L::abs(L::sub(L::load(p + d), L::load(q + d))));
+	}
+
+	if (d < dimension) {
+		std::size_t rest = dimension - d;
+		acc = L::max(acc,
+				L::abs(L::sub(L::loadPartial(p + d, rest),
+						L::loadPartial(q + d, rest))));
+	}
+
+	return L::hmax(acc);
+}
+
+/** Raises every lane to a positive integer power by repeated squaring.
+ * Works in place, returning vectors from untargeted helpers would change
+ * their ABI. */
+template<class L>
+KNN_INLINE void raiseToPower(typename L::Vec& value, unsigned exponent) {
+	typename L::Vec base = value;
+	value = L::set1(1.0);
+
+	while (exponent > 0) {
+		if (exponent & 1) {
+			value = L::mul(value, base);
+		}
+		base = L::mul(base, base);
+		exponent >>= 1;
+	}
+}
+
+/** Sum of the p-th powers of the absolute coordinate differences, i.e. the
+ * Minkowski distance without the final root. */
+template<class L>
+KNN_INLINE double minkowskiKernel(const double* p, const double* q,
+		std::size_t dimension, unsigned power) {
+	typename L::Vec acc = L::zero();
+	std::size_t d = 0;
+
+	for (; d + L::WIDTH <= dimension; d += L::WIDTH) {
+		typename L::Vec diff = L::abs(L::sub(L::load(p + d), L::load(q + d)));
+		raiseToPower<L>(diff, power);
+		acc = L::add(acc, diff);
+	}
+
+	if (d < dimension) {
+		std::size_t rest = dimension - d;
+		typename L::Vec diff = L::abs(
+				L::sub(L::loadPartial(p + d, rest),
+						L::loadPartial(q + d, rest)));
+		raiseToPower<L>(diff, power);
+		acc = L::add(acc, diff);
+	}
+
+	return L::hsum(acc);
+}
+
+/** Cosine distance 1 - cos(p, q) of two contiguous coordinate rows, dot
+ * product and both norms are accumulated in one pass. Rows of norm zero
+ * have distance 1 to everything. */
+template<class L>
+KNN_INLINE double cosineKernel(const double* p, const double* q,
+		std::size_t dimension) {
+	typename L::Vec dot = L::zero();
+	typename L::Vec pNorm = L::zero();
+	typename L::Vec qNorm = L::zero();
+	std::size_t d = 0;
+
+	for (; d + L::WIDTH <= dimension; d += L::WIDTH) {
+		typename L::Vec pCoords = L::load(p + d);
+		typename L::Vec qCoords = L::load(q + d);
+		dot = L::fmadd(pCoords, qCoords, dot);
+		pNorm = L::fmadd(pCoords, pCoords, pNorm);
+		qNorm = L::fmadd(qCoords, qCoords, qNorm);
+	}
+
+	if (d < dimension) {
+		std::size_t rest = dimension - d;
+		typename L::Vec pCoords = L::loadPartial(p + d, rest);
+		typename L::Vec qCoords = L::loadPartial(q + d, rest);
+		dot = L::fmadd(pCoords, qCoords, dot);
+		pNorm = L::fmadd(pCoords, pCoords, pNorm);
+		qNorm = L::fmadd(qCoords, qCoords, qNorm);
+	}
+
+	double norms = L::hsum(pNorm) * L::hsum(qNorm);
+
+	return norms > 0.0 ? 1.0 - L::hsum(dot) / std::sqrt(norms) : 1.0;
+}
+
+/** Coordinates accumulated between two early-abandon checks, a multiple of
+ * every lane width. */
+static const std::size_t ABANDON_CHUNK = 16;
+
+/** Squared euclidean distance which stops once the partial sum of a chunk
+ * of ABANDON_CHUNK coordinates exceeds the threshold and returns that
+ * partial sum. Coordinates are accumulated as in squaredEuclideanKernel,
+ * so distances not exceeding the threshold are identical to it. */
+template<class L>
+KNN_INLINE double boundedSquaredEuclideanKernel(const double* p,
+		const double* q, std::size_t dimension, double threshold) {
+	typename L::Vec acc = L::zero();
+	std::size_t d = 0;
+
+	while (d + ABANDON_CHUNK < dimension) {
+		for (std::size_t chunkEnd = d + ABANDON_CHUNK; d < chunkEnd; d +=
+				L::WIDTH) {
+			typename L::Vec diff = L::sub(L::load(p + d), L::load(q + d));
+			acc = L::fmadd(diff, diff, acc);
+		}
+
+		double partial = L::hsum(acc);
+		if (partial > threshold) {
+			return partial;
+		}
+	}
+
+	for (; d + L::WIDTH <= dimension; d += L::WIDTH) {
+		typename L::Vec diff = L::sub(L::load(p + d), L::load(q + d));
+		acc = L::fmadd(diff, diff, acc);
+	}
+
+	if (d < dimension) {
+		std::size_t rest = dimension - d;
+		typename L::Vec diff = L::sub(L::loadPartial(p + d, rest),
+				L::loadPartial(q + d, rest));
+		acc = L::fmadd(diff, diff, acc);
+	}
+
+	return L::hsum(acc);
+}
+
+/** Squared euclidean distances of a panel of points to a tile of TILE
+ * queries. The tile is stored dimension-major (tile[d * TILE + q]), so
+ * every point coordinate is broadcast once and compared against all queries
+ * held in registers. Each lane sums its coordinates in order without FMA
+ * (see KNN_NO_CONTRACT), which gives the same results as the scalar
+ * kernel.
+ * distances[p * TILE + q] receives the distance of point p to query q. */
+template<class L, std::size_t TILE>
+KNN_INLINE void squaredEuclideanTileKernel(const double* points,
+		std::size_t numberOfPoints, const double* queryTile,
+		std::size_t dimension, double* distances) {
+	static_assert(TILE % L::WIDTH == 0, "TILE must be a multiple of WIDTH");
+	static const std::size_t VECTORS = TILE / L::WIDTH;
+
+	for (std::size_t p = 0; p < numberOfPoints; ++p) {
+		const double* point = points + p * dimension;
+		typename L::Vec acc[VECTORS];
+
+		for (std::size_t v = 0; v < VECTORS; ++v) {
+			acc[v] = L::zero();
+		}
+
+		for (std::size_t d = 0; d < dimension; ++d) {
+			typename L::Vec coord = L::set1(point[d]);
+			const double* queries = queryTile + d * TILE;
+
+			for (std::size_t v = 0; v < VECTORS; ++v) {
+				typename L::Vec diff = L::sub(coord,
+						L::load(queries + v * L::WIDTH));
+				acc[v] = L::add(acc[v], L::mul(diff, diff));
+			}
+		}
+
+		for (std::size_t v = 0; v < VECTORS; ++v) {
+			L::store(distances + p * TILE + v * L::WIDTH, acc[v]);
+		}
+	}
+}
+
+/** Dot products of ROWS consecutive points with a dimension-major tile of
+ * TILE queries, kept in ROWS * TILE / WIDTH accumulator registers. */
+template<class L, std::size_t TILE, std::size_t ROWS>
+KNN_INLINE void dotProductRows(const double* points, const double* queryTile,
+		std::size_t dimension, double* dots) {
+	static const std::size_t VECTORS = TILE / L::WIDTH;
+	typename L::Vec acc[ROWS][VECTORS];
+
+	for (std::size_t r = 0; r < ROWS; ++r) {
+		for (std::size_t v = 0; v < VECTORS; ++v) {
+			acc[r][v] = L::zero();
+		}
+	}
+
+	for (std::size_t d = 0; d < dimension; ++d) {
+		const double* queries = queryTile + d * TILE;
+
+		for (std::size_t v = 0; v < VECTORS; ++v) {
+			typename L::Vec query = L::load(queries + v * L::WIDTH);
+
+			for (std::size_t r = 0; r < ROWS; ++r) {
+				acc[r][v] = L::fmadd(L::set1(points[r * dimension + d]), query,
+						acc[r][v]);
+			}
+		}
+	}
+
+	for (std::size_t r = 0; r < ROWS; ++r) {
+		for (std::size_t v = 0; v < VECTORS; ++v) {
+			L::store(dots + r * TILE + v * L::WIDTH, acc[r][v]);
+		}
+	}
+}
+
+/** Blocked dot-product kernel: dots[p * TILE + q] receives the dot product
+ * of point p and query q of a dimension-major query tile. Points are
+ * register-blocked four at a time, so every loaded query vector is reused
+ * for four points. */
+template<class L, std::size_t TILE>
+KNN_INLINE void dotProductTileKernel(const double* points,
+		std::size_t numberOfPoints, const double* queryTile,
+		std::size_t dimension, double* dots) {
+	static_assert(TILE % L::WIDTH == 0, "TILE must be a multiple of WIDTH");
+	static const std::size_t ROWS = 4;
+	std::size_t p = 0;
+
+	for (; p + ROWS <= numberOfPoints; p += ROWS) {
+		dotProductRows<L, TILE, ROWS>(points + p * dimension, queryTile,
+				dimension, dots + p * TILE);
+	}
+
+	for (; p < numberOfPoints; ++p) {
+		dotProductRows<L, TILE, 1>(points + p * dimension, queryTile,
+				dimension, dots + p * TILE);
+	}
+}
+
+#pragma GCC diagnostic pop
+
+#endif
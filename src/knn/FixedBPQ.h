@@ -0,0 +1,185 @@
+#ifndef KNN_FIXEDBPQ_H_
+#define KNN_FIXEDBPQ_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/** Bounded priority queue of (index, distance) pairs, keeping the
+ * capacity smallest distances like BPQ. Storage is allocated once and
+ * reused across queries via reset(), the comparison is inlined and an
+ * entry takes 16 bytes instead of an accessor with vtable. The max-heap
+ * is 4-ary, which halves the sift-down depth of large queues and keeps
+ * the children of a node within one cache line. */
+template<class Index = std::uint32_t>
+class FixedBPQ {
+public:
+	struct Entry {
+		double distance;
+		Index index;
+	};
+
+	static const std::size_t ARITY = 4;
+
+private:
+	std::vector<Entry> heap_;
+	std::size_t capacity_;
+	std::size_t size_;
+	double max_distance_;
+
+	void siftUp(std::size_t position);
+	void siftDown(std::size_t position);
+
+public:
+	explicit FixedBPQ(std::size_t capacity) :
+			heap_(capacity), capacity_(capacity), size_(0), max_distance_(
+					std::numeric_limits<double>::infinity()) {
+	}
+
+	/** Empties the queue, keeping its storage. */
+	void reset();
+	/** Empties the queue and changes its capacity, allocating only if the
+	 * capacity grows beyond all previous ones. */
+	void reset(std::size_t capacity);
+	/** Adds a candidate, requires distance < max_dist(). A full queue drops
+	 * its farthest entry. */
+	void push(Index index, double distance);
+	void pop();
+	Index topIndex() const;
+	double topDistance() const;
+	/** Distance candidates have to beat, infinity until the queue is
+	 * full. */
+	double max_dist() const;
+	std::size_t size() const;
+	bool empty() const;
+	bool notFull() const;
+	/** Entries in heap order. */
+	const Entry* data() const;
+};
+
+template<class Index>
+inline void FixedBPQ<Index>::reset() {
+	size_ = 0;
+	max_distance_ = std::numeric_limits<double>::infinity();
+}
+
+template<class Index>
+inline void FixedBPQ<Index>::reset(std::size_t capacity) {
+	if (heap_.size() < capacity) {
+		heap_.resize(capacity);
+	}
+	capacity_ = capacity;
+	reset();
+}
+
+template<class Index>
+inline void FixedBPQ<Index>::siftUp(std::size_t position) {
+	Entry entry = heap_[position];
+
+	while (position > 0) {
+		std::size_t parent = (position - 1) / ARITY;
+		if (heap_[parent].distance >= entry.distance) {
+			break;
+		}
+		heap_[position] = heap_[parent];
+		position = parent;
+	}
+
+	heap_[position] = entry;
+}
+
+template<class Index>
+inline void FixedBPQ<Index>::siftDown(std::size_t position) {
+	Entry entry = heap_[position];
+
+	while (true) {
+		std::size_t first = position * ARITY + 1;
+		if (first >= size_) {
+			break;
+		}
+
+		std::size_t last = first + ARITY < size_ ? first + ARITY : size_;
+		std::size_t largest = first;
+		for (std::size_t child = first + 1; child < last; ++child) {
+			if (heap_[child].distance > heap_[largest].distance) {
+				largest = child;
+			}
+		}
+
+		if (heap_[largest].distance <= entry.distance) {
+			break;
+		}
+		heap_[position] = heap_[largest];
+		position = largest;
+	}
+
+	heap_[position] = entry;
+}
+
+template<class Index>
+inline void FixedBPQ<Index>::push(Index index, double distance) {
+	assert(distance < max_distance_);
+	assert(capacity_ > 0);
+
+	if (size_ == capacity_) {
+		//replace the farthest entry instead of pop and push
+		heap_[0] = Entry { distance, index };
+		siftDown(0);
+	} else {
+		heap_[size_] = Entry { distance, index };
+		siftUp(size_++);
+	}
+
+	if (size_ == capacity_) {
+		max_distance_ = heap_[0].distance;
+	}
+}
+
+template<class Index>
+inline void FixedBPQ<Index>::pop() {
+	assert(size_ > 0);
+
+	heap_[0] = heap_[--size_];
+	if (size_ > 0) {
+		siftDown(0);
+	}
+}
+
+template<class Index>
+inline Index FixedBPQ<Index>::topIndex() const {
+	return heap_[0].index;
+}
+
+template<class Index>
+inline double FixedBPQ<Index>::topDistance() const {
+	return heap_[0].distance;
+}
+
+template<class Index>
+inline double FixedBPQ<Index>::max_dist() const {
+	return max_distance_;
+}
+
+template<class Index>
+inline std::size_t FixedBPQ<Index>::size() const {
+	return size_;
+}
+
+template<class Index>
+inline bool FixedBPQ<Index>::empty() const {
+	return size_ == 0;
+}
+
+template<class Index>
+inline bool FixedBPQ<Index>::notFull() const {
+	return size_ < capacity_;
+}
+
+template<class Index>
+inline const typename FixedBPQ<Index>::Entry* FixedBPQ<Index>::data() const {
+	return heap_.data();
+}
+
+#endif
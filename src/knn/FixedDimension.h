@@ -0,0 +1,82 @@
+#ifndef KNN_FIXEDDIMENSION_H_
+#define KNN_FIXEDDIMENSION_H_
+
+#include "MetricPolicies.h"
+#include "Metrics.h"
+
+#include <cstddef>
+
+/** Largest dimension dimension-specialized engines are compiled for. */
+static const std::size_t MAX_FIXED_DIMENSION = 8;
+
+/** Squared euclidean distance, recursively expanded at compile time.
+ * Coordinates are summed in the same order as the scalar kernel. */
+template<std::size_t D>
+struct UnrolledSquaredEuclidean {
+	static inline double distance(const double* p, const double* q) {
+		double diff = p[D - 1] - q[D - 1];
+		return UnrolledSquaredEuclidean<D - 1>::distance(p, q) + diff * diff;
+	}
+};
+
+template<>
+struct UnrolledSquaredEuclidean<0> {
+	static inline double distance(const double*, const double*) {
+		return 0.0;
+	}
+};
+
+/** Dimension policy of the specialized engines. D > 0 fixes the dimension
+ * at compile time, D == 0 denotes a dimension only known at run time. */
+template<std::size_t D>
+struct FixedDimension {
+	static inline std::size_t dimension(std::size_t) {
+		return D;
+	}
+	static inline double squared_euclidean(const double* p, const double* q,
+			std::size_t) {
+		return UnrolledSquaredEuclidean<D>::distance(p, q);
+	}
+	/** Few fixed coordinates are cheaper to sum than to check. */
+	static inline double squared_euclidean(const double* p, const double* q,
+			std::size_t, double) {
+		return UnrolledSquaredEuclidean<D>::distance(p, q);
+	}
+};
+
+template<>
+struct FixedDimension<0> {
+	static inline std::size_t dimension(std::size_t runtimeDimension) {
+		return runtimeDimension;
+	}
+	static inline double squared_euclidean(const double* p, const double* q,
+			std::size_t dimension) {
+		return Metrics::squared_euclidean(p, q, dimension);
+	}
+	static inline double squared_euclidean(const double* p, const double* q,
+			std::size_t dimension, double threshold) {
+		return Metrics::squared_euclidean(p, q, dimension, threshold);
+	}
+};
+
+/** Distance of a metric policy under a dimension policy. Squared euclidean
+ * distances are unrolled for fixed dimensions, other metrics call their
+ * kernels with the fixed dimension. */
+template<class Metric, std::size_t D>
+struct FixedDimensionDistance {
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension, double threshold) {
+		return Metric::distance(p, q, FixedDimension<D>::dimension(dimension),
+				threshold);
+	}
+};
+
+template<std::size_t D>
+struct FixedDimensionDistance<SquaredEuclidean, D> {
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension, double threshold) {
+		return FixedDimension<D>::squared_euclidean(p, q, dimension, threshold);
+	}
+};
+
+#endif
@@ -2,9 +2,13 @@
 #define KNN_KNNPROCESSOR_H_
 
 #include "../model/PointAccessor.h"
+#include "../model/PointContainer.h"
+#include "../util/ParallelFor.h"
 #include "BPQ.h"
 
 #include <cassert>
+#include <cstddef>
+#include <limits>
 #include <queue>
 #include <functional>
 #include <vector>
@@ -13,6 +17,9 @@
 template<class T_BPQ>
 class BPQ;
 
+/** Id of the unused entries of batch result rows. */
+static const std::size_t NO_NEIGHBOR = static_cast<std::size_t>(-1);
+
 template<class T>
 class KnnProcessor {
 
@@ -24,8 +31,38 @@ public:
 	virtual BPQ<T> kNearestNeighbors(unsigned k,
 			PointAccessor* query) = 0;
 
+	/** Writes the ids (positions in the indexed points) and distances of
+	 * the k-nearest neighbors into ids and distances, closest first. Both
+	 * need room for k entries. Returns the number of neighbors, less than
+	 * k only if fewer points are indexed. With finalDistances, distances
+	 * are converted to the metric itself (e.g. euclidean instead of
+	 * squared euclidean), which is done for the returned neighbors only. */
+	virtual std::size_t kNearestNeighborIds(unsigned k, PointAccessor* query,
+			std::size_t* ids, double* distances,
+			bool finalDistances = false) = 0;
+
+	/** Answers every point of queries on up to numberOfThreads threads,
+	 * which pick queries by work stealing (see parallelFor). Row q of the
+	 * k-column matrices ids and distances receives the result of query q
+	 * as written by kNearestNeighborIds, entries beyond the neighbors found
+	 * are set to NO_NEIGHBOR and infinity. kNearestNeighborIds has to be
+	 * safe for concurrent queries, which holds for all processors as long
+	 * as they are not modified during the batch. */
+	virtual void kNearestNeighborIdsBatch(unsigned k, PointContainer& queries,
+			unsigned numberOfThreads, std::size_t* ids, double* distances,
+			bool finalDistances = false);
+
 	/** Lookup the closest point for input query point. */
 	BPQ<T> nearestNeighbor(PointAccessor* query);
+
+protected:
+	/** Batch driver of kNearestNeighborIdsBatch, answering query q with
+	 * lookup(query, row ids, row distances), which returns the number of
+	 * neighbors written. */
+	template<class Lookup>
+	void batchIds(unsigned k, PointContainer& queries,
+			unsigned numberOfThreads, std::size_t* ids, double* distances,
+			Lookup lookup);
 };
 
 template<class T>
@@ -36,6 +73,38 @@ template<class T>
 KnnProcessor<T>::~KnnProcessor() {
 }
 
+template<class T>
+void KnnProcessor<T>::kNearestNeighborIdsBatch(unsigned k,
+		PointContainer& queries, unsigned numberOfThreads, std::size_t* ids,
+		double* distances, bool finalDistances) {
+	batchIds(k, queries, numberOfThreads, ids, distances,
+			[=](PointAccessor* query, std::size_t* rowIds,
+					double* rowDistances) {
+				return this->kNearestNeighborIds(k, query, rowIds,
+						rowDistances, finalDistances);
+			});
+}
+
+template<class T>
+template<class Lookup>
+void KnnProcessor<T>::batchIds(unsigned k, PointContainer& queries,
+		unsigned numberOfThreads, std::size_t* ids, double* distances,
+		Lookup lookup) {
+	const std::size_t rowSize = k;
+
+	parallelFor(queries.size(), numberOfThreads, [&](std::size_t q) {
+		PointVectorAccessor query = queries[q];
+		std::size_t* rowIds = ids + q * rowSize;
+		double* rowDistances = distances + q * rowSize;
+
+		for (std::size_t i = lookup(&query, rowIds, rowDistances);
+				i < rowSize; ++i) {
+			rowIds[i] = NO_NEIGHBOR;
+			rowDistances[i] = std::numeric_limits<double>::infinity();
+		}
+	});
+}
+
 template<class T>
 BPQ<T> KnnProcessor<T>::nearestNeighbor(PointAccessor* query) {
 	BPQ<T> nNQueue = kNearestNeighbors(1, query);
@@ -0,0 +1,200 @@
+#ifndef KNN_METRICPOLICIES_H_
+#define KNN_METRICPOLICIES_H_
+
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+/** Metric policies are the template parameter of the kNN engines
+ * (BasicNaiveKnn, BasicGrid, BasicNaiveMapReduce). A policy provides
+ * - distance(p, q, dimension): the value results are ranked and reported
+ *   by, monotone in the metric itself (e.g. squared euclidean),
+ * - distance(p, q, dimension, threshold): may stop once threshold is
+ *   exceeded and return any value above it,
+ * - distance(const float* p, q, dimension): single precision points
+ *   against a double precision query, computed in double,
+ * - axisBound(axisDistance): lower bound of the distance of two points
+ *   whose coordinates differ by axisDistance in one dimension, used to
+ *   prune grid cells,
+ * - boxBound(bound, axisDistance): adds the axis distance of one more
+ *   dimension to the lower bound of the distance to a box (e.g. a grid
+ *   cell), starting from 0,
+ * - finalize(distance): the metric value of a reported distance, e.g. the
+ *   euclidean distance, applied on request to final results only,
+ * - TILED: whether the squared euclidean kernels apply that have no
+ *   counterpart for other metrics (blocked batches, quantized filters). */
+
+/** Squared euclidean distance, the default metric. */
+struct SquaredEuclidean {
+	static const bool TILED = true;
+
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension) {
+		return Metrics::squared_euclidean(p, q, dimension);
+	}
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension, double threshold) {
+		return Metrics::squared_euclidean(p, q, dimension, threshold);
+	}
+	static inline double distance(const float* p, const double* q,
+			std::size_t dimension) {
+		return Metrics::squared_euclidean(p, q, dimension);
+	}
+	static inline double axisBound(double axisDistance) {
+		return axisDistance * axisDistance;
+	}
+	static inline double boxBound(double bound, double axisDistance) {
+		return bound + axisBound(axisDistance);
+	}
+	static inline double finalize(double distance) {
+		return std::sqrt(distance);
+	}
+};
+
+/** Manhattan (L1) distance. */
+struct Manhattan {
+	static const bool TILED = false;
+
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension) {
+		return Metrics::manhattan(p, q, dimension);
+	}
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension, double) {
+		return Metrics::manhattan(p, q, dimension);
+	}
+	/** Single precision rows are not vectorized for this metric. */
+	static inline double distance(const float* p, const double* q,
+			std::size_t dimension) {
+		double sum = 0.0;
+		for (std::size_t d = 0; d < dimension; ++d) {
+			sum += std::fabs(p[d] - q[d]);
+		}
+		return sum;
+	}
+	static inline double axisBound(double axisDistance) {
+		return axisDistance;
+	}
+	static inline double boxBound(double bound, double axisDistance) {
+		return bound + axisBound(axisDistance);
+	}
+	static inline double finalize(double distance) {
+		return distance;
+	}
+};
+
+/** Chebyshev (L-infinity) distance. */
+struct Chebyshev {
+	static const bool TILED = false;
+
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension) {
+		return Metrics::chebyshev(p, q, dimension);
+	}
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension, double) {
+		return Metrics::chebyshev(p, q, dimension);
+	}
+	/** Single precision rows are not vectorized for this metric. */
+	static inline double distance(const float* p, const double* q,
+			std::size_t dimension) {
+		double maximum = 0.0;
+		for (std::size_t d = 0; d < dimension; ++d) {
+			maximum = std::max(maximum, std::fabs(p[d] - q[d]));
+		}
+		return maximum;
+	}
+	static inline double axisBound(double axisDistance) {
+		return axisDistance;
+	}
+	static inline double boxBound(double bound, double axisDistance) {
+		return std::max(bound, axisDistance);
+	}
+	static inline double finalize(double distance) {
+		return distance;
+	}
+};
+
+/** Minkowski distance of order P, reported without the final root
+ * (sum of P-th powers), which preserves the ranking. The engines are
+ * instantiated for the orders 1 to 4, Manhattan and SquaredEuclidean rank
+ * like orders 1 and 2 and are vectorized. */
+template<unsigned P>
+struct Minkowski {
+	static_assert(P > 0 && P <= 4, "Minkowski orders 1 to 4 are supported");
+	static const bool TILED = false;
+
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension) {
+		return Metrics::minkowski(p, q, dimension, P);
+	}
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension, double) {
+		return Metrics::minkowski(p, q, dimension, P);
+	}
+	/** Single precision rows are not vectorized for this metric. */
+	static inline double distance(const float* p, const double* q,
+			std::size_t dimension) {
+		double sum = 0.0;
+		for (std::size_t d = 0; d < dimension; ++d) {
+			sum += axisBound(std::fabs(p[d] - q[d]));
+		}
+		return sum;
+	}
+	static inline double axisBound(double axisDistance) {
+		double bound = 1.0;
+		for (unsigned i = 0; i < P; ++i) {
+			bound *= axisDistance;
+		}
+		return bound;
+	}
+	static inline double boxBound(double bound, double axisDistance) {
+		return bound + axisBound(axisDistance);
+	}
+	static inline double finalize(double distance) {
+		return std::pow(distance, 1.0 / P);
+	}
+};
+
+/** Cosine distance 1 - cos(p, q). Angles are not bounded by coordinate
+ * differences, so grid searches visit all cells. */
+struct Cosine {
+	static const bool TILED = false;
+
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension) {
+		return Metrics::cosine(p, q, dimension);
+	}
+	static inline double distance(const double* p, const double* q,
+			std::size_t dimension, double) {
+		return Metrics::cosine(p, q, dimension);
+	}
+	/** Single precision rows are not vectorized for this metric. */
+	static inline double distance(const float* p, const double* q,
+			std::size_t dimension) {
+		double dot = 0.0, pNorm = 0.0, qNorm = 0.0;
+		for (std::size_t d = 0; d < dimension; ++d) {
+			dot += p[d] * q[d];
+			pNorm += static_cast<double>(p[d]) * p[d];
+			qNorm += q[d] * q[d];
+		}
+		double norms = pNorm * qNorm;
+		return norms > 0.0 ? 1.0 - dot / std::sqrt(norms) : 1.0;
+	}
+	static inline double axisBound(double axisDistance) {
+		//keep the "no border left" marker of the grid ring search
+		return axisDistance == std::numeric_limits<double>::infinity() ?
+				axisDistance : 0.0;
+	}
+	static inline double boxBound(double, double) {
+		return 0.0;
+	}
+	static inline double finalize(double distance) {
+		return distance;
+	}
+};
+
+#endif
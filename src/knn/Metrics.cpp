@@ -1,18 +1,490 @@
 #include "Metrics.h"
+#include "DistanceKernels.h"
+#include "QuantizedKernels.h"
+
 #include <cmath>
 #include <cassert>
 
+namespace {
+
+KNN_NO_CONTRACT
+double squaredEuclideanScalar(const double* p, const double* q,
+		std::size_t dimension) {
+	return squaredEuclideanKernel<ScalarLanes, double>(p, q, dimension);
+}
+
+double squaredEuclideanSinglePrecisionScalar(const float* p, const double* q,
+		std::size_t dimension) {
+	return squaredEuclideanKernel<ScalarLanes, float>(p, q, dimension);
+}
+
+double boundedSquaredEuclideanScalar(const double* p, const double* q,
+		std::size_t dimension, double threshold) {
+	return boundedSquaredEuclideanKernel<ScalarLanes>(p, q, dimension, threshold);
+}
+
+KNN_NO_CONTRACT
+void squaredEuclideanTileScalar(const double* points,
+		std::size_t numberOfPoints, const double* queryTile,
+		std::size_t dimension, double* distances) {
+	squaredEuclideanTileKernel<ScalarLanes, Metrics::QUERY_TILE>(points,
+			numberOfPoints, queryTile, dimension, distances);
+}
+
+void dotProductTileScalar(const double* points, std::size_t numberOfPoints,
+		const double* queryTile, std::size_t dimension, double* dots) {
+	dotProductTileKernel<ScalarLanes, Metrics::QUERY_TILE>(points,
+			numberOfPoints, queryTile, dimension, dots);
+}
+
+double manhattanScalar(const double* p, const double* q, std::size_t dimension) {
+	return manhattanKernel<ScalarLanes>(p, q, dimension);
+}
+
+double chebyshevScalar(const double* p, const double* q, std::size_t dimension) {
+	return chebyshevKernel<ScalarLanes>(p, q, dimension);
+}
+
+double cosineScalar(const double* p, const double* q, std::size_t dimension) {
+	return cosineKernel<ScalarLanes>(p, q, dimension);
+}
+
+double minkowskiScalar(const double* p, const double* q, std::size_t dimension,
+		unsigned power) {
+	return minkowskiKernel<ScalarLanes>(p, q, dimension, power);
+}
+
+double int8SquaredEuclideanScalar(const std::int8_t* p, const std::int8_t* q,
+		std::size_t dimension) {
+	return quantizedSquaredEuclideanScalar(p, q, 0, dimension);
+}
+
+double int16SquaredEuclideanScalar(const std::int16_t* p,
+		const std::int16_t* q, std::size_t dimension) {
+	return quantizedSquaredEuclideanScalar(p, q, 0, dimension);
+}
+
+#ifdef KNN_X86_SIMD
+//flatten inlines the generic kernel and all lane operations,
+//so the whole kernel is compiled for the wrapper's target.
+KNN_TARGET_SSE2 __attribute__((flatten))
+double squaredEuclideanSse2(const double* p, const double* q,
+		std::size_t dimension) {
+	return squaredEuclideanKernel<Sse2Lanes, double>(p, q, dimension);
+}
+
+KNN_TARGET_SSE2 __attribute__((flatten))
+double squaredEuclideanSinglePrecisionSse2(const float* p, const double* q,
+		std::size_t dimension) {
+	return squaredEuclideanKernel<Sse2Lanes, float>(p, q, dimension);
+}
+
+KNN_TARGET_SSE2 __attribute__((flatten))
+double boundedSquaredEuclideanSse2(const double* p, const double* q,
+		std::size_t dimension, double threshold) {
+	return boundedSquaredEuclideanKernel<Sse2Lanes>(p, q, dimension, threshold);
+}
+
+KNN_TARGET_SSE2 KNN_NO_CONTRACT __attribute__((flatten))
+void squaredEuclideanTileSse2(const double* points,
+		std::size_t numberOfPoints, const double* queryTile,
+		std::size_t dimension, double* distances) {
+	squaredEuclideanTileKernel<Sse2Lanes, Metrics::QUERY_TILE>(points,
+			numberOfPoints, queryTile, dimension, distances);
+}
+
+KNN_TARGET_SSE2 __attribute__((flatten))
+void dotProductTileSse2(const double* points, std::size_t numberOfPoints,
+		const double* queryTile, std::size_t dimension, double* dots) {
+	dotProductTileKernel<Sse2Lanes, Metrics::QUERY_TILE>(points,
+			numberOfPoints, queryTile, dimension, dots);
+}
+
+KNN_TARGET_SSE2 __attribute__((flatten))
+double manhattanSse2(const double* p, const double* q, std::size_t dimension) {
+	return manhattanKernel<Sse2Lanes>(p, q, dimension);
+}
+
+KNN_TARGET_SSE2 __attribute__((flatten))
+double chebyshevSse2(const double* p, const double* q, std::size_t dimension) {
+	return chebyshevKernel<Sse2Lanes>(p, q, dimension);
+}
+
+KNN_TARGET_SSE2 __attribute__((flatten))
+double cosineSse2(const double* p, const double* q, std::size_t dimension) {
+	return cosineKernel<Sse2Lanes>(p, q, dimension);
+}
+
+KNN_TARGET_SSE2 __attribute__((flatten))
+double minkowskiSse2(const double* p, const double* q, std::size_t dimension,
+		unsigned power) {
+	return minkowskiKernel<Sse2Lanes>(p, q, dimension, power);
+}
+
+KNN_TARGET_AVX2 __attribute__((flatten))
+double squaredEuclideanAvx2(const double* p, const double* q,
+		std::size_t dimension) {
+	return squaredEuclideanKernel<Avx2Lanes, double>(p, q, dimension);
+}
+
+KNN_TARGET_AVX2 __attribute__((flatten))
+double squaredEuclideanSinglePrecisionAvx2(const float* p, const double* q,
+		std::size_t dimension) {
+	return squaredEuclideanKernel<Avx2Lanes, float>(p, q, dimension);
+}
+
+KNN_TARGET_AVX2 __attribute__((flatten))
+double boundedSquaredEuclideanAvx2(const double* p, const double* q,
+		std::size_t dimension, double threshold) {
+	return boundedSquaredEuclideanKernel<Avx2Lanes>(p, q, dimension, threshold);
+}
+
+KNN_TARGET_AVX2 KNN_NO_CONTRACT __attribute__((flatten))
+void squaredEuclideanTileAvx2(const double* points,
+		std::size_t numberOfPoints, const double* queryTile,
+		std::size_t dimension, double* distances) {
+	squaredEuclideanTileKernel<Avx2Lanes, Metrics::QUERY_TILE>(points,
+			numberOfPoints, queryTile, dimension, distances);
+}
+
+KNN_TARGET_AVX2 __attribute__((flatten))
+void dotProductTileAvx2(const double* points, std::size_t numberOfPoints,
+		const double* queryTile, std::size_t dimension, double* dots) {
+	dotProductTileKernel<Avx2Lanes, Metrics::QUERY_TILE>(points,
+			numberOfPoints, queryTile, dimension, dots);
+}
+
+KNN_TARGET_AVX2 __attribute__((flatten))
+double manhattanAvx2(const double* p, const double* q, std::size_t dimension) {
+	return manhattanKernel<Avx2Lanes>(p, q, dimension);
+}
+
+KNN_TARGET_AVX2 __attribute__((flatten))
+double chebyshevAvx2(const double* p, const double* q, std::size_t dimension) {
+	return chebyshevKernel<Avx2Lanes>(p, q, dimension);
+}
+
+KNN_TARGET_AVX2 __attribute__((flatten))
+double cosineAvx2(const double* p, const double* q, std::size_t dimension) {
+	return cosineKernel<Avx2Lanes>(p, q, dimension);
+}
+
+KNN_TARGET_AVX2 __attribute__((flatten))
+double minkowskiAvx2(const double* p, const double* q, std::size_t dimension,
+		unsigned power) {
+	return minkowskiKernel<Avx2Lanes>(p, q, dimension, power);
+}
+
+//GCC 12 avx512fintrin.h falsely reports its _mm512_undefined_pd()
+//placeholders as uninitialized once inlined.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+KNN_TARGET_AVX512 __attribute__((flatten))
+double squaredEuclideanAvx512(const double* p, const double* q,
+		std::size_t dimension) {
+	return squaredEuclideanKernel<Avx512Lanes, double>(p, q, dimension);
+}
+
+KNN_TARGET_AVX512 __attribute__((flatten))
+double squaredEuclideanSinglePrecisionAvx512(const float* p, const double* q,
+		std::size_t dimension) {
+	return squaredEuclideanKernel<Avx512Lanes, float>(p, q, dimension);
+}
+
+KNN_TARGET_AVX512 __attribute__((flatten))
+double boundedSquaredEuclideanAvx512(const double* p, const double* q,
+		std::size_t dimension, double threshold) {
+	return boundedSquaredEuclideanKernel<Avx512Lanes>(p, q, dimension, threshold);
+}
+
+KNN_TARGET_AVX512 KNN_NO_CONTRACT __attribute__((flatten))
+void squaredEuclideanTileAvx512(const double* points,
+		std::size_t numberOfPoints, const double* queryTile,
+		std::size_t dimension, double* distances) {
+	squaredEuclideanTileKernel<Avx512Lanes, Metrics::QUERY_TILE>(points,
+			numberOfPoints, queryTile, dimension, distances);
+}
+
+KNN_TARGET_AVX512 __attribute__((flatten))
+void dotProductTileAvx512(const double* points, std::size_t numberOfPoints,
+		const double* queryTile, std::size_t dimension, double* dots) {
+	dotProductTileKernel<Avx512Lanes, Metrics::QUERY_TILE>(points,
+			numberOfPoints, queryTile, dimension, dots);
+}
+
+KNN_TARGET_AVX512 __attribute__((flatten))
+double manhattanAvx512(const double* p, const double* q, std::size_t dimension) {
+	return manhattanKernel<Avx512Lanes>(p, q, dimension);
+}
+
+KNN_TARGET_AVX512 __attribute__((flatten))
+double chebyshevAvx512(const double* p, const double* q, std::size_t dimension) {
+	return chebyshevKernel<Avx512Lanes>(p, q, dimension);
+}
+
+KNN_TARGET_AVX512 __attribute__((flatten))
+double cosineAvx512(const double* p, const double* q, std::size_t dimension) {
+	return cosineKernel<Avx512Lanes>(p, q, dimension);
+}
+
+KNN_TARGET_AVX512 __attribute__((flatten))
+double minkowskiAvx512(const double* p, const double* q, std::size_t dimension,
+		unsigned power) {
+	return minkowskiKernel<Avx512Lanes>(p, q, dimension, power);
+}
+#pragma GCC diagnostic pop
+#endif
+
+}
+
+const std::size_t Metrics::QUERY_TILE;
+
+SIMD_LEVEL Metrics::simdLevel_ = Metrics::detectSimdLevel();
+Metrics::SquaredEuclideanKernel Metrics::squaredEuclidean_ =
+		Metrics::squaredEuclideanKernel(Metrics::simdLevel_);
+Metrics::SinglePrecisionKernel Metrics::squaredEuclideanSinglePrecision_ =
+		Metrics::squaredEuclideanSinglePrecisionKernel(Metrics::simdLevel_);
+Metrics::BoundedSquaredEuclideanKernel Metrics::boundedSquaredEuclidean_ =
+		Metrics::boundedSquaredEuclideanKernel(Metrics::simdLevel_);
+Metrics::SquaredEuclideanTileKernel Metrics::squaredEuclideanTile_ =
+		Metrics::squaredEuclideanTileKernel(Metrics::simdLevel_);
+Metrics::DotProductTileKernel Metrics::dotProductTile_ =
+		Metrics::dotProductTileKernel(Metrics::simdLevel_);
+Metrics::DistanceKernel Metrics::manhattan_ = Metrics::manhattanKernel(
+		Metrics::simdLevel_);
+Metrics::DistanceKernel Metrics::chebyshev_ = Metrics::chebyshevKernel(
+		Metrics::simdLevel_);
+Metrics::MinkowskiKernel Metrics::minkowski_ = Metrics::minkowskiKernel(
+		Metrics::simdLevel_);
+Metrics::DistanceKernel Metrics::cosine_ = Metrics::cosineKernel(
+		Metrics::simdLevel_);
+Metrics::Int8Kernel Metrics::int8SquaredEuclidean_ =
+		Metrics::int8SquaredEuclideanKernel(Metrics::simdLevel_);
+Metrics::Int16Kernel Metrics::int16SquaredEuclidean_ =
+		Metrics::int16SquaredEuclideanKernel(Metrics::simdLevel_);
+
 Metrics::Metrics() {
 }
 
 Metrics::~Metrics() {
 }
 
+SIMD_LEVEL Metrics::detectSimdLevel() {
+#ifdef KNN_X86_SIMD
+	//Static initialization may run before the runtime initialized its
+	//CPU model, so trigger it explicitly.
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return AVX512;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return AVX2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return SSE2;
+	}
+#endif
+	return SCALAR;
+}
+
+SIMD_LEVEL Metrics::simdLevel() {
+	return simdLevel_;
+}
+
+SIMD_LEVEL Metrics::setSimdLevel(SIMD_LEVEL level) {
+	SIMD_LEVEL supported = detectSimdLevel();
+	simdLevel_ = level < supported ? level : supported;
+	squaredEuclidean_ = squaredEuclideanKernel(simdLevel_);
+	squaredEuclideanSinglePrecision_ = squaredEuclideanSinglePrecisionKernel(
+			simdLevel_);
+	boundedSquaredEuclidean_ = boundedSquaredEuclideanKernel(simdLevel_);
+	squaredEuclideanTile_ = squaredEuclideanTileKernel(simdLevel_);
+	dotProductTile_ = dotProductTileKernel(simdLevel_);
+	manhattan_ = manhattanKernel(simdLevel_);
+	chebyshev_ = chebyshevKernel(simdLevel_);
+	minkowski_ = minkowskiKernel(simdLevel_);
+	cosine_ = cosineKernel(simdLevel_);
+	int8SquaredEuclidean_ = int8SquaredEuclideanKernel(simdLevel_);
+	int16SquaredEuclidean_ = int16SquaredEuclideanKernel(simdLevel_);
+
+	return simdLevel_;
+}
+
+Metrics::SquaredEuclideanKernel Metrics::squaredEuclideanKernel(
+		SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+		return &squaredEuclideanAvx512;
+	case AVX2:
+		return &squaredEuclideanAvx2;
+	case SSE2:
+		return &squaredEuclideanSse2;
+#endif
+	default:
+		return &squaredEuclideanScalar;
+	}
+}
+
+Metrics::SinglePrecisionKernel Metrics::squaredEuclideanSinglePrecisionKernel(
+		SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+		return &squaredEuclideanSinglePrecisionAvx512;
+	case AVX2:
+		return &squaredEuclideanSinglePrecisionAvx2;
+	case SSE2:
+		return &squaredEuclideanSinglePrecisionSse2;
+#endif
+	default:
+		return &squaredEuclideanSinglePrecisionScalar;
+	}
+}
+
+Metrics::BoundedSquaredEuclideanKernel Metrics::boundedSquaredEuclideanKernel(
+		SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+		return &boundedSquaredEuclideanAvx512;
+	case AVX2:
+		return &boundedSquaredEuclideanAvx2;
+	case SSE2:
+		return &boundedSquaredEuclideanSse2;
+#endif
+	default:
+		return &boundedSquaredEuclideanScalar;
+	}
+}
+
+Metrics::SquaredEuclideanTileKernel Metrics::squaredEuclideanTileKernel(
+		SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+		return &squaredEuclideanTileAvx512;
+	case AVX2:
+		return &squaredEuclideanTileAvx2;
+	case SSE2:
+		return &squaredEuclideanTileSse2;
+#endif
+	default:
+		return &squaredEuclideanTileScalar;
+	}
+}
+
+Metrics::DotProductTileKernel Metrics::dotProductTileKernel(SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+		return &dotProductTileAvx512;
+	case AVX2:
+		return &dotProductTileAvx2;
+	case SSE2:
+		return &dotProductTileSse2;
+#endif
+	default:
+		return &dotProductTileScalar;
+	}
+}
+
+Metrics::DistanceKernel Metrics::manhattanKernel(SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+		return &manhattanAvx512;
+	case AVX2:
+		return &manhattanAvx2;
+	case SSE2:
+		return &manhattanSse2;
+#endif
+	default:
+		return &manhattanScalar;
+	}
+}
+
+Metrics::DistanceKernel Metrics::chebyshevKernel(SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+		return &chebyshevAvx512;
+	case AVX2:
+		return &chebyshevAvx2;
+	case SSE2:
+		return &chebyshevSse2;
+#endif
+	default:
+		return &chebyshevScalar;
+	}
+}
+
+Metrics::MinkowskiKernel Metrics::minkowskiKernel(SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+		return &minkowskiAvx512;
+	case AVX2:
+		return &minkowskiAvx2;
+	case SSE2:
+		return &minkowskiSse2;
+#endif
+	default:
+		return &minkowskiScalar;
+	}
+}
+
+Metrics::DistanceKernel Metrics::cosineKernel(SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+		return &cosineAvx512;
+	case AVX2:
+		return &cosineAvx2;
+	case SSE2:
+		return &cosineSse2;
+#endif
+	default:
+		return &cosineScalar;
+	}
+}
+
+Metrics::Int8Kernel Metrics::int8SquaredEuclideanKernel(SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+	case AVX2:
+		return &int8SquaredEuclideanAvx2;
+	case SSE2:
+		return &int8SquaredEuclideanSse2;
+#endif
+	default:
+		return &int8SquaredEuclideanScalar;
+	}
+}
+
+Metrics::Int16Kernel Metrics::int16SquaredEuclideanKernel(SIMD_LEVEL level) {
+	switch (level) {
+#ifdef KNN_X86_SIMD
+	case AVX512:
+	case AVX2:
+		return &int16SquaredEuclideanAvx2;
+	case SSE2:
+		return &int16SquaredEuclideanSse2;
+#endif
+	default:
+		return &int16SquaredEuclideanScalar;
+	}
+}
+
 double Metrics::squared_euclidean(const PointAccessor* p,
 		const PointAccessor* q) {
 	double result = 0.0;
 	for (std::size_t dim = 0; dim < (*q).dimension(); dim++) {
-		result += std::pow((*p)[dim] - (*q)[dim], 2);
+		//not std::pow, which matches the kernels only if folded to this
+		const double diff = (*p)[dim] - (*q)[dim];
+		result += diff * diff;
 	}
 
 	return result;
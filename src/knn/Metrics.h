@@ -3,9 +3,34 @@
 #include "../model/PointAccessor.h"
 #include "../model/PointVectorAccessor.h"
 #include "../model/PointArrayAccessor.h"
+#include "SimdLanes.h"
+
+#include <cstddef>
+#include <cstdint>
 
 class Metrics {
 public:
+	typedef double (*SquaredEuclideanKernel)(const double* p, const double* q,
+			std::size_t dimension);
+	typedef double (*SinglePrecisionKernel)(const float* p, const double* q,
+			std::size_t dimension);
+	typedef double (*BoundedSquaredEuclideanKernel)(const double* p,
+			const double* q, std::size_t dimension, double threshold);
+	typedef void (*SquaredEuclideanTileKernel)(const double* points,
+			std::size_t numberOfPoints, const double* queryTile,
+			std::size_t dimension, double* distances);
+	typedef SquaredEuclideanTileKernel DotProductTileKernel;
+	typedef SquaredEuclideanKernel DistanceKernel;
+	typedef double (*MinkowskiKernel)(const double* p, const double* q,
+			std::size_t dimension, unsigned power);
+	typedef double (*Int8Kernel)(const std::int8_t* p, const std::int8_t* q,
+			std::size_t dimension);
+	typedef double (*Int16Kernel)(const std::int16_t* p, const std::int16_t* q,
+			std::size_t dimension);
+
+	/** Number of queries processed together by the tile kernels. */
+	static const std::size_t QUERY_TILE = 8;
+
 	Metrics();
 	virtual ~Metrics();
 	static double squared_euclidean(const PointAccessor* p, const PointAccessor* q);
@@ -13,6 +38,153 @@ public:
 	static double squared_euclidean(const PointArrayAccessor& p, const PointAccessor* q);
 	static double euclidean(const PointAccessor* p, const PointAccessor* q);
 
+	/** Squared euclidean distance of two contiguous coordinate rows,
+	 * computed by the kernel selected for the executing CPU. */
+	static double squared_euclidean(const double* p, const double* q,
+			std::size_t dimension);
+	/** Squared euclidean distance of a single precision point to a double
+	 * precision query, accumulated in double. */
+	static double squared_euclidean(const float* p, const double* q,
+			std::size_t dimension);
+	/** Squared euclidean distance which may stop early once it exceeds the
+	 * threshold. Then a partial sum larger than the threshold is returned,
+	 * otherwise the same value as squared_euclidean. */
+	static double squared_euclidean(const double* p, const double* q,
+			std::size_t dimension, double threshold);
+	/** Squared euclidean distances of consecutive points to QUERY_TILE
+	 * queries stored dimension-major (queryTile[d * QUERY_TILE + q]).
+	 * distances[p * QUERY_TILE + q] receives the distance of point p
+	 * to query q. They equal those of the scalar kernel at every SIMD
+	 * level, the vectorized single distances may differ in the last bits
+	 * (lane order, FMA). */
+	static void squared_euclidean_tile(const double* points,
+			std::size_t numberOfPoints, const double* queryTile,
+			std::size_t dimension, double* distances);
+	/** Dot products of consecutive points with QUERY_TILE queries, same
+	 * layout as squared_euclidean_tile. */
+	static void dot_product_tile(const double* points,
+			std::size_t numberOfPoints, const double* queryTile,
+			std::size_t dimension, double* dots);
+	/** Exact squared euclidean distance of two rows of quantization codes
+	 * (see QuantizedPointContainer), in code units. */
+	static double squared_euclidean(const std::int8_t* p, const std::int8_t* q,
+			std::size_t dimension);
+	static double squared_euclidean(const std::int16_t* p,
+			const std::int16_t* q, std::size_t dimension);
+	/** Manhattan (L1) distance of two contiguous coordinate rows. */
+	static double manhattan(const double* p, const double* q,
+			std::size_t dimension);
+	/** Chebyshev (L-infinity) distance of two contiguous coordinate rows. */
+	static double chebyshev(const double* p, const double* q,
+			std::size_t dimension);
+	/** Sum of the power-th powers of the absolute coordinate differences
+	 * (Minkowski distance without the root). */
+	static double minkowski(const double* p, const double* q,
+			std::size_t dimension, unsigned power);
+	/** Cosine distance 1 - cos(p, q), 1 if either row has norm zero. */
+	static double cosine(const double* p, const double* q,
+			std::size_t dimension);
+	/** Returns the best SIMD level supported by CPU and OS. */
+	static SIMD_LEVEL detectSimdLevel();
+	/** Returns the level of the currently used kernels. */
+	static SIMD_LEVEL simdLevel();
+	/** Switches kernels to a particular level, which is capped at the detected
+	 * level. Not thread-safe, call it before running any queries. */
+	static SIMD_LEVEL setSimdLevel(SIMD_LEVEL level);
+	/** Returns the squared euclidean kernel compiled for a SIMD level. */
+	static SquaredEuclideanKernel squaredEuclideanKernel(SIMD_LEVEL level);
+	/** Returns the single precision kernel compiled for a SIMD level. */
+	static SinglePrecisionKernel squaredEuclideanSinglePrecisionKernel(
+			SIMD_LEVEL level);
+	/** Returns the early-abandoning kernel compiled for a SIMD level. */
+	static BoundedSquaredEuclideanKernel boundedSquaredEuclideanKernel(
+			SIMD_LEVEL level);
+	/** Returns the tile kernel compiled for a SIMD level. */
+	static SquaredEuclideanTileKernel squaredEuclideanTileKernel(
+			SIMD_LEVEL level);
+	/** Returns the dot product tile kernel compiled for a SIMD level. */
+	static DotProductTileKernel dotProductTileKernel(SIMD_LEVEL level);
+	/** Return the metric kernels compiled for a SIMD level. */
+	static DistanceKernel manhattanKernel(SIMD_LEVEL level);
+	static DistanceKernel chebyshevKernel(SIMD_LEVEL level);
+	static MinkowskiKernel minkowskiKernel(SIMD_LEVEL level);
+	static DistanceKernel cosineKernel(SIMD_LEVEL level);
+	/** Return the integer code kernels compiled for a SIMD level. AVX512
+	 * uses the AVX2 kernels, 512 bit integer lanes require AVX512BW. */
+	static Int8Kernel int8SquaredEuclideanKernel(SIMD_LEVEL level);
+	static Int16Kernel int16SquaredEuclideanKernel(SIMD_LEVEL level);
+
+private:
+	static SIMD_LEVEL simdLevel_;
+	static SquaredEuclideanKernel squaredEuclidean_;
+	static SinglePrecisionKernel squaredEuclideanSinglePrecision_;
+	static BoundedSquaredEuclideanKernel boundedSquaredEuclidean_;
+	static SquaredEuclideanTileKernel squaredEuclideanTile_;
+	static DotProductTileKernel dotProductTile_;
+	static DistanceKernel manhattan_;
+	static DistanceKernel chebyshev_;
+	static MinkowskiKernel minkowski_;
+	static DistanceKernel cosine_;
+	static Int8Kernel int8SquaredEuclidean_;
+	static Int16Kernel int16SquaredEuclidean_;
 };
 
+inline double Metrics::squared_euclidean(const double* p, const double* q,
+		std::size_t dimension) {
+	return squaredEuclidean_(p, q, dimension);
+}
+
+inline double Metrics::squared_euclidean(const float* p, const double* q,
+		std::size_t dimension) {
+	return squaredEuclideanSinglePrecision_(p, q, dimension);
+}
+
+inline double Metrics::squared_euclidean(const double* p, const double* q,
+		std::size_t dimension, double threshold) {
+	return boundedSquaredEuclidean_(p, q, dimension, threshold);
+}
+
+inline void Metrics::squared_euclidean_tile(const double* points,
+		std::size_t numberOfPoints, const double* queryTile,
+		std::size_t dimension, double* distances) {
+	squaredEuclideanTile_(points, numberOfPoints, queryTile, dimension,
+			distances);
+}
+
+inline void Metrics::dot_product_tile(const double* points,
+		std::size_t numberOfPoints, const double* queryTile,
+		std::size_t dimension, double* dots) {
+	dotProductTile_(points, numberOfPoints, queryTile, dimension, dots);
+}
+
+inline double Metrics::squared_euclidean(const std::int8_t* p,
+		const std::int8_t* q, std::size_t dimension) {
+	return int8SquaredEuclidean_(p, q, dimension);
+}
+
+inline double Metrics::squared_euclidean(const std::int16_t* p,
+		const std::int16_t* q, std::size_t dimension) {
+	return int16SquaredEuclidean_(p, q, dimension);
+}
+
+inline double Metrics::manhattan(const double* p, const double* q,
+		std::size_t dimension) {
+	return manhattan_(p, q, dimension);
+}
+
+inline double Metrics::chebyshev(const double* p, const double* q,
+		std::size_t dimension) {
+	return chebyshev_(p, q, dimension);
+}
+
+inline double Metrics::minkowski(const double* p, const double* q,
+		std::size_t dimension, unsigned power) {
+	return minkowski_(p, q, dimension, power);
+}
+
+inline double Metrics::cosine(const double* p, const double* q,
+		std::size_t dimension) {
+	return cosine_(p, q, dimension);
+}
+
 #endif
@@ -1,27 +1,387 @@
 #include "../knn/BPQ.h"
+#include "../knn/FixedDimension.h"
 #include "../knn/Metrics.h"
 #include "../knn/NaiveKnn.h"
+#include "../knn/NaiveKnnD.h"
+#include "../knn/Rerank.h"
+#include "../knn/SmallKQueue.h"
 #include "../model/PointArrayAccessor.h"
+#include "../model/QuantizedPointContainer.h"
 
+#include <algorithm>
 #include <functional>
 #include <cassert>
 #include <queue>
 #include <vector>
 #include <limits>
+#include <stdexcept>
+#include <utility>
 
-BPQ<PointArrayAccessor> NaiveKnn::kNearestNeighbors(unsigned k,
+template<class Metric>
+const std::size_t BasicNaiveKnn<Metric>::BLOCK_BYTES_DEFAULT;
+template<class Metric>
+const std::size_t BasicNaiveKnn<Metric>::PANEL_SIZE;
+template<class Metric>
+const std::size_t BasicNaiveKnn<Metric>::NORM_EXPANSION_MIN_DIMENSION;
+template<class Metric>
+const unsigned BasicNaiveKnn<Metric>::RERANK_SLACK_DEFAULT;
+template<class Metric>
+const std::size_t BasicNaiveKnn<Metric>::SELECTION_POINTS_PER_K_DEFAULT;
+
+template<class Metric>
+BasicNaiveKnn<Metric>* BasicNaiveKnn<Metric>::create(double * points,
+		std::size_t dimension, std::size_t numberOfPoints) {
+	switch (dimension) {
+	case 1:
+		return new NaiveKnnD<1, Metric> { points, numberOfPoints };
+	case 2:
+		return new NaiveKnnD<2, Metric> { points, numberOfPoints };
+	case 3:
+		return new NaiveKnnD<3, Metric> { points, numberOfPoints };
+	case 4:
+		return new NaiveKnnD<4, Metric> { points, numberOfPoints };
+	case 5:
+		return new NaiveKnnD<5, Metric> { points, numberOfPoints };
+	case 6:
+		return new NaiveKnnD<6, Metric> { points, numberOfPoints };
+	case 7:
+		return new NaiveKnnD<7, Metric> { points, numberOfPoints };
+	case 8:
+		return new NaiveKnnD<8, Metric> { points, numberOfPoints };
+	default:
+		return new BasicNaiveKnn { points, dimension, numberOfPoints };
+	}
+}
+
+template<class Metric>
+BPQ<PointArrayAccessor> BasicNaiveKnn<Metric>::kNearestNeighbors(unsigned k,
+		PointAccessor* query) {
+	return scan<0>(k, query);
+}
+
+template<class Metric>
+std::size_t BasicNaiveKnn<Metric>::kNearestNeighborIds(unsigned k,
+		PointAccessor* query, std::size_t* ids, double* distances,
+		bool finalDistances) {
+	return scanIds<0>(k, query, ids, distances, finalDistances);
+}
+
+template<class Metric>
+template<std::size_t D>
+std::size_t BasicNaiveKnn<Metric>::scanIds(unsigned k, PointAccessor* query,
+		std::size_t* ids, double* distances, bool finalDistances) {
+	assert(dimension_ == query->dimension());
+	if (k == 0) {
+		return 0;
+	}
+	std::vector<Neighbor>& neighbors =
+			NeighborScratch<std::size_t>::local().neighbors;
+	neighbors.clear();
+
+	if (quantizedPoints_ || singlePrecisionPoints_) {
+		BPQ<PointArrayAccessor> result = scan<D>(k, query);
+
+		while (!result.empty()) {
+			neighbors.push_back(Neighbor { result.topDistance(),
+					result.topPoint().getOffset() / dimension_ });
+			result.pop();
+		}
+	} else {
+		collectRange<D>(query->getData() + query->getOffset(), 0,
+				numberOfPoints_, k, neighbors);
+	}
+
+	sortNeighbors(k, neighbors);
+	return writeNeighbors<Metric>(neighbors, ids, distances, finalDistances);
+}
+
+template<class Metric>
+template<std::size_t D>
+BPQ<PointArrayAccessor> BasicNaiveKnn<Metric>::scan(unsigned k,
+		PointAccessor* query) {
+	const bool approximate = quantizedPoints_ || singlePrecisionPoints_;
+
+	//the queues need room for a candidate
+	if (k == 0) {
+		return BPQ<PointArrayAccessor>(0);
+	}
+	if (!approximate && usesSelection(k)) {
+		assert(dimension_ == query->dimension());
+		std::vector<Neighbor> selected;
+		selectRange<D>(query->getData() + query->getOffset(), 0,
+				numberOfPoints_, k, selected);
+		return selectionResult(k, selected);
+	}
+	if ((approximate ? k + rerankSlack_ : k) <= SMALL_K_MAX) {
+		return scanWith<D, SmallKQueue<PointArrayAccessor>>(k, query);
+	}
+	return scanWith<D, BPQ<PointArrayAccessor>>(k, query);
+}
+
+template<class Metric>
+template<std::size_t D, class Queue>
+BPQ<PointArrayAccessor> BasicNaiveKnn<Metric>::scanWith(unsigned k,
 		PointAccessor* query) {
 	assert(dimension_ == query->dimension());
+	assert(D == 0 || D == dimension_);
 
-	BPQ<PointArrayAccessor> candidates(k);
+	if (quantizedPoints_) {
+		return scanQuantized<D, Queue>(k, query);
+	}
+	if (singlePrecisionPoints_) {
+		return scanSinglePrecision<D, Queue>(k, query);
+	}
+
+	Queue candidates(k);
+	double* points = points_;
+	const std::size_t dimension = dimension_;
+
+	scanRange<D>(query->getData() + query->getOffset(), 0, numberOfPoints_,
+			candidates, [points, dimension](std::size_t point) {
+				return PointArrayAccessor {points, point * dimension, dimension};
+			});
+
+	return toBPQ(candidates);
+}
 
-	PointArrayAccessor current_point(points_, 0, dimension_);
+template<class Metric>
+template<std::size_t D, class Queue, class MakePoint>
+void BasicNaiveKnn<Metric>::scanRange(const double* queryCoords,
+		std::size_t firstPoint, std::size_t lastPoint, Queue& candidates,
+		MakePoint makePoint) const {
+	const std::size_t dimension = FixedDimension<D>::dimension(dimension_);
 	double current_dist;
 
+	for (std::size_t point = firstPoint; point < lastPoint; point++) {
+		current_dist = FixedDimensionDistance<Metric, D>::distance(
+				&points_[point * dimension], queryCoords, dimension,
+				candidates.max_dist());
+
+		if (current_dist < candidates.max_dist()) {
+			candidates.push(makePoint(point), current_dist);
+		}
+	}
+}
+
+template<class Metric>
+template<std::size_t D, class Queue, class MakePoint>
+void BasicNaiveKnn<Metric>::scanBounded(const double* queryCoords,
+		std::size_t firstPoint, std::size_t lastPoint, Queue& candidates,
+		MakePoint makePoint, SharedBound* bound) const {
+	if (bound) {
+		SharedBoundQueue<Queue> bounded(candidates, *bound);
+		scanRange<D>(queryCoords, firstPoint, lastPoint, bounded, makePoint);
+	} else {
+		scanRange<D>(queryCoords, firstPoint, lastPoint, candidates,
+				makePoint);
+	}
+}
+
+template<class Metric>
+template<std::size_t D>
+void BasicNaiveKnn<Metric>::collectRange(const double* queryCoords,
+		std::size_t firstPoint, std::size_t lastPoint, unsigned k,
+		std::vector<Neighbor>& neighbors, SharedBound* bound) const {
+	auto pointIndex = [](std::size_t point) {
+		return point;
+	};
+
+	if (k == 0) {
+		neighbors.clear();
+		return;
+	}
+	if (usesSelection(k)) {
+		selectRange<D>(queryCoords, firstPoint, lastPoint, k, neighbors,
+				bound);
+		return;
+	}
+
+	neighbors.clear();
+	if (k <= SMALL_K_MAX) {
+		SmallKQueue<std::size_t> candidates(k);
+		scanBounded<D>(queryCoords, firstPoint, lastPoint, candidates,
+				pointIndex, bound);
+		appendNeighbors(candidates, neighbors);
+	} else {
+		FixedBPQ<std::size_t>& candidates =
+				NeighborScratch<std::size_t>::local().candidates;
+		candidates.reset(k);
+		scanBounded<D>(queryCoords, firstPoint, lastPoint, candidates,
+				pointIndex, bound);
+		appendNeighbors(candidates, neighbors);
+	}
+}
+
+template<class Metric>
+bool BasicNaiveKnn<Metric>::usesSelection(unsigned k) const {
+	return selectionPointsPerK_ > 0 && k > SMALL_K_MAX
+			&& numberOfPoints_ <= k * selectionPointsPerK_;
+}
+
+template<class Metric>
+template<std::size_t D>
+void BasicNaiveKnn<Metric>::selectRange(const double* queryCoords,
+		std::size_t firstPoint, std::size_t lastPoint, unsigned k,
+		std::vector<Neighbor>& selected, SharedBound* bound) const {
+	const std::size_t dimension = FixedDimension<D>::dimension(dimension_);
+	double threshold = std::numeric_limits<double>::infinity();
+	selected.clear();
+	selected.reserve(2 * static_cast<std::size_t>(k));
+
+	for (std::size_t point = firstPoint; point < lastPoint; point++) {
+		const double shared =
+				bound ? bound->get() : std::numeric_limits<double>::infinity();
+		const double bestThreshold = shared < threshold ? shared : threshold;
+		double current_dist = FixedDimensionDistance<Metric, D>::distance(
+				&points_[point * dimension], queryCoords, dimension,
+				bestThreshold);
+
+		if (current_dist < bestThreshold) {
+			selected.push_back(Neighbor { current_dist, point });
+
+			if (selected.size() == 2 * static_cast<std::size_t>(k)) {
+				selectNeighbors(k, selected);
+				threshold = selected[k - 1].distance;
+				if (bound) {
+					bound->publish(threshold);
+				}
+			}
+		}
+	}
+
+	selectNeighbors(k, selected);
+}
+
+template<class Metric>
+BPQ<PointArrayAccessor> BasicNaiveKnn<Metric>::selectionResult(unsigned k,
+		const std::vector<Neighbor>& selected) const {
+	std::vector<std::pair<PointArrayAccessor, double>> candidates;
+	candidates.reserve(selected.size());
+
+	for (const Neighbor& candidate : selected) {
+		candidates.emplace_back(PointArrayAccessor { points_, candidate.id
+				* dimension_, dimension_ }, candidate.distance);
+	}
+
+	return BPQ<PointArrayAccessor>(k, std::move(candidates));
+}
+
+template<class Metric>
+void BasicNaiveKnn<Metric>::setSelectionPointsPerK(std::size_t pointsPerK) {
+	selectionPointsPerK_ = pointsPerK;
+}
+
+template<class Metric>
+std::vector<BPQ<PointArrayAccessor>> BasicNaiveKnn<Metric>::kNearestNeighborsBatch(
+		unsigned k, PointContainer& queries) {
+	if (!Metric::TILED) {
+		std::vector<BPQ<PointArrayAccessor>> results;
+
+		for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+			PointVectorAccessor query = queries[q_idx];
+			results.push_back(kNearestNeighbors(k, &query));
+		}
+
+		return results;
+	}
+
+	const bool normExpansion = squaredNorms_ != nullptr
+			&& dimension_ >= NORM_EXPANSION_MIN_DIMENSION;
+	std::vector<BPQ<PointArrayAccessor>> candidates(queries.size(),
+			BPQ<PointArrayAccessor> { normExpansion ? k + rerankSlack_ : k });
+
+	if (queries.empty() || k == 0) {
+		return candidates;
+	}
+
+	assert(queries[0].dimension() == dimension_);
+	std::vector<double> queryTiles = tileQueries(queries);
+
+	if (normExpansion) {
+		std::vector<double> queryNorms = tileSquaredNorms(queryTiles);
+		scanBlockedBatch(0, numberOfPoints_, queryTiles, candidates,
+				queryNorms.data());
+		rerank(k, queries, candidates);
+	} else {
+		scanBlockedBatch(0, numberOfPoints_, queryTiles, candidates);
+	}
+
+	return candidates;
+}
+
+template<class Metric>
+void BasicNaiveKnn<Metric>::setSquaredNorms(const double* squaredNorms) {
+	squaredNorms_ = squaredNorms;
+}
+
+template<class Metric>
+void BasicNaiveKnn<Metric>::setRerankSlack(unsigned slack) {
+	rerankSlack_ = slack;
+}
+
+template<class Metric>
+std::vector<double> BasicNaiveKnn<Metric>::tileSquaredNorms(
+		const std::vector<double>& queryTiles) const {
+	const std::size_t tile = Metrics::QUERY_TILE;
+	const std::size_t numberOfTiles = queryTiles.size() / (dimension_ * tile);
+	std::vector<double> queryNorms(numberOfTiles * tile, 0.0);
+
+	for (std::size_t t = 0; t < numberOfTiles; ++t) {
+		const double* tileCoords = &queryTiles[t * dimension_ * tile];
+
+		for (std::size_t d = 0; d < dimension_; ++d) {
+			for (std::size_t q = 0; q < tile; ++q) {
+				double coord = tileCoords[d * tile + q];
+				queryNorms[t * tile + q] += coord * coord;
+			}
+		}
+	}
+
+	return queryNorms;
+}
+
+template<class Metric>
+void BasicNaiveKnn<Metric>::expandedSquaredEuclideanTile(std::size_t panel,
+		std::size_t panelSize, const double* queryTile,
+		const double* queryNorms, double* distances) const {
+	const std::size_t tile = Metrics::QUERY_TILE;
+	Metrics::dot_product_tile(&points_[panel * dimension_], panelSize,
+			queryTile, dimension_, distances);
+
+	for (std::size_t p = 0; p < panelSize; ++p) {
+		const double pointNorm = squaredNorms_[panel + p];
+
+		for (std::size_t q = 0; q < tile; ++q) {
+			double& dot = distances[p * tile + q];
+			dot = pointNorm + queryNorms[q] - 2.0 * dot;
+		}
+	}
+}
+
+template<class Metric>
+void BasicNaiveKnn<Metric>::rerank(unsigned k, PointContainer& queries,
+		std::vector<BPQ<PointArrayAccessor>>& candidates) const {
+	const double* queryCoords = queries.data();
+
+	for (std::size_t q = 0; q < candidates.size(); ++q) {
+		candidates[q] = ::rerank<Metric, 0>(k, &queryCoords[q * dimension_],
+				dimension_, candidates[q]);
+	}
+}
+
+template<class Metric>
+template<std::size_t D, class Queue>
+BPQ<PointArrayAccessor> BasicNaiveKnn<Metric>::scanSinglePrecision(
+		unsigned k, PointAccessor* query) {
+	assert(dimension_ == query->dimension());
+
+	Queue candidates(k + rerankSlack_);
+	const double* queryCoords = query->getData() + query->getOffset();
+
 	for (std::size_t point = 0; point < numberOfPoints_; point++) {
 		std::size_t pIndexOffset = point * dimension_;
-		current_point.setOffset(pIndexOffset);
-		current_dist = Metrics::squared_euclidean(current_point, query);
+		double current_dist = Metric::distance(
+				&singlePrecisionPoints_[pIndexOffset], queryCoords, dimension_);
 
 		if (current_dist < candidates.max_dist()) {
 			candidates.push(PointArrayAccessor { points_, pIndexOffset,
@@ -29,5 +389,179 @@ BPQ<PointArrayAccessor> NaiveKnn::kNearestNeighbors(unsigned k,
 		}
 	}
 
-	return candidates;
+	return ::rerank<Metric, D>(k, queryCoords, dimension_, candidates);
+}
+
+template<class Metric>
+template<std::size_t D, class Queue>
+BPQ<PointArrayAccessor> BasicNaiveKnn<Metric>::scanQuantized(unsigned k,
+		PointAccessor* query) {
+	assert(dimension_ == query->dimension());
+
+	Queue candidates(k + rerankSlack_);
+	const double* queryCoords = query->getData() + query->getOffset();
+	double distances[QUANTIZED_BLOCK];
+	static thread_local QueryCodes queryCodes;
+	quantizedPoints_->encodeQuery(queryCoords, queryCodes);
+
+	for (std::size_t first = 0; first < numberOfPoints_; first +=
+			QUANTIZED_BLOCK) {
+		const std::size_t last = std::min(numberOfPoints_,
+				first + QUANTIZED_BLOCK);
+		quantizedPoints_->squaredDistances(queryCodes, first, last, distances);
+
+		for (std::size_t point = first; point < last; point++) {
+			double current_dist = distances[point - first];
+
+			if (current_dist < candidates.max_dist()) {
+				candidates.push(PointArrayAccessor { points_, point
+						* dimension_, dimension_ }, current_dist);
+			}
+		}
+	}
+
+	return ::rerank<Metric, D>(k, queryCoords, dimension_, candidates);
+}
+
+template<class Metric>
+void BasicNaiveKnn<Metric>::setQuantizedPoints(
+		const QuantizedPoints* quantizedPoints) {
+	if (quantizedPoints && !Metric::TILED) {
+		throw std::invalid_argument(
+				"Quantized points require the squared euclidean metric.");
+	}
+	assert(!quantizedPoints || quantizedPoints->size() == numberOfPoints_);
+	quantizedPoints_ = quantizedPoints;
+}
+
+template<class Metric>
+void BasicNaiveKnn<Metric>::setSinglePrecisionPoints(
+		const float* singlePrecisionPoints) {
+	singlePrecisionPoints_ = singlePrecisionPoints;
 }
+template<class Metric>
+std::vector<double> BasicNaiveKnn<Metric>::tileQueries(
+		PointContainer& queries) const {
+	const std::size_t tile = Metrics::QUERY_TILE;
+	const std::size_t numberOfTiles = (queries.size() + tile - 1) / tile;
+	std::vector<double> queryTiles(numberOfTiles * dimension_ * tile);
+	const double* queryCoords = queries.data();
+
+	for (std::size_t q = 0; q < numberOfTiles * tile; ++q) {
+		//pad the last tile with copies of the last query
+		std::size_t source = std::min(q, queries.size() - 1);
+		double* tileCoords = &queryTiles[(q / tile) * dimension_ * tile];
+
+		for (std::size_t d = 0; d < dimension_; ++d) {
+			tileCoords[d * tile + (q % tile)] = queryCoords[source * dimension_
+					+ d];
+		}
+	}
+
+	return queryTiles;
+}
+
+template<class Metric>
+void BasicNaiveKnn<Metric>::scanBlockedBatch(std::size_t firstPoint,
+		std::size_t lastPoint,
+		const std::vector<double>& queryTiles,
+		std::vector<BPQ<PointArrayAccessor>>& candidates,
+		const double* queryNorms) const {
+	const std::size_t tile = Metrics::QUERY_TILE;
+	const std::size_t tileSize = dimension_ * tile;
+	const std::size_t numberOfTiles = queryTiles.size() / tileSize;
+	const std::size_t blockSize = std::max(PANEL_SIZE,
+			BLOCK_BYTES_DEFAULT / (dimension_ * sizeof(double)));
+	double distances[PANEL_SIZE * Metrics::QUERY_TILE];
+
+	for (std::size_t block = firstPoint; block < lastPoint; block +=
+			blockSize) {
+		const std::size_t blockEnd = std::min(block + blockSize, lastPoint);
+
+		for (std::size_t t = 0; t < numberOfTiles; ++t) {
+			const std::size_t firstQuery = t * tile;
+			const std::size_t queriesInTile = std::min(tile,
+					candidates.size() - firstQuery);
+
+			for (std::size_t panel = block; panel < blockEnd; panel +=
+					PANEL_SIZE) {
+				const std::size_t panelSize = std::min(PANEL_SIZE,
+						blockEnd - panel);
+				if (queryNorms) {
+					expandedSquaredEuclideanTile(panel, panelSize,
+							&queryTiles[t * tileSize], &queryNorms[t * tile],
+							distances);
+				} else {
+					Metrics::squared_euclidean_tile(
+							&points_[panel * dimension_], panelSize,
+							&queryTiles[t * tileSize], dimension_, distances);
+				}
+
+				for (std::size_t p = 0; p < panelSize; ++p) {
+					for (std::size_t q = 0; q < queriesInTile; ++q) {
+						double current_dist = distances[p * tile + q];
+						BPQ<PointArrayAccessor>& queue = candidates[firstQuery
+								+ q];
+
+						if (current_dist < queue.max_dist()) {
+							queue.push(PointArrayAccessor { points_, (panel + p)
+									* dimension_, dimension_ }, current_dist);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+//Run-time dimension and all specializations used by NaiveKnnD.
+#define INSTANTIATE_NAIVE_KNN(METRIC) \
+	template class BasicNaiveKnn<METRIC>; \
+	template void BasicNaiveKnn<METRIC>::collectRange<0>(const double*, \
+			std::size_t, std::size_t, unsigned, std::vector<Neighbor>&, \
+			SharedBound*) const; \
+	template BPQ<PointArrayAccessor> BasicNaiveKnn<METRIC>::scan<0>(unsigned, \
+			PointAccessor*); \
+	template std::size_t BasicNaiveKnn<METRIC>::scanIds<0>(unsigned, \
+			PointAccessor*, std::size_t*, double*, bool); \
+	template BPQ<PointArrayAccessor> BasicNaiveKnn<METRIC>::scan<1>(unsigned, \
+			PointAccessor*); \
+	template std::size_t BasicNaiveKnn<METRIC>::scanIds<1>(unsigned, \
+			PointAccessor*, std::size_t*, double*, bool); \
+	template BPQ<PointArrayAccessor> BasicNaiveKnn<METRIC>::scan<2>(unsigned, \
+			PointAccessor*); \
+	template std::size_t BasicNaiveKnn<METRIC>::scanIds<2>(unsigned, \
+			PointAccessor*, std::size_t*, double*, bool); \
+	template BPQ<PointArrayAccessor> BasicNaiveKnn<METRIC>::scan<3>(unsigned, \
+			PointAccessor*); \
+	template std::size_t BasicNaiveKnn<METRIC>::scanIds<3>(unsigned, \
+			PointAccessor*, std::size_t*, double*, bool); \
+	template BPQ<PointArrayAccessor> BasicNaiveKnn<METRIC>::scan<4>(unsigned, \
+			PointAccessor*); \
+	template std::size_t BasicNaiveKnn<METRIC>::scanIds<4>(unsigned, \
+			PointAccessor*, std::size_t*, double*, bool); \
+	template BPQ<PointArrayAccessor> BasicNaiveKnn<METRIC>::scan<5>(unsigned, \
+			PointAccessor*); \
+	template std::size_t BasicNaiveKnn<METRIC>::scanIds<5>(unsigned, \
+			PointAccessor*, std::size_t*, double*, bool); \
+	template BPQ<PointArrayAccessor> BasicNaiveKnn<METRIC>::scan<6>(unsigned, \
+			PointAccessor*); \
+	template std::size_t BasicNaiveKnn<METRIC>::scanIds<6>(unsigned, \
+			PointAccessor*, std::size_t*, double*, bool); \
+	template BPQ<PointArrayAccessor> BasicNaiveKnn<METRIC>::scan<7>(unsigned, \
+			PointAccessor*); \
+	template std::size_t BasicNaiveKnn<METRIC>::scanIds<7>(unsigned, \
+			PointAccessor*, std::size_t*, double*, bool); \
+	template BPQ<PointArrayAccessor> BasicNaiveKnn<METRIC>::scan<8>(unsigned, \
+			PointAccessor*); \
+	template std::size_t BasicNaiveKnn<METRIC>::scanIds<8>(unsigned, \
+			PointAccessor*, std::size_t*, double*, bool);
+
+INSTANTIATE_NAIVE_KNN(SquaredEuclidean)
+INSTANTIATE_NAIVE_KNN(Manhattan)
+INSTANTIATE_NAIVE_KNN(Chebyshev)
+INSTANTIATE_NAIVE_KNN(Minkowski<1>)
+INSTANTIATE_NAIVE_KNN(Minkowski<2>)
+INSTANTIATE_NAIVE_KNN(Minkowski<3>)
+INSTANTIATE_NAIVE_KNN(Minkowski<4>)
+INSTANTIATE_NAIVE_KNN(Cosine)
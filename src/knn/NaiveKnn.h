@@ -2,25 +2,181 @@
 #define KNN_NAIVEKNN_H_
 #include "../model/PointAccessor.h"
 #include "../model/PointContainer.h"
+#include "../model/QuantizedPointContainer.h"
 
 #include "KnnProcessor.h"
+#include "MetricPolicies.h"
+#include "Neighbor.h"
+#include "SharedBound.h"
 #include <cstddef>
+#include <vector>
 
-class NaiveKnn: public KnnProcessor<PointArrayAccessor> {
+/** Exhaustive kNN scan, distances are computed by the Metric policy (see
+ * MetricPolicies.h). NaiveKnn is the squared euclidean instantiation. */
+template<class Metric>
+class BasicNaiveKnn: public KnnProcessor<PointArrayAccessor> {
 protected:
 	double * points_;
 	const std::size_t dimension_;
 	const std::size_t numberOfPoints_;
+	const double* squaredNorms_;
+	const float* singlePrecisionPoints_;
+	const QuantizedPoints* quantizedPoints_;
+	unsigned rerankSlack_;
+	std::size_t selectionPointsPerK_;
+
+	/** Column scan, D > 0 fixes the dimension at compile time. Candidates
+	 * are collected in a SmallKQueue if at most SMALL_K_MAX are needed, in
+	 * a BPQ otherwise. */
+	template<std::size_t D>
+	BPQ<PointArrayAccessor> scan(unsigned k, PointAccessor* query);
+	/** Column scan collecting the candidates in a Queue (BPQ or
+	 * SmallKQueue). */
+	template<std::size_t D, class Queue>
+	BPQ<PointArrayAccessor> scanWith(unsigned k, PointAccessor* query);
+	/** Selects k + slack candidates on the single precision points and
+	 * re-ranks them with double precision distances. */
+	template<std::size_t D, class Queue>
+	BPQ<PointArrayAccessor> scanSinglePrecision(unsigned k,
+			PointAccessor* query);
+	/** Selects k + slack candidates on the quantized points and re-ranks
+	 * them with exact distances. */
+	template<std::size_t D, class Queue>
+	BPQ<PointArrayAccessor> scanQuantized(unsigned k, PointAccessor* query);
+	/** Pushes points [firstPoint, lastPoint) closer than the bound of the
+	 * candidates as makePoint(point index). */
+	template<std::size_t D, class Queue, class MakePoint>
+	void scanRange(const double* queryCoords, std::size_t firstPoint,
+			std::size_t lastPoint, Queue& candidates,
+			MakePoint makePoint) const;
+	/** scanRange, through a SharedBoundQueue if bound is set. */
+	template<std::size_t D, class Queue, class MakePoint>
+	void scanBounded(const double* queryCoords, std::size_t firstPoint,
+			std::size_t lastPoint, Queue& candidates, MakePoint makePoint,
+			SharedBound* bound) const;
+	/** Whether k is large enough relative to the number of points for the
+	 * selection path. */
+	bool usesSelection(unsigned k) const;
+	/** Replaces selected by the k closest of points [firstPoint,
+	 * lastPoint), unordered and identified by point index. Distances below
+	 * a running threshold are appended to a buffer, a full buffer of 2k
+	 * candidates is cut to its k closest by partitioning selection, which
+	 * tightens the threshold. With a shared bound, the threshold is
+	 * published and candidates have to beat the shared one as well, so
+	 * fewer than k may be selected. */
+	template<std::size_t D>
+	void selectRange(const double* queryCoords, std::size_t firstPoint,
+			std::size_t lastPoint, unsigned k, std::vector<Neighbor>& selected,
+			SharedBound* bound = nullptr) const;
+	/** Like selectRange, but collects the candidates with the queue that
+	 * suits k (SmallKQueue, FixedBPQ or selection). Ignores approximate
+	 * modes. */
+	template<std::size_t D>
+	void collectRange(const double* queryCoords, std::size_t firstPoint,
+			std::size_t lastPoint, unsigned k, std::vector<Neighbor>& neighbors,
+			SharedBound* bound = nullptr) const;
+	/** Heapifies the k selected candidates into a result queue. */
+	BPQ<PointArrayAccessor> selectionResult(unsigned k,
+			const std::vector<Neighbor>& selected) const;
+	/** Index-based search (see kNearestNeighborIds), D > 0 fixes the
+	 * dimension at compile time. Approximate modes search via scan. */
+	template<std::size_t D>
+	std::size_t scanIds(unsigned k, PointAccessor* query, std::size_t* ids,
+			double* distances, bool finalDistances);
+	/** Transposes queries into dimension-major tiles of
+	 * Metrics::QUERY_TILE queries, padding the last tile. */
+	std::vector<double> tileQueries(PointContainer& queries) const;
+	/** Squared norms of the tiled queries, including padding. */
+	std::vector<double> tileSquaredNorms(
+			const std::vector<double>& queryTiles) const;
+	/** Scans points [firstPoint, lastPoint) for all query tiles. Given the
+	 * tiled query norms, distances are expanded from dot products as
+	 * ||x||^2 + ||q||^2 - 2 x.q using the reference norms. */
+	void scanBlockedBatch(std::size_t firstPoint, std::size_t lastPoint,
+			const std::vector<double>& queryTiles,
+			std::vector<BPQ<PointArrayAccessor>>& candidates,
+			const double* queryNorms = nullptr) const;
+	/** Squared euclidean distances of a panel to a query tile, expanded
+	 * from blocked dot products and the precomputed norms. */
+	void expandedSquaredEuclideanTile(std::size_t panel, std::size_t panelSize,
+			const double* queryTile, const double* queryNorms,
+			double* distances) const;
+	/** Replaces the approximate candidate distances by exact ones and keeps
+	 * the k closest. */
+	void rerank(unsigned k, PointContainer& queries,
+			std::vector<BPQ<PointArrayAccessor>>& candidates) const;
 
 public:
-	NaiveKnn(double * points, std::size_t dimension, std::size_t numberOfPoints) :
+	/** Default size of the reference blocks scanned per query tile,
+	 * chosen to stay resident in L2. */
+	static const std::size_t BLOCK_BYTES_DEFAULT = 256 * 1024;
+	/** Number of points per tile kernel call. */
+	static const std::size_t PANEL_SIZE = 64;
+	/** Smallest dimension the norm expansion is used for. Below, the
+	 * saved subtractions do not pay for the re-ranking. */
+	static const std::size_t NORM_EXPANSION_MIN_DIMENSION = 16;
+	/** Additional candidates re-ranked after an approximate selection
+	 * (norm expansion, single precision or quantized scan). */
+	static const unsigned RERANK_SLACK_DEFAULT = 16;
+	/** Number of quantized distances computed per call. */
+	static const std::size_t QUANTIZED_BLOCK = 256;
+	/** Exact scans for k > SMALL_K_MAX switch from the heap to selection if
+	 * there are at most this many points per neighbor. */
+	static const std::size_t SELECTION_POINTS_PER_K_DEFAULT = 2000;
+
+	BasicNaiveKnn(double * points, std::size_t dimension,
+			std::size_t numberOfPoints) :
 			points_(points), dimension_(dimension), numberOfPoints_(
-					numberOfPoints) {
+					numberOfPoints), squaredNorms_(nullptr), singlePrecisionPoints_(
+					nullptr), quantizedPoints_(nullptr), rerankSlack_(
+					RERANK_SLACK_DEFAULT), selectionPointsPerK_(
+					SELECTION_POINTS_PER_K_DEFAULT) {
 
 	}
 
+	/** Creates a dimension-specialized processor (NaiveKnnD) for
+	 * dimensions up to MAX_FIXED_DIMENSION, a BasicNaiveKnn otherwise. */
+	static BasicNaiveKnn* create(double * points, std::size_t dimension,
+			std::size_t numberOfPoints);
+
 	virtual BPQ<PointArrayAccessor> kNearestNeighbors(unsigned k, PointAccessor* query) override;
+	virtual std::size_t kNearestNeighborIds(unsigned k, PointAccessor* query,
+			std::size_t* ids, double* distances, bool finalDistances = false)
+					override;
+
+	/** Returns the k-nearest neighbors for a batch of queries. Queries are
+	 * processed in tiles against cache-sized blocks of reference points,
+	 * so every block is loaded once for all queries instead of once per
+	 * query. Distances are those of the scalar kernel and may differ from
+	 * kNearestNeighbors in the last bits (see squared_euclidean_tile).
+	 * Metrics without tile kernels scan query by query. */
+	std::vector<BPQ<PointArrayAccessor>> kNearestNeighborsBatch(unsigned k,
+			PointContainer& queries);
+
+	/** Sets precomputed squared norms of the reference points (see
+	 * PointContainer::computeSquaredNorms), nullptr disables them. With
+	 * norms and at least NORM_EXPANSION_MIN_DIMENSION dimensions, batches
+	 * select k + slack candidates via dot products and re-rank them with
+	 * exact distances to neutralize cancellation errors. */
+	void setSquaredNorms(const double* squaredNorms);
+	/** Sets a single precision copy of the reference points (see
+	 * PointContainer::computeSinglePrecision), nullptr disables it. Single
+	 * queries then scan floats, i.e. half the bytes, and re-rank k + slack
+	 * candidates in double precision. Batches keep scanning doubles. */
+	void setSinglePrecisionPoints(const float* singlePrecisionPoints);
+	/** Sets quantized codes of the reference points, nullptr disables
+	 * them. Single queries then filter k + slack candidates on the codes
+	 * and refine them with exact distances. Takes precedence over the
+	 * single precision points. Throws std::invalid_argument unless the
+	 * metric is squared euclidean. */
+	void setQuantizedPoints(const QuantizedPoints* quantizedPoints);
+	void setRerankSlack(unsigned slack);
+	/** Sets the points per neighbor below which exact scans use selection
+	 * instead of the heap, 0 disables the selection path. */
+	void setSelectionPointsPerK(std::size_t pointsPerK);
 
 };
 
+typedef BasicNaiveKnn<SquaredEuclidean> NaiveKnn;
+
 #endif
@@ -0,0 +1,34 @@
+#ifndef KNN_NAIVEKNND_H_
+#define KNN_NAIVEKNND_H_
+
+#include "FixedDimension.h"
+#include "NaiveKnn.h"
+
+#include <cstddef>
+
+/** BasicNaiveKnn with the dimension fixed at compile time, so the distance
+ * calculation is fully unrolled. Available for D up to MAX_FIXED_DIMENSION. */
+template<std::size_t D, class Metric = SquaredEuclidean>
+class NaiveKnnD: public BasicNaiveKnn<Metric> {
+	static_assert(D > 0 && D <= MAX_FIXED_DIMENSION,
+			"NaiveKnnD is only instantiated for D in [1, MAX_FIXED_DIMENSION]");
+
+public:
+	NaiveKnnD(double * points, std::size_t numberOfPoints) :
+			BasicNaiveKnn<Metric>(points, D, numberOfPoints) {
+	}
+
+	BPQ<PointArrayAccessor> kNearestNeighbors(unsigned k, PointAccessor* query)
+			override {
+		return this->template scan<D>(k, query);
+	}
+
+	std::size_t kNearestNeighborIds(unsigned k, PointAccessor* query,
+			std::size_t* ids, double* distances, bool finalDistances = false)
+					override {
+		return this->template scanIds<D>(k, query, ids, distances,
+				finalDistances);
+	}
+};
+
+#endif
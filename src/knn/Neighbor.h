@@ -0,0 +1,148 @@
+#ifndef KNN_NEIGHBOR_H_
+#define KNN_NEIGHBOR_H_
+
+#include "FixedBPQ.h"
+#include "SmallKQueue.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/** Entry of the index-based results (see
+ * KnnProcessor::kNearestNeighborIds), a point id and its distance. Engines
+ * also collect candidates with their own ids in it before mapping them to
+ * point ids. */
+struct Neighbor {
+	double distance;
+	std::size_t id;
+};
+
+/** Buffers of the index-based queries, one instance per thread and Index
+ * type (see local()). Reusing them across queries keeps batches (see
+ * KnnProcessor::kNearestNeighborIdsBatch) free of allocations once the
+ * buffers fit k, at the price of keeping the largest ones alive. */
+template<class Index>
+struct NeighborScratch {
+	FixedBPQ<Index> candidates { 0 };
+	std::vector<Neighbor> neighbors;
+
+	/** The scratch of the calling thread. */
+	static NeighborScratch& local() {
+		static thread_local NeighborScratch scratch;
+		return scratch;
+	}
+};
+
+inline bool closerThan(const Neighbor& left, const Neighbor& right) {
+	return left.distance < right.distance;
+}
+
+/** Appends the candidates of a queue, in heap order. */
+template<class Index>
+void appendNeighbors(const FixedBPQ<Index>& candidates,
+		std::vector<Neighbor>& neighbors) {
+	const typename FixedBPQ<Index>::Entry* entries = candidates.data();
+
+	for (std::size_t i = 0; i < candidates.size(); ++i) {
+		neighbors.push_back(Neighbor { entries[i].distance,
+				static_cast<std::size_t>(entries[i].index) });
+	}
+}
+
+/** Appends the candidates of a queue, closest first. */
+template<class T, std::size_t CAPACITY>
+void appendNeighbors(const SmallKQueue<T, CAPACITY>& candidates,
+		std::vector<Neighbor>& neighbors) {
+	for (std::size_t i = 0; i < candidates.size(); ++i) {
+		neighbors.push_back(Neighbor { candidates.distance(i),
+				static_cast<std::size_t>(candidates.point(i)) });
+	}
+}
+
+/** Cuts neighbors down to the k closest, in no particular order. */
+inline void selectNeighbors(unsigned k, std::vector<Neighbor>& neighbors) {
+	if (neighbors.size() <= k) {
+		return;
+	}
+
+	//the k-th closest ends up at k - 1, all closer ones before it
+	std::nth_element(neighbors.begin(), neighbors.begin() + (k - 1),
+			neighbors.end(), closerThan);
+	neighbors.resize(k);
+}
+
+/** Cuts neighbors down to the k closest and sorts them by distance. */
+inline void sortNeighbors(unsigned k, std::vector<Neighbor>& neighbors) {
+	selectNeighbors(k, neighbors);
+	std::sort(neighbors.begin(), neighbors.end(), closerThan);
+}
+
+/** Merges runs sorted by distance into their k closest, closest first, in
+ * O(k log T) for T runs: a tournament tree over the heads of the runs
+ * replays only the path of the run that lost its head. Equal distances
+ * keep the order of the runs. */
+inline void mergeNeighbors(unsigned k,
+		const std::vector<std::vector<Neighbor>>& runs,
+		std::vector<Neighbor>& merged) {
+	merged.clear();
+	if (runs.empty()) {
+		return;
+	}
+
+	std::size_t leaves = 1;
+	while (leaves < runs.size()) {
+		leaves *= 2;
+	}
+	std::vector<std::size_t> heads(runs.size(), 0);
+	auto exhausted = [&](std::size_t run) {
+		return run >= runs.size() || heads[run] == runs[run].size();
+	};
+	auto play = [&](std::size_t left, std::size_t right) {
+		if (exhausted(right)) {
+			return left;
+		}
+		if (exhausted(left)) {
+			return right;
+		}
+		return closerThan(runs[right][heads[right]], runs[left][heads[left]]) ?
+				right : left;
+	};
+
+	//winner[node]: run with the closest head below node, the leaf of run
+	//r is leaves + r, padding leaves stand for empty runs
+	std::vector<std::size_t> winner(2 * leaves);
+	for (std::size_t leaf = 0; leaf < leaves; ++leaf) {
+		winner[leaves + leaf] = leaf;
+	}
+	for (std::size_t node = leaves - 1; node > 0; --node) {
+		winner[node] = play(winner[2 * node], winner[2 * node + 1]);
+	}
+
+	merged.reserve(k);
+	while (merged.size() < k && !exhausted(winner[1])) {
+		const std::size_t run = winner[1];
+		merged.push_back(runs[run][heads[run]++]);
+
+		for (std::size_t node = (leaves + run) / 2; node > 0; node /= 2) {
+			winner[node] = play(winner[2 * node], winner[2 * node + 1]);
+		}
+	}
+}
+
+/** Copies neighbors into the flat result arrays and returns their number.
+ * With finalDistances, the distances are converted by Metric::finalize. */
+template<class Metric>
+std::size_t writeNeighbors(const std::vector<Neighbor>& neighbors,
+		std::size_t* ids, double* distances, bool finalDistances) {
+	for (std::size_t i = 0; i < neighbors.size(); ++i) {
+		ids[i] = neighbors[i].id;
+		distances[i] =
+				finalDistances ?
+						Metric::finalize(neighbors[i].distance) :
+						neighbors[i].distance;
+	}
+
+	return neighbors.size();
+}
+
+#endif
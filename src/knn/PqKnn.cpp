@@ -0,0 +1,244 @@
+#include "../knn/PqKnn.h"
+#include "../knn/FixedBPQ.h"
+#include "../knn/FixedDimension.h"
+#include "../knn/Metrics.h"
+#include "../knn/MetricPolicies.h"
+#include "../knn/Neighbor.h"
+#include "../knn/Rerank.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+const std::size_t PqKnn::CODEBOOK_SIZE;
+const unsigned PqKnn::TRAINING_ITERATIONS_DEFAULT;
+const std::size_t PqKnn::TRAINING_SAMPLE_DEFAULT;
+const unsigned PqKnn::RERANK_SLACK_DEFAULT;
+
+PqKnn::PqKnn(double * points, std::size_t dimension,
+		std::size_t numberOfPoints, std::size_t subspaces,
+		unsigned trainingIterations, std::size_t trainingSample, unsigned seed) :
+		points_(points), dimension_(dimension), numberOfPoints_(
+				numberOfPoints), codebookSize_(0), rerank_(true), rerankSlack_(
+				RERANK_SLACK_DEFAULT) {
+	if (subspaces == 0 || subspaces > dimension) {
+		throw std::invalid_argument(
+				"Number of subspaces must be within [1, dimension].");
+	}
+
+	//spread the remainder over the first subspaces
+	subspaceOffsets_.push_back(0);
+	for (std::size_t m = 0; m < subspaces; ++m) {
+		subspaceOffsets_.push_back(
+				subspaceOffsets_.back() + dimension / subspaces
+						+ (m < dimension % subspaces ? 1 : 0));
+	}
+	assert(subspaceOffsets_.back() == dimension_);
+
+	train(trainingIterations, trainingSample, seed);
+	encode();
+}
+
+std::size_t PqKnn::width(std::size_t subspace) const {
+	return subspaceOffsets_[subspace + 1] - subspaceOffsets_[subspace];
+}
+
+const double* PqKnn::centroid(std::size_t subspace, std::size_t code) const {
+	return &codebooks_[subspaceOffsets_[subspace] * codebookSize_
+			+ code * width(subspace)];
+}
+
+std::uint8_t PqKnn::closestCentroid(std::size_t subspace,
+		const double* subvector) const {
+	const std::size_t w = width(subspace);
+	std::size_t closest = 0;
+	double closestDist = std::numeric_limits<double>::infinity();
+
+	for (std::size_t c = 0; c < codebookSize_; ++c) {
+		double dist = Metrics::squared_euclidean(centroid(subspace, c),
+				subvector, w, closestDist);
+		if (dist < closestDist) {
+			closestDist = dist;
+			closest = c;
+		}
+	}
+
+	return static_cast<std::uint8_t>(closest);
+}
+
+void PqKnn::train(unsigned iterations, std::size_t trainingSample,
+		unsigned seed) {
+	std::vector<std::size_t> sample(numberOfPoints_);
+	std::iota(sample.begin(), sample.end(), 0);
+	std::default_random_engine engine(seed);
+	std::shuffle(sample.begin(), sample.end(), engine);
+	sample.resize(
+			std::min(sample.size(), std::max<std::size_t>(1, trainingSample)));
+
+	//initial centroids are the first sample points
+	codebookSize_ = std::min(CODEBOOK_SIZE, sample.size());
+	codebooks_.assign(dimension_ * codebookSize_, 0.0);
+	std::vector<double> sums;
+	std::vector<std::size_t> counts;
+
+	for (std::size_t m = 0; m < subspaces(); ++m) {
+		const std::size_t offset = subspaceOffsets_[m];
+		const std::size_t w = width(m);
+		double* codebook = &codebooks_[offset * codebookSize_];
+
+		for (std::size_t c = 0; c < codebookSize_; ++c) {
+			std::copy_n(&points_[sample[c] * dimension_ + offset], w,
+					&codebook[c * w]);
+		}
+
+		for (unsigned i = 0; i < iterations; ++i) {
+			sums.assign(codebookSize_ * w, 0.0);
+			counts.assign(codebookSize_, 0);
+
+			for (std::size_t point : sample) {
+				const double* subvector = &points_[point * dimension_ + offset];
+				std::size_t c = closestCentroid(m, subvector);
+				for (std::size_t d = 0; d < w; ++d) {
+					sums[c * w + d] += subvector[d];
+				}
+				++counts[c];
+			}
+
+			//empty clusters keep their centroid
+			for (std::size_t c = 0; c < codebookSize_; ++c) {
+				if (counts[c] > 0) {
+					for (std::size_t d = 0; d < w; ++d) {
+						codebook[c * w + d] = sums[c * w + d] / counts[c];
+					}
+				}
+			}
+		}
+	}
+}
+
+void PqKnn::encode() {
+	const std::size_t numberOfSubspaces = subspaces();
+	codes_.resize(numberOfPoints_ * numberOfSubspaces);
+
+	for (std::size_t point = 0; point < numberOfPoints_; ++point) {
+		for (std::size_t m = 0; m < numberOfSubspaces; ++m) {
+			codes_[point * numberOfSubspaces + m] = closestCentroid(m,
+					&points_[point * dimension_ + subspaceOffsets_[m]]);
+		}
+	}
+}
+
+std::vector<double> PqKnn::distanceTable(const double* query) const {
+	std::vector<double> table(subspaces() * codebookSize_);
+
+	for (std::size_t m = 0; m < subspaces(); ++m) {
+		const double* subvector = query + subspaceOffsets_[m];
+		for (std::size_t c = 0; c < codebookSize_; ++c) {
+			table[m * codebookSize_ + c] = Metrics::squared_euclidean(
+					centroid(m, c), subvector, width(m));
+		}
+	}
+
+	return table;
+}
+
+template<class Queue, class MakePoint>
+void PqKnn::scanCodes(const double* queryCoords, Queue& candidates,
+		MakePoint makePoint) const {
+	const std::vector<double> table = distanceTable(queryCoords);
+	const std::size_t numberOfSubspaces = subspaces();
+
+	for (std::size_t point = 0; point < numberOfPoints_; point++) {
+		const std::uint8_t* code = &codes_[point * numberOfSubspaces];
+		const double* subspaceTable = table.data();
+		double current_dist = 0.0;
+
+		for (std::size_t m = 0; m < numberOfSubspaces; ++m) {
+			current_dist += subspaceTable[code[m]];
+			subspaceTable += codebookSize_;
+		}
+
+		if (current_dist < candidates.max_dist()) {
+			candidates.push(makePoint(point), current_dist);
+		}
+	}
+}
+
+BPQ<PointArrayAccessor> PqKnn::kNearestNeighbors(unsigned k,
+		PointAccessor* query) {
+	assert(dimension_ == query->dimension());
+
+	const double* queryCoords = query->getData() + query->getOffset();
+	BPQ<PointArrayAccessor> candidates(rerank_ ? k + rerankSlack_ : k);
+	double* points = points_;
+	const std::size_t dimension = dimension_;
+
+	scanCodes(queryCoords, candidates, [points, dimension](std::size_t point) {
+		return PointArrayAccessor {points, point * dimension, dimension};
+	});
+
+	if (rerank_) {
+		return ::rerank<SquaredEuclidean, 0>(k, queryCoords, dimension_,
+				candidates);
+	}
+
+	return candidates;
+}
+
+std::size_t PqKnn::kNearestNeighborIds(unsigned k, PointAccessor* query,
+		std::size_t* ids, double* distances, bool finalDistances) {
+	assert(dimension_ == query->dimension());
+
+	const double* queryCoords = query->getData() + query->getOffset();
+	NeighborScratch<std::size_t>& scratch =
+			NeighborScratch<std::size_t>::local();
+	FixedBPQ<std::size_t>& candidates = scratch.candidates;
+	std::vector<Neighbor>& neighbors = scratch.neighbors;
+	candidates.reset(rerank_ ? k + rerankSlack_ : k);
+	neighbors.clear();
+
+	scanCodes(queryCoords, candidates, [](std::size_t point) {
+		return point;
+	});
+	appendNeighbors(candidates, neighbors);
+
+	if (rerank_) {
+		for (Neighbor& neighbor : neighbors) {
+			neighbor.distance =
+					FixedDimensionDistance<SquaredEuclidean, 0>::distance(
+							&points_[neighbor.id * dimension_], queryCoords,
+							dimension_, std::numeric_limits<double>::infinity());
+		}
+	}
+
+	sortNeighbors(k, neighbors);
+	return writeNeighbors<SquaredEuclidean>(neighbors, ids, distances,
+			finalDistances);
+}
+
+void PqKnn::setRerank(bool rerank) {
+	rerank_ = rerank;
+}
+
+void PqKnn::setRerankSlack(unsigned slack) {
+	rerankSlack_ = slack;
+}
+
+std::size_t PqKnn::subspaces() const {
+	return subspaceOffsets_.size() - 1;
+}
+
+std::size_t PqKnn::memoryUsage() const {
+	return codes_.size() * sizeof(std::uint8_t)
+			+ codebooks_.size() * sizeof(double);
+}
+
+void PqKnn::decode(std::size_t point, double* coordinates) const {
+	for (std::size_t m = 0; m < subspaces(); ++m) {
+		std::copy_n(centroid(m, codes_[point * subspaces() + m]), width(m),
+				coordinates + subspaceOffsets_[m]);
+	}
+}
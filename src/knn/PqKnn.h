@@ -0,0 +1,87 @@
+#ifndef KNN_PQKNN_H_
+#define KNN_PQKNN_H_
+#include "../model/PointAccessor.h"
+#include "../model/PointArrayAccessor.h"
+
+#include "KnnProcessor.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** kNN search on product quantization codes for high-dimensional points.
+ * The dimensions are split into subspaces, each with a codebook of up to
+ * CODEBOOK_SIZE centroids trained by k-means, and every point is stored as
+ * one byte per subspace. A query computes its squared distances to all
+ * centroids once, the scan then adds up one table entry per subspace
+ * (asymmetric distance computation). Optionally, k + slack candidates are
+ * re-ranked with exact squared euclidean distances on the original
+ * points. */
+class PqKnn: public KnnProcessor<PointArrayAccessor> {
+protected:
+	double * points_;
+	const std::size_t dimension_;
+	const std::size_t numberOfPoints_;
+	/** Subspace m covers [subspaceOffsets_[m], subspaceOffsets_[m + 1]). */
+	std::vector<std::size_t> subspaceOffsets_;
+	/** Number of centroids per subspace. */
+	std::size_t codebookSize_;
+	/** Centroid c of subspace m starts at
+	 * subspaceOffsets_[m] * codebookSize_ + c * width(m). */
+	std::vector<double> codebooks_;
+	/** Code of point p in subspace m at p * subspaces() + m. */
+	std::vector<std::uint8_t> codes_;
+	bool rerank_;
+	unsigned rerankSlack_;
+
+	std::size_t width(std::size_t subspace) const;
+	const double* centroid(std::size_t subspace, std::size_t code) const;
+	/** Index of the centroid closest to a subvector. */
+	std::uint8_t closestCentroid(std::size_t subspace,
+			const double* subvector) const;
+	/** Lloyd's k-means on a random sample, per subspace. */
+	void train(unsigned iterations, std::size_t trainingSample, unsigned seed);
+	void encode();
+	/** Squared distances of the query subvectors to all centroids,
+	 * table[m * codebookSize_ + c]. */
+	std::vector<double> distanceTable(const double* query) const;
+	/** Pushes all points whose code distance beats the bound of the
+	 * candidates as makePoint(point index). */
+	template<class Queue, class MakePoint>
+	void scanCodes(const double* queryCoords, Queue& candidates,
+			MakePoint makePoint) const;
+
+public:
+	/** Codes are bytes. */
+	static const std::size_t CODEBOOK_SIZE = 256;
+	static const unsigned TRAINING_ITERATIONS_DEFAULT = 10;
+	/** Maximum number of points k-means is trained on. */
+	static const std::size_t TRAINING_SAMPLE_DEFAULT = 16384;
+	/** Additional candidates re-ranked with exact distances. */
+	static const unsigned RERANK_SLACK_DEFAULT = 64;
+
+	/** Trains the codebooks and encodes all points. Throws
+	 * std::invalid_argument unless 0 < subspaces <= dimension. */
+	PqKnn(double * points, std::size_t dimension, std::size_t numberOfPoints,
+			std::size_t subspaces, unsigned trainingIterations =
+					TRAINING_ITERATIONS_DEFAULT, std::size_t trainingSample =
+					TRAINING_SAMPLE_DEFAULT, unsigned seed = 0);
+
+	/** Returns the k nearest neighbors by code distance, re-ranked with
+	 * exact distances if enabled. */
+	virtual BPQ<PointArrayAccessor> kNearestNeighbors(unsigned k,
+			PointAccessor* query) override;
+	virtual std::size_t kNearestNeighborIds(unsigned k, PointAccessor* query,
+			std::size_t* ids, double* distances, bool finalDistances = false)
+					override;
+
+	/** Enables the exact re-ranking (default). */
+	void setRerank(bool rerank);
+	void setRerankSlack(unsigned slack);
+	std::size_t subspaces() const;
+	/** Bytes occupied by codes and codebooks. */
+	std::size_t memoryUsage() const;
+	/** Reconstructs a point from its codes. */
+	void decode(std::size_t point, double* coordinates) const;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef KNN_QUANTIZEDKERNELS_H_
+#define KNN_QUANTIZEDKERNELS_H_
+
+#include "SimdLanes.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/** Squared euclidean distances of integer codes (see
+ * QuantizedPointContainer). Sums are exact: int8 differences are squared
+ * and added in int32 lanes, which are flushed before they can overflow,
+ * int16 products are widened to double, which represents them exactly. */
+
+/** Dimensions accumulated in int32 lanes before flushing int8 sums. */
+static const std::size_t INT8_FLUSH_DIMENSIONS = 8192;
+
+template<class Code>
+inline double quantizedSquaredEuclideanScalar(const Code* p, const Code* q,
+		std::size_t from, std::size_t dimension) {
+	std::int64_t sum = 0;
+	for (std::size_t d = from; d < dimension; ++d) {
+		std::int64_t diff = static_cast<std::int64_t>(p[d]) - q[d];
+		sum += diff * diff;
+	}
+	return static_cast<double>(sum);
+}
+
+#ifdef KNN_X86_SIMD
+
+KNN_TARGET_SSE2
+inline std::int64_t hsumInt32Sse2(__m128i v) {
+	alignas(16) std::int32_t lanes[4];
+	_mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+	return static_cast<std::int64_t>(lanes[0]) + lanes[1] + lanes[2]
+			+ lanes[3];
+}
+
+KNN_TARGET_SSE2
+inline double int8SquaredEuclideanSse2(const std::int8_t* p,
+		const std::int8_t* q, std::size_t dimension) {
+	std::int64_t sum = 0;
+	std::size_t d = 0;
+
+	while (d + 16 <= dimension) {
+		const std::size_t blockEnd = std::min(dimension,
+				d + INT8_FLUSH_DIMENSIONS);
+		__m128i acc = _mm_setzero_si128();
+
+		for (; d + 16 <= blockEnd; d += 16) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + d));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(q + d));
+			//sign extension to int16: duplicate bytes, shift arithmetically
+			__m128i diffLow = _mm_sub_epi16(
+					_mm_srai_epi16(_mm_unpacklo_epi8(a, a), 8),
+					_mm_srai_epi16(_mm_unpacklo_epi8(b, b), 8));
+			__m128i diffHigh = _mm_sub_epi16(
+					_mm_srai_epi16(_mm_unpackhi_epi8(a, a), 8),
+					_mm_srai_epi16(_mm_unpackhi_epi8(b, b), 8));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(diffLow, diffLow));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(diffHigh, diffHigh));
+		}
+		sum += hsumInt32Sse2(acc);
+	}
+
+	return static_cast<double>(sum)
+			+ quantizedSquaredEuclideanScalar(p, q, d, dimension);
+}
+
+KNN_TARGET_SSE2
+inline double int16SquaredEuclideanSse2(const std::int16_t* p,
+		const std::int16_t* q, std::size_t dimension) {
+	__m128d accLow = _mm_setzero_pd();
+	__m128d accHigh = _mm_setzero_pd();
+	std::size_t d = 0;
+
+	for (; d + 8 <= dimension; d += 8) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + d));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(q + d));
+		__m128i diff = _mm_sub_epi16(a, b);
+		__m128i squares = _mm_madd_epi16(diff, diff);
+		accLow = _mm_add_pd(accLow, _mm_cvtepi32_pd(squares));
+		accHigh = _mm_add_pd(accHigh,
+				_mm_cvtepi32_pd(_mm_shuffle_epi32(squares, 0xEE)));
+	}
+
+	alignas(16) double lanes[2];
+	_mm_store_pd(lanes, _mm_add_pd(accLow, accHigh));
+	return lanes[0] + lanes[1]
+			+ quantizedSquaredEuclideanScalar(p, q, d, dimension);
+}
+
+KNN_TARGET_AVX2
+inline double int8SquaredEuclideanAvx2(const std::int8_t* p,
+		const std::int8_t* q, std::size_t dimension) {
+	std::int64_t sum = 0;
+	std::size_t d = 0;
+
+	while (d + 16 <= dimension) {
+		const std::size_t blockEnd = std::min(dimension,
+				d + INT8_FLUSH_DIMENSIONS);
+		__m256i acc = _mm256_setzero_si256();
+
+		for (; d + 16 <= blockEnd; d += 16) {
+			__m256i a = _mm256_cvtepi8_epi16(
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + d)));
+			__m256i b = _mm256_cvtepi8_epi16(
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(q + d)));
+			__m256i diff = _mm256_sub_epi16(a, b);
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(diff, diff));
+		}
+		sum += hsumInt32Sse2(
+				_mm_add_epi32(_mm256_castsi256_si128(acc),
+						_mm256_extracti128_si256(acc, 1)));
+	}
+
+	return static_cast<double>(sum)
+			+ quantizedSquaredEuclideanScalar(p, q, d, dimension);
+}
+
+KNN_TARGET_AVX2
+inline double int16SquaredEuclideanAvx2(const std::int16_t* p,
+		const std::int16_t* q, std::size_t dimension) {
+	double sum = 0.0;
+	std::size_t d = 0;
+
+	//short rows must not touch the ymm registers, leaving their upper
+	//halves dirty slows down the SSE code of the caller
+	if (dimension >= 16) {
+		__m256d accLow = _mm256_setzero_pd();
+		__m256d accHigh = _mm256_setzero_pd();
+
+		for (; d + 16 <= dimension; d += 16) {
+			__m256i a = _mm256_loadu_si256(
+					reinterpret_cast<const __m256i*>(p + d));
+			__m256i b = _mm256_loadu_si256(
+					reinterpret_cast<const __m256i*>(q + d));
+			__m256i diff = _mm256_sub_epi16(a, b);
+			__m256i squares = _mm256_madd_epi16(diff, diff);
+			accLow = _mm256_add_pd(accLow,
+					_mm256_cvtepi32_pd(_mm256_castsi256_si128(squares)));
+			accHigh = _mm256_add_pd(accHigh,
+					_mm256_cvtepi32_pd(_mm256_extracti128_si256(squares, 1)));
+		}
+
+		alignas(32) double lanes[4];
+		_mm256_store_pd(lanes, _mm256_add_pd(accLow, accHigh));
+		sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+
+	return sum + quantizedSquaredEuclideanScalar(p, q, d, dimension);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef KNN_RERANK_H_
+#define KNN_RERANK_H_
+
+#include "BPQ.h"
+#include "FixedDimension.h"
+#include "SmallKQueue.h"
+
+#include <cstddef>
+
+/** Replaces approximate candidate distances (e.g. from single precision
+ * coordinates or the norm expansion) by exact distances of the Metric and
+ * keeps the k closest. Empties the approximate queue. Distances are
+ * computed like the exact scans of dimension D, so results compare equal. */
+template<class Metric, std::size_t D, class T>
+BPQ<T> rerank(unsigned k, const double* query, std::size_t dimension,
+		BPQ<T>& approximate) {
+	BPQ<T> exact(k);
+
+	while (!approximate.empty()) {
+		T point = approximate.topPoint();
+		double current_dist = FixedDimensionDistance<Metric, D>::distance(
+				point.getData() + point.getOffset(), query, dimension,
+				exact.max_dist());
+
+		if (current_dist < exact.max_dist()) {
+			exact.push(point, current_dist);
+		}
+		approximate.pop();
+	}
+
+	return exact;
+}
+
+/** As above for small candidate sets, which are visited closest first. */
+template<class Metric, std::size_t D, class T, std::size_t CAPACITY>
+BPQ<T> rerank(unsigned k, const double* query, std::size_t dimension,
+		const SmallKQueue<T, CAPACITY>& approximate) {
+	SmallKQueue<T, CAPACITY> exact(k);
+
+	for (std::size_t i = 0; i < approximate.size(); ++i) {
+		T point = approximate.point(i);
+		double current_dist = FixedDimensionDistance<Metric, D>::distance(
+				point.getData() + point.getOffset(), query, dimension,
+				exact.max_dist());
+
+		if (current_dist < exact.max_dist()) {
+			exact.push(point, current_dist);
+		}
+	}
+
+	return exact.toBPQ();
+}
+
+#endif
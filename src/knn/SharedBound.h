@@ -0,0 +1,69 @@
+#ifndef KNN_SHAREDBOUND_H_
+#define KNN_SHAREDBOUND_H_
+
+#include <atomic>
+#include <limits>
+
+/** Upper bound on the k-th distance of a search split into parallel tasks
+ * (e.g. the map tasks of BasicNaiveMapReduce). A task that holds k
+ * candidates publishes its k-th distance, the smallest published one
+ * bounds the final result, so all tasks can drop candidates at or beyond
+ * it. Lock-free, a task reading a stale bound merely prunes less. */
+class SharedBound {
+private:
+	std::atomic<double> bound_;
+
+public:
+	SharedBound() :
+			bound_(std::numeric_limits<double>::infinity()) {
+	}
+
+	SharedBound(const SharedBound&) = delete;
+	SharedBound& operator=(const SharedBound&) = delete;
+
+	double get() const {
+		return bound_.load(std::memory_order_relaxed);
+	}
+
+	/** Lowers the bound to distance, unless it is lower already. */
+	void publish(double distance) {
+		double current = get();
+		while (distance < current
+				&& !bound_.compare_exchange_weak(current, distance,
+						std::memory_order_relaxed)) {
+		}
+	}
+};
+
+/** Queue adapter for the scans: candidates have to beat both the queue's
+ * own bound and the shared one, and a full queue publishes its bound. */
+template<class Queue>
+class SharedBoundQueue {
+private:
+	Queue& candidates_;
+	SharedBound& shared_;
+	/** max_dist() of candidates_, cached as it only changes by push. */
+	double local_;
+
+public:
+	SharedBoundQueue(Queue& candidates, SharedBound& shared) :
+			candidates_(candidates), shared_(shared), local_(
+					candidates.max_dist()) {
+	}
+
+	double max_dist() const {
+		const double shared = shared_.get();
+		return shared < local_ ? shared : local_;
+	}
+
+	template<class T>
+	void push(const T& point, double distance) {
+		candidates_.push(point, distance);
+		local_ = candidates_.max_dist();
+		if (!candidates_.notFull()) {
+			shared_.publish(local_);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef KNN_SIMDLANES_H_
+#define KNN_SIMDLANES_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KNN_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/** Instruction set levels a distance kernel can be compiled for. */
+enum SIMD_LEVEL {
+	SCALAR, SSE2, AVX2, AVX512
+};
+
+/** Kernels are forced inline so that they always end up inside the
+ * target-attributed wrappers, also in unoptimized builds where an out-of-line
+ * kernel would pass vectors across mismatching ABIs. */
+#define KNN_INLINE inline __attribute__((always_inline))
+/** Keeps products and sums separately rounded in kernels whose results
+ * must equal the scalar kernel's, also on targets with FMA. */
+#define KNN_NO_CONTRACT __attribute__((optimize("fp-contract=off")))
+
+/** Lane traits wrap the handful of vector operations the distance kernels
+ * need. Kernels are templates over these traits and get instantiated inside
+ * functions carrying the matching target attribute (see Metrics.cpp), so the
+ * build itself does not need any -m flags. */
+struct ScalarLanes {
+	typedef double Vec;
+	static const std::size_t WIDTH = 1;
+
+	static inline Vec zero() {
+		return 0.0;
+	}
+	static inline Vec load(const double* p) {
+		return *p;
+	}
+	static inline Vec loadPartial(const double* p, std::size_t) {
+		return *p;
+	}
+	static inline Vec load(const float* p) {
+		return *p;
+	}
+	static inline Vec loadPartial(const float* p, std::size_t) {
+		return *p;
+	}
+	static inline Vec set1(double x) {
+		return x;
+	}
+	static inline void store(double* p, Vec a) {
+		*p = a;
+	}
+	static inline Vec add(Vec a, Vec b) {
+		return a + b;
+	}
+	static inline Vec sub(Vec a, Vec b) {
+		return a - b;
+	}
+	static inline Vec mul(Vec a, Vec b) {
+		return a * b;
+	}
+	static inline Vec fmadd(Vec a, Vec b, Vec c) {
+		return a * b + c;
+	}
+	static inline Vec abs(Vec a) {
+		return std::fabs(a);
+	}
+	static inline Vec max(Vec a, Vec b) {
+		return std::max(a, b);
+	}
+	static inline double hsum(Vec a) {
+		return a;
+	}
+	static inline double hmax(Vec a) {
+		return a;
+	}
+};
+
+#ifdef KNN_X86_SIMD
+
+#define KNN_TARGET_SSE2 __attribute__((target("sse2")))
+#define KNN_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define KNN_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+
+//Vector arguments of the (inlined) lane functions trigger ABI notes
+//for the generic translation unit target, which are irrelevant here.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+struct Sse2Lanes {
+	typedef __m128d Vec;
+	static const std::size_t WIDTH = 2;
+
+	static inline KNN_TARGET_SSE2 Vec zero() {
+		return _mm_setzero_pd();
+	}
+	static inline KNN_TARGET_SSE2 Vec load(const double* p) {
+		return _mm_loadu_pd(p);
+	}
+	/** Loads n < WIDTH coordinates, remaining lanes are zero. */
+	static inline KNN_TARGET_SSE2 Vec loadPartial(const double* p,
+			std::size_t) {
+		return _mm_load_sd(p);
+	}
+	/** Loads WIDTH single precision coordinates, widened to double. */
+	static inline KNN_TARGET_SSE2 Vec load(const float* p) {
+		return _mm_cvtps_pd(
+				_mm_castsi128_ps(
+						_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+	}
+	static inline KNN_TARGET_SSE2 Vec loadPartial(const float* p,
+			std::size_t) {
+		return _mm_cvtps_pd(_mm_load_ss(p));
+	}
+	static inline KNN_TARGET_SSE2 Vec set1(double x) {
+		return _mm_set1_pd(x);
+	}
+	static inline KNN_TARGET_SSE2 void store(double* p, Vec a) {
+		_mm_storeu_pd(p, a);
+	}
+	static inline KNN_TARGET_SSE2 Vec add(Vec a, Vec b) {
+		return _mm_add_pd(a, b);
+	}
+	static inline KNN_TARGET_SSE2 Vec sub(Vec a, Vec b) {
+		return _mm_sub_pd(a, b);
+	}
+	static inline KNN_TARGET_SSE2 Vec mul(Vec a, Vec b) {
+		return _mm_mul_pd(a, b);
+	}
+	static inline KNN_TARGET_SSE2 Vec fmadd(Vec a, Vec b, Vec c) {
+		return _mm_add_pd(_mm_mul_pd(a, b), c);
+	}
+	static inline KNN_TARGET_SSE2 Vec abs(Vec a) {
+		return _mm_andnot_pd(_mm_set1_pd(-0.0), a);
+	}
+	static inline KNN_TARGET_SSE2 Vec max(Vec a, Vec b) {
+		return _mm_max_pd(a, b);
+	}
+	static inline KNN_TARGET_SSE2 double hsum(Vec a) {
+		return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a)));
+	}
+	static inline KNN_TARGET_SSE2 double hmax(Vec a) {
+		return _mm_cvtsd_f64(_mm_max_sd(a, _mm_unpackhi_pd(a, a)));
+	}
+};
+
+struct Avx2Lanes {
+	typedef __m256d Vec;
+	static const std::size_t WIDTH = 4;
+
+	static inline KNN_TARGET_AVX2 Vec zero() {
+		return _mm256_setzero_pd();
+	}
+	static inline KNN_TARGET_AVX2 Vec load(const double* p) {
+		return _mm256_loadu_pd(p);
+	}
+	/** Loads n < WIDTH coordinates, remaining lanes are zero. */
+	static inline KNN_TARGET_AVX2 Vec loadPartial(const double* p,
+			std::size_t n) {
+		const __m256i lanes = _mm256_set_epi64x(3, 2, 1, 0);
+		const __m256i mask = _mm256_cmpgt_epi64(
+				_mm256_set1_epi64x(static_cast<long long>(n)), lanes);
+		return _mm256_maskload_pd(p, mask);
+	}
+	/** Loads WIDTH single precision coordinates, widened to double. */
+	static inline KNN_TARGET_AVX2 Vec load(const float* p) {
+		return _mm256_cvtps_pd(_mm_loadu_ps(p));
+	}
+	static inline KNN_TARGET_AVX2 Vec loadPartial(const float* p,
+			std::size_t n) {
+		const __m128i mask = _mm_cmpgt_epi32(
+				_mm_set1_epi32(static_cast<int>(n)), _mm_set_epi32(3, 2, 1, 0));
+		return _mm256_cvtps_pd(_mm_maskload_ps(p, mask));
+	}
+	static inline KNN_TARGET_AVX2 Vec set1(double x) {
+		return _mm256_set1_pd(x);
+	}
+	static inline KNN_TARGET_AVX2 void store(double* p, Vec a) {
+		_mm256_storeu_pd(p, a);
+	}
+	static inline KNN_TARGET_AVX2 Vec add(Vec a, Vec b) {
+		return _mm256_add_pd(a, b);
+	}
+	static inline KNN_TARGET_AVX2 Vec sub(Vec a, Vec b) {
+		return _mm256_sub_pd(a, b);
+	}
+	static inline KNN_TARGET_AVX2 Vec mul(Vec a, Vec b) {
+		return _mm256_mul_pd(a, b);
+	}
+	static inline KNN_TARGET_AVX2 Vec fmadd(Vec a, Vec b, Vec c) {
+		return _mm256_fmadd_pd(a, b, c);
+	}
+	static inline KNN_TARGET_AVX2 Vec abs(Vec a) {
+		return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a);
+	}
+	static inline KNN_TARGET_AVX2 Vec max(Vec a, Vec b) {
+		return _mm256_max_pd(a, b);
+	}
+	static inline KNN_TARGET_AVX2 double hsum(Vec a) {
+		__m128d low = _mm256_castpd256_pd128(a);
+		__m128d high = _mm256_extractf128_pd(a, 1);
+		low = _mm_add_pd(low, high);
+		return _mm_cvtsd_f64(_mm_add_sd(low, _mm_unpackhi_pd(low, low)));
+	}
+	static inline KNN_TARGET_AVX2 double hmax(Vec a) {
+		__m128d low = _mm256_castpd256_pd128(a);
+		__m128d high = _mm256_extractf128_pd(a, 1);
+		low = _mm_max_pd(low, high);
+		return _mm_cvtsd_f64(_mm_max_sd(low, _mm_unpackhi_pd(low, low)));
+	}
+};
+
+struct Avx512Lanes {
+	typedef __m512d Vec;
+	static const std::size_t WIDTH = 8;
+
+	static inline KNN_TARGET_AVX512 Vec zero() {
+		return _mm512_setzero_pd();
+	}
+	static inline KNN_TARGET_AVX512 Vec load(const double* p) {
+		return _mm512_loadu_pd(p);
+	}
+	/** Loads n < WIDTH coordinates, remaining lanes are zero. */
+	static inline KNN_TARGET_AVX512 Vec loadPartial(const double* p,
+			std::size_t n) {
+		return _mm512_maskz_loadu_pd(static_cast<__mmask8>((1u << n) - 1), p);
+	}
+	/** Loads WIDTH single precision coordinates, widened to double. */
+	static inline KNN_TARGET_AVX512 Vec load(const float* p) {
+		return _mm512_cvtps_pd(_mm256_loadu_ps(p));
+	}
+	static inline KNN_TARGET_AVX512 Vec loadPartial(const float* p,
+			std::size_t n) {
+		const __m256i mask = _mm256_cmpgt_epi32(
+				_mm256_set1_epi32(static_cast<int>(n)),
+				_mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+		return _mm512_cvtps_pd(_mm256_maskload_ps(p, mask));
+	}
+	static inline KNN_TARGET_AVX512 Vec set1(double x) {
+		return _mm512_set1_pd(x);
+	}
+	static inline KNN_TARGET_AVX512 void store(double* p, Vec a) {
+		_mm512_storeu_pd(p, a);
+	}
+	static inline KNN_TARGET_AVX512 Vec add(Vec a, Vec b) {
+		return _mm512_add_pd(a, b);
+	}
+	static inline KNN_TARGET_AVX512 Vec sub(Vec a, Vec b) {
+		return _mm512_sub_pd(a, b);
+	}
+	static inline KNN_TARGET_AVX512 Vec mul(Vec a, Vec b) {
+		return _mm512_mul_pd(a, b);
+	}
+	static inline KNN_TARGET_AVX512 Vec fmadd(Vec a, Vec b, Vec c) {
+		return _mm512_fmadd_pd(a, b, c);
+	}
+	static inline KNN_TARGET_AVX512 Vec abs(Vec a) {
+		return _mm512_abs_pd(a);
+	}
+	static inline KNN_TARGET_AVX512 Vec max(Vec a, Vec b) {
+		return _mm512_max_pd(a, b);
+	}
+	static inline KNN_TARGET_AVX512 double hsum(Vec a) {
+		//Fold halves, quarters and pairs; stays in 512 bit registers.
+		a = _mm512_add_pd(a, _mm512_shuffle_f64x2(a, a, 0x4E));
+		a = _mm512_add_pd(a, _mm512_shuffle_f64x2(a, a, 0xB1));
+		a = _mm512_add_pd(a, _mm512_permute_pd(a, 0x55));
+		return _mm512_cvtsd_f64(a);
+	}
+	static inline KNN_TARGET_AVX512 double hmax(Vec a) {
+		a = _mm512_max_pd(a, _mm512_shuffle_f64x2(a, a, 0x4E));
+		a = _mm512_max_pd(a, _mm512_shuffle_f64x2(a, a, 0xB1));
+		a = _mm512_max_pd(a, _mm512_permute_pd(a, 0x55));
+		return _mm512_cvtsd_f64(a);
+	}
+};
+
+#pragma GCC diagnostic pop
+
+#endif
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef KNN_SMALLKQUEUE_H_
+#define KNN_SMALLKQUEUE_H_
+
+#include "BPQ.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/** Largest k collected by SmallKQueue instead of BPQ. */
+static const std::size_t SMALL_K_MAX = 32;
+
+/** Bounded queue for small k, a drop-in for BPQ in the kNN scans. The
+ * distances are kept sorted in an inline array padded with infinity, so
+ * the insert position is a branch-free count over CAPACITY elements the
+ * compiler vectorizes, followed by a short shift. Points are stored in
+ * inline slots and only their slot numbers are shifted, nothing is
+ * allocated per query. */
+template<class T, std::size_t CAPACITY = SMALL_K_MAX>
+class SmallKQueue {
+	static_assert(CAPACITY > 0 && CAPACITY <= 256,
+			"slot numbers are stored in bytes");
+
+private:
+	typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+
+	/** Distances in ascending order, infinity beyond size_. */
+	double distances_[CAPACITY];
+	/** Slot of the i-th closest point. */
+	unsigned char order_[CAPACITY];
+	Slot slots_[CAPACITY];
+	std::size_t max_size_;
+	std::size_t size_;
+
+	T& slot(std::size_t s) {
+		return *reinterpret_cast<T*>(&slots_[s]);
+	}
+
+public:
+	explicit SmallKQueue(std::size_t max_size) :
+			max_size_(max_size), size_(0) {
+		assert(max_size > 0 && max_size <= CAPACITY);
+		for (std::size_t i = 0; i < CAPACITY; ++i) {
+			distances_[i] = std::numeric_limits<double>::infinity();
+		}
+	}
+
+	SmallKQueue(const SmallKQueue&) = delete;
+	SmallKQueue& operator=(const SmallKQueue&) = delete;
+
+	~SmallKQueue() {
+		//slots are handed out in order and never freed
+		for (std::size_t s = 0; s < size_; ++s) {
+			slot(s).~T();
+		}
+	}
+
+	/** Adds a candidate, requires distance < max_dist(). A full queue drops
+	 * its farthest point. Equal distances keep insertion order. */
+	void push(const T& point, double distance);
+	/** Distance candidates have to beat, infinity until the queue is
+	 * full. */
+	double max_dist() const;
+	std::size_t size() const;
+	bool empty() const;
+	bool notFull() const;
+	/** Distance of the i-th closest point. */
+	double distance(std::size_t i) const;
+	/** The i-th closest point. */
+	const T& point(std::size_t i) const;
+	/** Copies the entries into a BPQ of the same bound. */
+	BPQ<T> toBPQ() const;
+};
+
+template<class T, std::size_t CAPACITY>
+inline void SmallKQueue<T, CAPACITY>::push(const T& point, double distance) {
+	assert(distance < max_dist());
+
+	std::size_t position = 0;
+	for (std::size_t i = 0; i < CAPACITY; ++i) {
+		position += distances_[i] <= distance;
+	}
+
+	unsigned char s;
+	if (size_ == max_size_) {
+		//reuse the slot of the dropped farthest point
+		s = order_[size_ - 1];
+		slot(s) = point;
+	} else {
+		s = static_cast<unsigned char>(size_);
+		new (&slots_[s]) T(point);
+		++size_;
+	}
+
+	const std::size_t shifted = size_ - 1 - position;
+	std::memmove(&distances_[position + 1], &distances_[position],
+			shifted * sizeof(double));
+	std::memmove(&order_[position + 1], &order_[position], shifted);
+	distances_[position] = distance;
+	order_[position] = s;
+}
+
+template<class T, std::size_t CAPACITY>
+inline double SmallKQueue<T, CAPACITY>::max_dist() const {
+	return distances_[max_size_ - 1];
+}
+
+template<class T, std::size_t CAPACITY>
+inline std::size_t SmallKQueue<T, CAPACITY>::size() const {
+	return size_;
+}
+
+template<class T, std::size_t CAPACITY>
+inline bool SmallKQueue<T, CAPACITY>::empty() const {
+	return size_ == 0;
+}
+
+template<class T, std::size_t CAPACITY>
+inline bool SmallKQueue<T, CAPACITY>::notFull() const {
+	return size_ < max_size_;
+}
+
+template<class T, std::size_t CAPACITY>
+inline double SmallKQueue<T, CAPACITY>::distance(std::size_t i) const {
+	assert(i < size_);
+	return distances_[i];
+}
+
+template<class T, std::size_t CAPACITY>
+inline const T& SmallKQueue<T, CAPACITY>::point(std::size_t i) const {
+	assert(i < size_);
+	return *reinterpret_cast<const T*>(&slots_[order_[i]]);
+}
+
+template<class T, std::size_t CAPACITY>
+BPQ<T> SmallKQueue<T, CAPACITY>::toBPQ() const {
+	BPQ<T> result(max_size_);
+
+	//farthest first, so every push stays a leaf of the heap
+	for (std::size_t i = size_; i-- > 0;) {
+		result.push(point(i), distances_[i]);
+	}
+
+	return result;
+}
+
+/** Returns the collected candidates as BPQ, moving an existing BPQ. */
+template<class T>
+inline BPQ<T> toBPQ(BPQ<T>& candidates) {
+	return std::move(candidates);
+}
+
+template<class T, std::size_t CAPACITY>
+inline BPQ<T> toBPQ(const SmallKQueue<T, CAPACITY>& candidates) {
+	return candidates.toBPQ();
+}
+
+#endif
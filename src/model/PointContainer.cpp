@@ -7,12 +7,14 @@ std::size_t PointContainer::size() const {
 }
 
 void PointContainer::add(const double* p, std::size_t size) {
+	invalidateCaches();
 	for (std::size_t i = 0; i < size; i++) {
 		coordinates_.push_back(p[i]);
 	}
 }
 
 void PointContainer::addPoint(const double* p) {
+	invalidateCaches();
 	for (std::size_t i = 0; i < dimension_; i++) {
 		coordinates_.push_back(p[i]);
 	}
@@ -20,6 +22,7 @@ void PointContainer::addPoint(const double* p) {
 
 void PointContainer::addPointAtIndex(std::vector<double> point,
 		std::size_t indexPosition) {
+	invalidateCaches();
 	std::size_t indexOffset = dimension_ * indexPosition;
 	if (coordinates_.capacity() < (indexOffset + point.size())) {
 		coordinates_.reserve((indexOffset + point.size()));
@@ -31,6 +34,11 @@ void PointContainer::addPointAtIndex(std::vector<double> point,
 	}
 }
 
+void PointContainer::resize(std::size_t numberOfPoints) {
+	invalidateCaches();
+	coordinates_.resize(numberOfPoints * dimension_);
+}
+
 bool PointContainer::empty() {
 	return coordinates_.size() < dimension_;
 }
@@ -43,6 +51,7 @@ PointContainer PointContainer::clonePoint(std::size_t pointIndex) const {
 }
 
 PointContainer PointContainer::append(PointContainer& tail) {
+	invalidateCaches();
 	coordinates_.insert(coordinates_.end(), tail.begin(), tail.end());
 
 	return *this;
@@ -52,6 +61,53 @@ double* PointContainer::data() {
 	return coordinates_.data();
 }
 
+void PointContainer::computeSquaredNorms() {
+	const std::size_t numberOfPoints = size();
+	squaredNorms_.assign(numberOfPoints, 0.0);
+
+	for (std::size_t i = 0; i < numberOfPoints; i++) {
+		const double* point = &coordinates_[i * dimension_];
+		double norm = 0.0;
+
+		for (std::size_t d = 0; d < dimension_; d++) {
+			norm += point[d] * point[d];
+		}
+
+		squaredNorms_[i] = norm;
+	}
+}
+
+bool PointContainer::hasSquaredNorms() const {
+	return !squaredNorms_.empty() && squaredNorms_.size() == size();
+}
+
+const std::vector<double>& PointContainer::squaredNorms() const {
+	return squaredNorms_;
+}
+
+void PointContainer::computeSinglePrecision() {
+	singlePrecision_.assign(coordinates_.begin(), coordinates_.end());
+}
+
+bool PointContainer::hasSinglePrecision() const {
+	return singlePrecision_.size() == coordinates_.size();
+}
+
+const std::vector<float>& PointContainer::singlePrecision() const {
+	return singlePrecision_;
+}
+
+std::size_t PointContainer::memoryUsage() const {
+	return coordinates_.capacity() * sizeof(double)
+			+ squaredNorms_.capacity() * sizeof(double)
+			+ singlePrecision_.capacity() * sizeof(float);
+}
+
+void PointContainer::invalidateCaches() {
+	squaredNorms_.clear();
+	singlePrecision_.clear();
+}
+
 void PointContainer::to_stream(std::ostream& os) {
 	os << "PointContainer [\n";
 
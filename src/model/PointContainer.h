@@ -13,6 +13,8 @@ protected:
 	static const std::size_t DEFAULT_DIMENSION = 1;
 	std::size_t dimension_;
 	std::vector<double> coordinates_;
+	std::vector<double> squaredNorms_;
+	std::vector<float> singlePrecision_;
 
 public:
 	PointContainer() :
@@ -48,12 +50,35 @@ public:
 	void add(const double* p, std::size_t size);
 	void addPoint(const double* p);
 	void addPointAtIndex(std::vector<double> point, std::size_t indexPosition);
+	/** Grows or shrinks the container to numberOfPoints, new points are
+	 * zero until written through data(). */
+	void resize(std::size_t numberOfPoints);
 	std::size_t size() const;
 	virtual bool empty();
 	PointContainer clonePoint(std::size_t pointIndex) const;
 	PointContainer append(PointContainer& pc);
 	double* data();
 
+	/** Precomputes the squared euclidean norm of every point. Derived data
+	 * is dropped by add, addPoint, addPointAtIndex and append; writes
+	 * through data(), iterators or accessors require invalidateCaches(). */
+	void computeSquaredNorms();
+	/** Returns true if squaredNorms() holds one norm per point. */
+	bool hasSquaredNorms() const;
+	/** Precomputed squared norms, empty unless computeSquaredNorms() was
+	 * called since the last modification. */
+	const std::vector<double>& squaredNorms() const;
+	/** Creates a single precision copy of all coordinates, which scans
+	 * can read at half the bandwidth. Invalidated like the norms. */
+	void computeSinglePrecision();
+	bool hasSinglePrecision() const;
+	const std::vector<float>& singlePrecision() const;
+	/** Drops precomputed norms and the single precision copy. */
+	void invalidateCaches();
+	/** Bytes allocated for the coordinates and derived data, including
+	 * unused capacity. */
+	std::size_t memoryUsage() const;
+
 	void to_stream(std::ostream& os) override;
 
 	std::vector<double>::iterator begin() {
@@ -0,0 +1,149 @@
+#include "QuantizedPointContainer.h"
+
+#include "../knn/Metrics.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+/** The codes of a query of the given width. */
+std::vector<std::int8_t>& codesOfWidth(QueryCodes& queryCodes, std::int8_t) {
+	return queryCodes.int8;
+}
+std::vector<std::int16_t>& codesOfWidth(QueryCodes& queryCodes,
+		std::int16_t) {
+	return queryCodes.int16;
+}
+const std::vector<std::int8_t>& codesOfWidth(const QueryCodes& queryCodes,
+		std::int8_t) {
+	return queryCodes.int8;
+}
+const std::vector<std::int16_t>& codesOfWidth(const QueryCodes& queryCodes,
+		std::int16_t) {
+	return queryCodes.int16;
+}
+
+}
+
+template<>
+const std::int8_t QuantizedPointContainer<std::int8_t>::MAX_CODE = 127;
+template<>
+const std::int16_t QuantizedPointContainer<std::int16_t>::MAX_CODE = 16383;
+
+QuantizedPoints* QuantizedPoints::create(QUANTIZATION quantization, MBR& mbr,
+		const double* coordinates, std::size_t numberOfPoints) {
+	switch (quantization) {
+	case INT16:
+		return new QuantizedPointContainer<std::int16_t> { mbr, coordinates,
+				numberOfPoints };
+	default:
+		return new QuantizedPointContainer<std::int8_t> { mbr, coordinates,
+				numberOfPoints };
+	}
+}
+
+QuantizedPoints* QuantizedPoints::create(QUANTIZATION quantization, MBR& mbr,
+		std::size_t numberOfPoints) {
+	switch (quantization) {
+	case INT16:
+		return new QuantizedPointContainer<std::int16_t> { mbr, numberOfPoints };
+	default:
+		return new QuantizedPointContainer<std::int8_t> { mbr, numberOfPoints };
+	}
+}
+
+template<class Code>
+QuantizedPointContainer<Code>::QuantizedPointContainer(MBR& mbr,
+		std::size_t numberOfPoints) :
+		dimension_(mbr.getLowPoint().dimension()), step_(stepOf(mbr)), codes_(
+				numberOfPoints * dimension_) {
+	PointVectorAccessor low = mbr.getLowPoint();
+	for (std::size_t d = 0; d < dimension_; ++d) {
+		low_.push_back(low[d]);
+	}
+}
+
+template<class Code>
+QuantizedPointContainer<Code>::QuantizedPointContainer(MBR& mbr,
+		const double* coordinates, std::size_t numberOfPoints) :
+		QuantizedPointContainer(mbr, numberOfPoints) {
+	encodePoints(0, coordinates, numberOfPoints);
+}
+
+template<class Code>
+double QuantizedPointContainer<Code>::stepOf(MBR& mbr) {
+	PointVectorAccessor low = mbr.getLowPoint();
+	PointVectorAccessor high = mbr.getHighPoint();
+	double widest = 0.0;
+
+	for (std::size_t d = 0; d < low.dimension(); ++d) {
+		widest = std::max(widest, high[d] - low[d]);
+	}
+
+	return widest > 0.0 ? widest / (2.0 * MAX_CODE) : 1.0;
+}
+
+template<class Code>
+void QuantizedPointContainer<Code>::encode(const double* point,
+		Code* codes) const {
+	for (std::size_t d = 0; d < dimension_; ++d) {
+		double level = std::round((point[d] - low_[d]) / step_) - MAX_CODE;
+		level = std::min<double>(MAX_CODE, std::max<double>(-MAX_CODE, level));
+		codes[d] = static_cast<Code>(level);
+	}
+}
+
+template<class Code>
+void QuantizedPointContainer<Code>::encodePoints(std::size_t firstPoint,
+		const double* coordinates, std::size_t numberOfPoints) {
+	assert(firstPoint + numberOfPoints <= size());
+	for (std::size_t i = 0; i < numberOfPoints; ++i) {
+		encode(&coordinates[i * dimension_],
+				&codes_[(firstPoint + i) * dimension_]);
+	}
+}
+
+template<class Code>
+void QuantizedPointContainer<Code>::encodeQuery(const double* query,
+		QueryCodes& queryCodes) const {
+	std::vector<Code>& codes = codesOfWidth(queryCodes, Code());
+	codes.resize(dimension_);
+	encode(query, codes.data());
+}
+
+template<class Code>
+std::size_t QuantizedPointContainer<Code>::size() const {
+	return codes_.size() / dimension_;
+}
+
+template<class Code>
+std::size_t QuantizedPointContainer<Code>::memoryUsage() const {
+	return codes_.size() * sizeof(Code) + low_.size() * sizeof(double);
+}
+
+template<class Code>
+void QuantizedPointContainer<Code>::squaredDistances(
+		const QueryCodes& queryCodes, std::size_t firstPoint,
+		std::size_t lastPoint, double* distances) const {
+	assert(lastPoint <= size());
+	const std::vector<Code>& codes = codesOfWidth(queryCodes, Code());
+	assert(codes.size() == dimension_);
+	const Code* query = codes.data();
+	const double squaredStep = step_ * step_;
+
+	for (std::size_t i = firstPoint; i < lastPoint; ++i) {
+		distances[i - firstPoint] = squaredStep
+				* Metrics::squared_euclidean(&codes_[i * dimension_], query,
+						dimension_);
+	}
+}
+
+template<class Code>
+double QuantizedPointContainer<Code>::step() const {
+	return step_;
+}
+
+template class QuantizedPointContainer<std::int8_t>;
+template class QuantizedPointContainer<std::int16_t>;
@@ -0,0 +1,92 @@
+#ifndef MODEL_QUANTIZEDPOINTCONTAINER_H_
+#define MODEL_QUANTIZEDPOINTCONTAINER_H_
+
+#include "MBR.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum QUANTIZATION {
+	INT8, INT16
+};
+
+/** Codes of a query, encoded once per search (see
+ * QuantizedPoints::encodeQuery) in the width of the points. */
+struct QueryCodes {
+	std::vector<std::int8_t> int8;
+	std::vector<std::int16_t> int16;
+};
+
+/** Reference points stored as integer codes, used to filter candidates
+ * which are refined with the original coordinates. */
+class QuantizedPoints {
+public:
+	virtual ~QuantizedPoints() {
+	}
+
+	/** Encodes numberOfPoints points with the bounds of mbr. */
+	static QuantizedPoints* create(QUANTIZATION quantization, MBR& mbr,
+			const double* coordinates, std::size_t numberOfPoints);
+	/** Room for numberOfPoints points with the bounds of mbr, to be
+	 * encoded by encodePoints. */
+	static QuantizedPoints* create(QUANTIZATION quantization, MBR& mbr,
+			std::size_t numberOfPoints);
+
+	virtual std::size_t size() const = 0;
+	/** Bytes occupied by codes and decoding parameters. */
+	virtual std::size_t memoryUsage() const = 0;
+	/** Encodes numberOfPoints points as the points from firstPoint on. */
+	virtual void encodePoints(std::size_t firstPoint,
+			const double* coordinates, std::size_t numberOfPoints) = 0;
+	/** Encodes a query for squaredDistances. */
+	virtual void encodeQuery(const double* query,
+			QueryCodes& queryCodes) const = 0;
+	/** Approximate squared euclidean distances of the points
+	 * [firstPoint, lastPoint) to an encoded query, in the units of the
+	 * coordinates. */
+	virtual void squaredDistances(const QueryCodes& queryCodes,
+			std::size_t firstPoint, std::size_t lastPoint,
+			double* distances) const = 0;
+};
+
+/** Scalar quantization of each coordinate to round((x - low) / step),
+ * shifted into the signed range of Code. low is the per-dimension minimum
+ * of the MBR, step is shared by all dimensions (the widest extent divided
+ * by the number of levels), so that code distances are proportional to
+ * coordinate distances and the integer kernels apply unweighted. Points
+ * and queries outside the MBR are clamped. */
+template<class Code>
+class QuantizedPointContainer: public QuantizedPoints {
+protected:
+	const std::size_t dimension_;
+	std::vector<double> low_;
+	double step_;
+	std::vector<Code> codes_;
+
+	static double stepOf(MBR& mbr);
+	void encode(const double* point, Code* codes) const;
+
+public:
+	/** Codes range from -MAX_CODE to MAX_CODE, differences of two codes
+	 * fit into the 16 bit lanes of the integer kernels. */
+	static const Code MAX_CODE;
+
+	QuantizedPointContainer(MBR& mbr, std::size_t numberOfPoints);
+	QuantizedPointContainer(MBR& mbr, const double* coordinates,
+			std::size_t numberOfPoints);
+
+	std::size_t size() const override;
+	std::size_t memoryUsage() const override;
+	void encodePoints(std::size_t firstPoint, const double* coordinates,
+			std::size_t numberOfPoints) override;
+	void encodeQuery(const double* query, QueryCodes& queryCodes) const
+			override;
+	void squaredDistances(const QueryCodes& queryCodes,
+			std::size_t firstPoint, std::size_t lastPoint,
+			double* distances) const override;
+	/** Width of one quantization level. */
+	double step() const;
+};
+
+#endif
@@ -1,187 +1,408 @@
 #include "NaiveMapReduce.h"
-#include "../grid/Grid.h"
+#include "../util/Affinity.h"
 
-#include <cmath>
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
-#include <functional>
-#include <thread>
+#include <limits>
+#include <stdexcept>
 #include <vector>
 
-BPQ<PointArrayAccessor> NaiveMapReduce::kNearestNeighbors(unsigned k,
-		PointAccessor* query) {
+template<class Metric>
+BPQ<PointArrayAccessor> BasicNaiveMapReduce<Metric>::kNearestNeighbors(
+		unsigned k, PointAccessor* query) {
 
-	unsigned arraySize = numberOfPoints_ * dimension_;
+	unsigned arraySize = this->numberOfPoints_ * this->dimension_;
 
 	if (arraySize < singleThreadedThreashold_) {
-		return NaiveKnn::kNearestNeighbors(k, query);
+		return BasicNaiveKnn<Metric>::kNearestNeighbors(k, query);
 	}
 
-	unsigned threadLoad = maxThreadLoad_ < k ? k : maxThreadLoad_;
-	std::vector<std::thread> mapThreads;
+	std::vector<Neighbor> neighbors;
+	mapReduceNeighbors(query, k, neighbors);
+	return this->selectionResult(k, neighbors);
+}
 
-	unsigned numberOfThreads =
-			std::ceil(arraySize / threadLoad) > maxThreads_ ?
-					maxThreads_ : (arraySize / threadLoad);
+template<class Metric>
+std::size_t BasicNaiveMapReduce<Metric>::kNearestNeighborIds(unsigned k,
+		PointAccessor* query, std::size_t* ids, double* distances,
+		bool finalDistances) {
+	unsigned arraySize = this->numberOfPoints_ * this->dimension_;
 
-	//Init map result vector
-	std::vector<BPQ<PointArrayAccessor>> mapNaiveResult;
-	std::vector<BPQ<PointVectorAccessor>> mapGridResult;
-	if (knnStrategy_ == NAIVE) {
-		mapNaiveResult.resize(numberOfThreads, BPQ<PointArrayAccessor> { k });
-	} else {
-		mapGridResult.resize(numberOfThreads, BPQ<PointVectorAccessor> { k });
+	if (arraySize < singleThreadedThreashold_) {
+		return BasicNaiveKnn<Metric>::kNearestNeighborIds(k, query, ids,
+				distances, finalDistances);
 	}
 
-	//Offset calculations for map chunks
-	assert(numberOfThreads > 0);
+	std::vector<Neighbor> neighbors;
+	mapReduceNeighbors(query, k, neighbors);
+	return writeNeighbors<Metric>(neighbors, ids, distances, finalDistances);
+}
 
-	std::size_t thread_offset = (arraySize / numberOfThreads);
-	std::size_t step = thread_offset + dimension_
-			- (thread_offset % dimension_);
-	std::size_t lastFullStepOffset = (numberOfThreads - 1) * step;
-	std::size_t endStep = arraySize - lastFullStepOffset;
-
-	assert(thread_offset > 0);
-	assert(step / numberOfThreads > 0);
-	assert(lastFullStepOffset > 0);
-	assert(endStep > 0);
-
-	assert(endStep + lastFullStepOffset == dimension_ * numberOfPoints_);
-	assert(numberOfThreads * step >= numberOfPoints_);
-
-	//Start the first n-1 threads
-	switch (knnStrategy_) {
-	case NAIVE: {
-		for (unsigned threadId = 0; threadId < numberOfThreads - 1;
-				++threadId) {
-			mapThreads.push_back(
-					std::thread(&NaiveMapReduce::mapNaive, this,
-							&points_[threadId * step], query, k, step, threadId,
-							std::ref(mapNaiveResult)));
-		}
-	}
-		break;
-	case GRID: {
-		for (unsigned threadId = 0; threadId < numberOfThreads - 1;
-				++threadId) {
-			mapThreads.push_back(
-					std::thread(&NaiveMapReduce::mapGrid, this,
-							&points_[threadId * step], query, k, step, threadId,
-							std::ref(mapGridResult)));
-		}
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::kNearestNeighborIdsBatch(unsigned k,
+		PointContainer& queries, unsigned numberOfThreads, std::size_t* ids,
+		double* distances, bool finalDistances) {
+	if (knnStrategy_ == NAIVE && Metric::TILED) {
+		mapReduceBatch(k, queries, numberOfThreads, ids, distances,
+				finalDistances);
+		return;
 	}
-		break;
-	default:
-		throw std::runtime_error("Specified kNN strategy not supported!");
+	if (queries.size() < numberOfThreads) {
+		//one query after the other, each one map-reduced
+		BasicNaiveKnn<Metric>::kNearestNeighborIdsBatch(k, queries, 1, ids,
+				distances, finalDistances);
+		return;
 	}
 
-	//Handle last thread separately
-	switch (knnStrategy_) {
-	case NAIVE: {
-		mapThreads.push_back(
-				std::thread(&NaiveMapReduce::mapNaive, this,
-						&points_[lastFullStepOffset], query, k, endStep,
-						numberOfThreads - 1, std::ref(mapNaiveResult)));
-	}
-		break;
-	case GRID: {
-		mapThreads.push_back(
-				std::thread(&NaiveMapReduce::mapGrid, this,
-						&points_[lastFullStepOffset], query, k, endStep,
-						numberOfThreads - 1, std::ref(mapGridResult)));
-	}
-		break;
-	}
+	this->batchIds(k, queries, numberOfThreads, ids, distances,
+			[=](PointAccessor* query, std::size_t* rowIds,
+					double* rowDistances) {
+				return this->BasicNaiveKnn<Metric>::kNearestNeighborIds(k,
+						query, rowIds, rowDistances, finalDistances);
+			});
+}
 
-	//Join threads
-	for (unsigned threadId = 0; threadId < numberOfThreads; ++threadId) {
-		mapThreads[threadId].join();
-	}
+template<class Metric>
+unsigned BasicNaiveMapReduce<Metric>::mapChunks(unsigned k,
+		std::size_t& pointsPerChunk) const {
+	const std::size_t arraySize = this->numberOfPoints_ * this->dimension_;
+	const std::size_t threadLoad = maxThreadLoad_ < k ? k : maxThreadLoad_;
 
-	//Switch to appropriate kNN strategy
-	switch (knnStrategy_) {
-	case NAIVE: {
-		return reduceNaive(mapNaiveResult, query);
+	std::size_t numberOfThreads = arraySize / threadLoad;
+	if (numberOfThreads > maxThreads_) {
+		numberOfThreads = maxThreads_;
 	}
-		break;
-	case GRID: {
-		return reduceGrid(mapGridResult, query, k);
-	}
-		break;
-	default:
-		//It should crash much earlier, this is just to
-		//get rid compiler warnings.
-		throw std::runtime_error("Specified kNN strategy not supported!");
+	if (numberOfThreads == 0) {
+		numberOfThreads = 1;
 	}
 
+	//finer chunks balance the threads, as long as the k candidates of a
+	//chunk stay few compared to its points
+	std::size_t numberOfChunks = std::min(
+			numberOfThreads * MAP_CHUNKS_PER_THREAD,
+			this->numberOfPoints_
+					/ (static_cast<std::size_t>(k) * MIN_CHUNK_POINTS_PER_K));
+	numberOfChunks = std::max(numberOfChunks, numberOfThreads);
+	numberOfChunks = std::min(numberOfChunks, this->numberOfPoints_);
+	assert(numberOfChunks > 0);
+
+	pointsPerChunk = (this->numberOfPoints_ + numberOfChunks - 1)
+			/ numberOfChunks;
+	//rounding up can leave the last chunks empty
+	numberOfChunks = (this->numberOfPoints_ + pointsPerChunk - 1)
+			/ pointsPerChunk;
+	assert(numberOfChunks * pointsPerChunk >= this->numberOfPoints_);
+
+	return numberOfChunks;
 }
 
-void NaiveMapReduce::mapNaive(double* points, PointAccessor* query, unsigned k,
-		std::size_t step, unsigned storeId,
-		std::vector<BPQ<PointArrayAccessor>>& mapResult) {
-	assert(dimension_ == query->dimension());
+template<class Metric>
+unsigned BasicNaiveMapReduce<Metric>::mapTasks(unsigned k,
+		std::size_t& pointsPerChunk) {
+	if (knnStrategy_ != GRID) {
+		return mapChunks(k, pointsPerChunk);
+	}
 
-	PointArrayAccessor current_point { points, 0, dimension_ };
-	double current_dist = 0.0;
+	std::lock_guard<std::mutex> guard(partitionGridsLock_);
+	if (partitionGrids_.empty()) {
+		createPartitionGrids(k);
+	}
+	pointsPerChunk = pointsPerPartition_;
+	return partitionGrids_.size();
+}
 
-	for (std::size_t pIndex = 0; pIndex < step; pIndex += dimension_) {
-		current_point.setOffset(pIndex);
-		current_dist = Metrics::squared_euclidean(current_point, query);
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::buildPartitionGrids(unsigned k) {
+	std::lock_guard<std::mutex> guard(partitionGridsLock_);
+	createPartitionGrids(k);
+}
 
-		if (current_dist < mapResult[storeId].max_dist()) {
-			mapResult[storeId].push(PointArrayAccessor { points, pIndex,
-					dimension_ }, current_dist);
-		}
-	}
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::invalidatePartitionGrids() {
+	std::lock_guard<std::mutex> guard(partitionGridsLock_);
+	partitionGrids_.clear();
+}
 
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::createPartitionGrids(unsigned k) {
+	std::size_t pointsPerPartition;
+	const unsigned numberOfPartitions = mapChunks(k, pointsPerPartition);
+	const std::size_t cellFill = BasicGrid<Metric>::determineCellSize(k);
+	std::vector<std::unique_ptr<BasicGrid<Metric>>> grids(numberOfPartitions);
+
+	runMapTasks(numberOfPartitions, [&](std::size_t partition) {
+		const std::size_t firstPoint = partition * pointsPerPartition;
+		const std::size_t lastPoint = std::min(
+				firstPoint + pointsPerPartition, this->numberOfPoints_);
+		grids[partition].reset(
+				BasicGrid<Metric>::create(this->dimension_,
+						&this->points_[firstPoint * this->dimension_],
+						(lastPoint - firstPoint) * this->dimension_, cellFill));
+	});
+
+	partitionGrids_.swap(grids);
+	pointsPerPartition_ = pointsPerPartition;
 }
 
-void NaiveMapReduce::mapGrid(double* points, PointAccessor* query, unsigned k,
-		std::size_t step, unsigned storeId,
-		std::vector<BPQ<PointVectorAccessor>>& mapResult) {
-	assert(dimension_ == query->dimension());
-	Grid grid = Grid { dimension_, points, step, Grid::determineCellSize(k) };
-	mapResult[storeId] = grid.kNearestNeighbors(k, query);
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::threadPart(unsigned thread,
+		std::size_t& firstPoint, std::size_t& lastPoint) const {
+	//the pool hands every thread a contiguous share of the map chunks
+	const std::size_t threads = pool_->size();
+	firstPoint = this->numberOfPoints_ * thread / threads;
+	lastPoint = this->numberOfPoints_ * (thread + 1) / threads;
 }
 
-BPQ<PointArrayAccessor> NaiveMapReduce::reduceNaive(
-		std::vector<BPQ<PointArrayAccessor>>& mapResult, PointAccessor* query) {
-	unsigned resultQueueIdx = 0;
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::placePoints() {
+	const std::size_t dimension = this->dimension_;
+	//new[] without initializer leaves the pages to the first touch below. A
+	//copy placed before is refilled, the pinned threads are the same.
+	if (!placedPoints_) {
+		placedPoints_.reset(new double[this->numberOfPoints_ * dimension]);
+	}
 
-	for (unsigned bpq_idx = 1; bpq_idx < mapResult.size(); ++bpq_idx) {
+	pool_->forEachThread([&](unsigned thread) {
+		std::size_t firstPoint;
+		std::size_t lastPoint;
+		threadPart(thread, firstPoint, lastPoint);
+		std::copy(sourcePoints_ + firstPoint * dimension,
+				sourcePoints_ + lastPoint * dimension,
+				placedPoints_.get() + firstPoint * dimension);
+	});
+}
 
-		while (!mapResult[bpq_idx].empty()) {
-			double topDistance = mapResult[bpq_idx].topDistance();
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::setNumaAware(bool numaAware) {
+	if (numaAware == numaAware_) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> guard(poolLock_);
+		pool_.reset(new ThreadPool(maxThreads_, numaAware));
+	}
+	numaAware_ = numaAware;
 
-			if (topDistance < mapResult[resultQueueIdx].topDistance()) {
-				mapResult[resultQueueIdx].push(mapResult[bpq_idx].topPoint(),
-						topDistance);
-			}
+	if (numaAware) {
+		placePoints();
+		this->points_ = placedPoints_.get();
+	} else {
+		//earlier results may still refer to placedPoints_
+		this->points_ = sourcePoints_;
+	}
+	invalidatePartitionGrids();
+}
 
-			mapResult[bpq_idx].pop();
+template<class Metric>
+std::vector<double> BasicNaiveMapReduce<Metric>::nodeBandwidth() {
+	ThreadPool& pool = threadPool();
+	const CpuTopology& topology = CpuTopology::local();
+	std::vector<double> seconds(pool.size());
+	std::vector<std::size_t> bytes(pool.size());
+
+	pool.forEachThread([&](unsigned thread) {
+		std::size_t firstPoint;
+		std::size_t lastPoint;
+		threadPart(thread, firstPoint, lastPoint);
+		const double* first = this->points_ + firstPoint * this->dimension_;
+		const double* last = this->points_ + lastPoint * this->dimension_;
+
+		auto start = std::chrono::steady_clock::now();
+		double sum = 0.0;
+		for (const double* coordinate = first; coordinate < last;
+				++coordinate) {
+			sum += *coordinate;
 		}
+		auto end = std::chrono::steady_clock::now();
+
+		//keeps the reads
+		volatile double checksum = sum;
+		(void) checksum;
+		seconds[thread] = std::chrono::duration<double>(end - start).count();
+		bytes[thread] = (last - first) * sizeof(double);
+	});
+
+	//threads of a node read concurrently, the slowest one ends the read
+	std::vector<double> nodeBytes(topology.numberOfNodes, 0.0);
+	std::vector<double> nodeSeconds(topology.numberOfNodes, 0.0);
+	for (unsigned thread = 0; thread < pool.size(); ++thread) {
+		const int cpu = pool.cpu(thread);
+		const unsigned node = cpu < 0 ? 0 : topology.nodeOf(cpu);
+		nodeBytes[node] += bytes[thread];
+		nodeSeconds[node] = std::max(nodeSeconds[node], seconds[thread]);
 	}
 
-	return mapResult[resultQueueIdx];
+	std::vector<double> bandwidth(topology.numberOfNodes, 0.0);
+	for (unsigned node = 0; node < topology.numberOfNodes; ++node) {
+		if (nodeSeconds[node] > 0.0) {
+			bandwidth[node] = nodeBytes[node] / nodeSeconds[node];
+		}
+	}
+	return bandwidth;
+}
+
+template<class Metric>
+template<class Body>
+void BasicNaiveMapReduce<Metric>::runMapTasks(std::size_t numberOfChunks,
+		Body body, unsigned numberOfThreads) {
+	if (persistentThreads_ || numaAware_) {
+		threadPool().parallelFor(numberOfChunks, body);
+	} else {
+		parallelFor(numberOfChunks,
+				numberOfThreads == 0 ? maxThreads_ : numberOfThreads, body);
+	}
 }
 
-BPQ<PointArrayAccessor> NaiveMapReduce::reduceGrid(
-		std::vector<BPQ<PointVectorAccessor>>& mapResult, PointAccessor* query,
-		unsigned k) {
-	BPQ<PointArrayAccessor> result { k };
-	PointArrayAccessor pa = PointArrayAccessor{query->getData(),query->getOffset(),query->dimension()};
-	for (unsigned bpq_idx = 0; bpq_idx < mapResult.size(); ++bpq_idx) {
+template<class Metric>
+ThreadPool& BasicNaiveMapReduce<Metric>::threadPool() {
+	std::lock_guard<std::mutex> guard(poolLock_);
+	if (!pool_) {
+		pool_.reset(new ThreadPool(maxThreads_));
+	}
+	return *pool_;
+}
 
-		while (!(mapResult[bpq_idx].empty())) {
-			double topDistance = mapResult[bpq_idx].topDistance();
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::setPersistentThreads(
+		bool persistentThreads) {
+	persistentThreads_ = persistentThreads;
+}
 
-			if (topDistance < result.max_dist()) {
-				result.push(pa, topDistance);
-			}
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::mapReduceNeighbors(PointAccessor* query,
+		unsigned k, std::vector<Neighbor>& neighbors) {
+	assert(this->dimension_ == query->dimension());
 
-			mapResult[bpq_idx].pop();
+	if (knnStrategy_ != NAIVE && knnStrategy_ != GRID) {
+		throw std::runtime_error("Specified kNN strategy not supported!");
+	}
+	//map chunks are sized by k
+	if (k == 0) {
+		neighbors.clear();
+		return;
+	}
+
+	const double* queryCoords = query->getData() + query->getOffset();
+	std::size_t pointsPerChunk;
+	const unsigned numberOfChunks = mapTasks(k, pointsPerChunk);
+	std::vector<std::vector<Neighbor>> chunkNeighbors(numberOfChunks);
+	SharedBound bound;
+
+	runMapTasks(numberOfChunks, [&](std::size_t chunk) {
+		const std::size_t firstPoint = chunk * pointsPerChunk;
+		const std::size_t lastPoint = std::min(firstPoint + pointsPerChunk,
+				this->numberOfPoints_);
+
+		if (knnStrategy_ == NAIVE) {
+			this->template collectRange<0>(queryCoords, firstPoint, lastPoint,
+					k, chunkNeighbors[chunk], &bound);
+			sortNeighbors(k, chunkNeighbors[chunk]);
+		} else {
+			mapGridIds(chunk, query, k, firstPoint, chunkNeighbors[chunk]);
 		}
+	});
+
+	//candidates beyond the shared bound are never among the k merged ones
+	mergeNeighbors(k, chunkNeighbors, neighbors);
+}
+
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::mapGridIds(std::size_t partition,
+		PointAccessor* query, unsigned k, std::size_t firstPoint,
+		std::vector<Neighbor>& neighbors) {
+	std::vector<std::size_t> ids(k);
+	std::vector<double> distances(k);
+	std::size_t found = partitionGrids_[partition]->kNearestNeighborIds(k,
+			query, ids.data(), distances.data());
+
+	for (std::size_t i = 0; i < found; ++i) {
+		neighbors.push_back(Neighbor { distances[i], firstPoint + ids[i] });
 	}
+}
 
-	return result;
+template<class Metric>
+void BasicNaiveMapReduce<Metric>::mapReduceBatch(unsigned k,
+		PointContainer& queries, unsigned numberOfThreads, std::size_t* ids,
+		double* distances, bool finalDistances) {
+	assert(numberOfThreads > 0);
+	if (queries.empty() || k == 0) {
+		return;
+	}
+	assert(queries[0].dimension() == this->dimension_);
+
+	//one chunk per thread, the cost per point is the same everywhere. On
+	//the pool, chunk t is the part of pool thread t (see threadPart), which
+	//holds it in its cache and, if NUMA-aware, on its node.
+	const bool pooled = persistentThreads_ || numaAware_;
+	const std::size_t numberOfChunks = std::max<std::size_t>(1,
+			std::min<std::size_t>(
+					pooled ? threadPool().size() : numberOfThreads,
+					this->numberOfPoints_));
+
+	const std::size_t tile = Metrics::QUERY_TILE;
+	std::size_t groupSize = BATCH_CANDIDATES_MAX / (numberOfChunks * k);
+	groupSize = std::max(tile, groupSize / tile * tile);
+	std::vector<std::vector<BPQ<PointArrayAccessor>>> chunkCandidates(
+			numberOfChunks);
+
+	for (std::size_t firstQuery = 0; firstQuery < queries.size();
+			firstQuery += groupSize) {
+		const std::size_t groupQueries = std::min(groupSize,
+				queries.size() - firstQuery);
+		PointContainer group(this->dimension_,
+				queries.data() + firstQuery * this->dimension_, groupQueries);
+		const std::vector<double> queryTiles = this->tileQueries(group);
+
+		//map: every chunk is scanned once for all queries of the group
+		runMapTasks(numberOfChunks, [&](std::size_t chunk) {
+			const std::size_t firstPoint = this->numberOfPoints_ * chunk
+					/ numberOfChunks;
+			const std::size_t lastPoint = this->numberOfPoints_ * (chunk + 1)
+					/ numberOfChunks;
+
+			chunkCandidates[chunk].assign(groupQueries,
+					BPQ<PointArrayAccessor> { k });
+			this->scanBlockedBatch(firstPoint, lastPoint, queryTiles,
+					chunkCandidates[chunk]);
+		}, numberOfThreads);
+
+		//reduce: merge the chunk results of every query
+		runMapTasks(groupQueries, [&](std::size_t q) {
+			std::vector<std::vector<Neighbor>> runs(numberOfChunks);
+			std::vector<Neighbor> neighbors;
+
+			for (std::size_t chunk = 0; chunk < numberOfChunks; ++chunk) {
+				BPQ<PointArrayAccessor>& candidates = chunkCandidates[chunk][q];
+				std::vector<Neighbor>& run = runs[chunk];
+
+				//the queue pops the farthest first
+				run.resize(candidates.size());
+				for (std::size_t i = run.size(); i-- > 0;) {
+					run[i] = Neighbor { candidates.topDistance(),
+							candidates.topPoint().getOffset()
+									/ this->dimension_ };
+					candidates.pop();
+				}
+			}
+			mergeNeighbors(k, runs, neighbors);
+
+			std::size_t* rowIds = ids + (firstQuery + q) * k;
+			double* rowDistances = distances + (firstQuery + q) * k;
+			for (std::size_t i = writeNeighbors<Metric>(neighbors, rowIds,
+					rowDistances, finalDistances); i < k; ++i) {
+				rowIds[i] = NO_NEIGHBOR;
+				rowDistances[i] = std::numeric_limits<double>::infinity();
+			}
+		}, numberOfThreads);
+	}
 }
+
+template class BasicNaiveMapReduce<SquaredEuclidean>;
+template class BasicNaiveMapReduce<Manhattan>;
+template class BasicNaiveMapReduce<Chebyshev>;
+template class BasicNaiveMapReduce<Minkowski<1>>;
+template class BasicNaiveMapReduce<Minkowski<2>>;
+template class BasicNaiveMapReduce<Minkowski<3>>;
+template class BasicNaiveMapReduce<Minkowski<4>>;
+template class BasicNaiveMapReduce<Cosine>;
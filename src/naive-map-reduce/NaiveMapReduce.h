@@ -3,53 +3,167 @@
 
 #include "../knn/NaiveKnn.h"
 #include "../knn/BPQ.h"
+#include "../knn/SharedBound.h"
+#include "../grid/Grid.h"
+#include "../util/ThreadPool.h"
 
+#include <memory>
+#include <mutex>
 #include <vector>
 
 enum KNN_STRATEGY {
 	NAIVE, GRID
 };
 
-class NaiveMapReduce: public NaiveKnn {
+/** Multi-threaded exhaustive kNN search, the Metric policy is shared with
+ * BasicNaiveKnn and BasicGrid. NaiveMapReduce is the squared euclidean
+ * instantiation. */
+template<class Metric>
+class BasicNaiveMapReduce: public BasicNaiveKnn<Metric> {
 private:
-	void mapNaive(double* points, PointAccessor* query, unsigned k, std::size_t step,
-			unsigned storeId, std::vector<BPQ<PointArrayAccessor>>& mapResult);
-	void mapGrid(double* points, PointAccessor* query, unsigned k, std::size_t step,
-				unsigned storeId, std::vector<BPQ<PointVectorAccessor>>& mapResult);
-	BPQ<PointArrayAccessor> reduceNaive(
-			std::vector<BPQ<PointArrayAccessor>>& mapResult,
-			PointAccessor* query);
-	BPQ<PointArrayAccessor> reduceGrid(
-				std::vector<BPQ<PointVectorAccessor>>& mapResult,
-				PointAccessor* query, unsigned k);
+	/** Number of map chunks for k, up to MAP_CHUNKS_PER_THREAD per thread
+	 * of the point load. pointsPerChunk is set to the points of all chunks
+	 * but the last one. */
+	unsigned mapChunks(unsigned k, std::size_t& pointsPerChunk) const;
+	/** Number of map tasks for k and the points of each: the partitions
+	 * of the GRID strategy, whose grids are built if necessary, or
+	 * mapChunks for NAIVE. */
+	unsigned mapTasks(unsigned k, std::size_t& pointsPerChunk);
+	/** Points [firstPoint, lastPoint) of the part of the points the given
+	 * pool thread starts on in every map phase. */
+	void threadPart(unsigned thread, std::size_t& firstPoint,
+			std::size_t& lastPoint) const;
+	/** Copies the points into placedPoints_, every part by the pool thread
+	 * that scans it, so that first touch puts it on the thread's node. */
+	void placePoints();
+	/** Builds the partition grids, requires partitionGridsLock_. */
+	void createPartitionGrids(unsigned k);
+	/** Runs body(chunk) for every map chunk on the pool, or on
+	 * numberOfThreads threads (maxThreads_ if 0) started for this call
+	 * unless persistentThreads_ is set. */
+	template<class Body>
+	void runMapTasks(std::size_t numberOfChunks, Body body,
+			unsigned numberOfThreads = 0);
+	/** Map reduce behind both result types of both strategies: every map
+	 * task collects the k closest of its chunk by point id, sorted (see
+	 * collectRange or the partition grids), the reduce merges these runs
+	 * into the k closest, closest first (see mergeNeighbors). NAIVE chunks
+	 * share a pruning bound (see SharedBound). */
+	void mapReduceNeighbors(PointAccessor* query, unsigned k,
+			std::vector<Neighbor>& neighbors);
+	/** Grid map phase of mapReduceNeighbors on a partition starting at
+	 * firstPoint. */
+	void mapGridIds(std::size_t partition, PointAccessor* query, unsigned k,
+			std::size_t firstPoint, std::vector<Neighbor>& neighbors);
+	/** Batch map reduce of the NAIVE strategy for tiled metrics: every map
+	 * task scans its chunk once for a group of queries, keeping a queue per
+	 * query (see scanBlockedBatch), the reduce merges the chunk queues of
+	 * every query. Both phases run like the map tasks of single queries
+	 * (see runMapTasks), numberOfThreads only counts if they do not run on
+	 * the pool. Ignores approximate modes. */
+	void mapReduceBatch(unsigned k, PointContainer& queries,
+			unsigned numberOfThreads, std::size_t* ids, double* distances,
+			bool finalDistances);
 
 	unsigned maxThreads_;
 	unsigned maxThreadLoad_;
 	unsigned singleThreadedThreashold_;
 	KNN_STRATEGY knnStrategy_;
+	/** Map threads, started by the first multi-threaded query. */
+	std::unique_ptr<ThreadPool> pool_;
+	/** Guards the creation and replacement of pool_. */
+	std::mutex poolLock_;
+	bool persistentThreads_;
+	bool numaAware_;
+	/** The points passed to the constructor. */
+	double* sourcePoints_;
+	/** NUMA-placed copy of the points, scanned instead while numaAware_.
+	 * Kept until destruction once placed. */
+	std::unique_ptr<double[]> placedPoints_;
+	/** Grids over the map partitions of the GRID strategy, kept between
+	 * queries. They hold a copy of the points. */
+	std::vector<std::unique_ptr<BasicGrid<Metric>>> partitionGrids_;
+	/** Points of every partition but the last one. */
+	std::size_t pointsPerPartition_;
+	std::mutex partitionGridsLock_;
 
 public:
-	NaiveMapReduce(double * points, std::size_t dimension,
+	BasicNaiveMapReduce(double * points, std::size_t dimension,
 			std::size_t numberOfPoints, unsigned maxThreadNumber =
 					MAX_NUMBER_OF_THREADS, unsigned maxThreadLoad =
 					MAX_THREAD_LOAD, unsigned singleThreadedThreshold =
 					SINGLE_THREADED_THRESHOLD, KNN_STRATEGY knn_strategy =
 					KNN_STRATEGY::NAIVE) :
-			NaiveKnn(points, dimension, numberOfPoints), maxThreads_(
+			BasicNaiveKnn<Metric>(points, dimension, numberOfPoints), maxThreads_(
 					maxThreadNumber), maxThreadLoad_(maxThreadLoad), singleThreadedThreashold_(
-					singleThreadedThreshold), knnStrategy_(knn_strategy) {
+					singleThreadedThreshold), knnStrategy_(knn_strategy), persistentThreads_(
+					true), numaAware_(false), sourcePoints_(points), pointsPerPartition_(
+					0) {
 
 	}
 
-	virtual ~NaiveMapReduce() {
+	virtual ~BasicNaiveMapReduce() {
 	}
 
 	static const unsigned MAX_NUMBER_OF_THREADS = 20;
 	static const unsigned MAX_THREAD_LOAD = 200000; 	//200 k
 	static const unsigned SINGLE_THREADED_THRESHOLD = 1000000; //1 Mio.
+	/** Map chunks per thread, finer chunks keep all threads busy if some
+	 * of them are slowed down. */
+	static const unsigned MAP_CHUNKS_PER_THREAD = 4;
+	/** Minimum points of a map chunk per neighbor, so that the k
+	 * candidates of each chunk stay cheap to reduce. */
+	static const unsigned MIN_CHUNK_POINTS_PER_K = 64;
+	/** Candidates held by the map tasks of a batch at once, larger batches
+	 * are map-reduced in groups of queries. */
+	static const std::size_t BATCH_CANDIDATES_MAX = 1 << 20;
 
 	virtual BPQ<PointArrayAccessor> kNearestNeighbors(unsigned k,
 			PointAccessor* query) override;
+	virtual std::size_t kNearestNeighborIds(unsigned k, PointAccessor* query,
+			std::size_t* ids, double* distances, bool finalDistances = false)
+					override;
+	/** NAIVE batches of tiled metrics (see mapReduceBatch) split the points
+	 * among the map threads, each scanning its points once per group of
+	 * queries instead of once per query. Otherwise, with at least
+	 * as many queries as threads, the threads share the queries, each
+	 * answered by the single-threaded scan of BasicNaiveKnn. */
+	virtual void kNearestNeighborIdsBatch(unsigned k, PointContainer& queries,
+			unsigned numberOfThreads, std::size_t* ids, double* distances,
+			bool finalDistances = false) override;
+
+	/** The maxThreadNumber threads running the map tasks, started on first
+	 * use and kept until destruction. They can be shared, e.g. with
+	 * BasicGrid and RandomPointGenerator. */
+	ThreadPool& threadPool();
+	/** Whether map tasks run on threadPool() (default) or on threads
+	 * started per query. */
+	void setPersistentThreads(bool persistentThreads);
+	/** NUMA-aware scans: replaces threadPool() by one pinned to CPUs (see
+	 * CpuTopology) and copies the points such that the part of every
+	 * thread lies on its node, results then refer to the copy. The copy
+	 * stays valid until destruction, also when switched off again, and is
+	 * refilled when switched on again. Map tasks run on the pool regardless
+	 * of setPersistentThreads, and partition grids are rebuilt by the
+	 * pinned threads. On a single node this only pins the threads. Does
+	 * nothing if the mode does not change. Must not run concurrently with
+	 * queries. */
+	void setNumaAware(bool numaAware);
+	/** Reads the scanned points once on every thread of threadPool(), each
+	 * its own part, and returns the read bandwidth in bytes per second per
+	 * NUMA node (see CpuTopology), 0 for nodes without threads. Floating
+	 * threads count for node 0. */
+	std::vector<double> nodeBandwidth();
+	/** Builds the partition grids of the GRID strategy in parallel, with
+	 * cells sized for k. Otherwise the first GRID query builds them for its
+	 * k, later queries reuse them for any k. */
+	void buildPartitionGrids(unsigned k);
+	/** Drops the partition grids, e.g. after the indexed points changed.
+	 * The next GRID query rebuilds them. Must not run concurrently with
+	 * queries. */
+	void invalidatePartitionGrids();
 };
 
+typedef BasicNaiveMapReduce<SquaredEuclidean> NaiveMapReduce;
+
 #endif
@@ -0,0 +1,145 @@
+#include "Affinity.h"
+
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+/** Parses sysfs lists like "0-3,8,10-11". */
+std::vector<unsigned> parseList(const std::string& list) {
+	std::vector<unsigned> values;
+	std::istringstream in(list);
+	std::string range;
+
+	while (std::getline(in, range, ',')) {
+		std::istringstream bounds(range);
+		unsigned first;
+		unsigned last;
+		if (!(bounds >> first)) {
+			continue;
+		}
+		last = first;
+		if (bounds.get() == '-') {
+			bounds >> last;
+		}
+		for (unsigned value = first; value <= last; ++value) {
+			values.push_back(value);
+		}
+	}
+
+	return values;
+}
+
+std::string readLine(const std::string& fileName) {
+	std::ifstream in(fileName);
+	std::string line;
+	std::getline(in, line);
+	return line;
+}
+
+std::vector<unsigned> allowedCpus() {
+	std::vector<unsigned> cpus;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+		for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &set)) {
+				cpus.push_back(cpu);
+			}
+		}
+	}
+#endif
+	if (cpus.empty()) {
+		const unsigned hardwareThreads = std::thread::hardware_concurrency();
+		for (unsigned cpu = 0; cpu < hardwareThreads || cpu == 0; ++cpu) {
+			cpus.push_back(cpu);
+		}
+	}
+	return cpus;
+}
+
+CpuTopology readTopology() {
+	const std::vector<unsigned> allowed = allowedCpus();
+	std::vector<std::vector<unsigned>> nodeCpus;
+
+	for (unsigned node : parseList(
+			readLine("/sys/devices/system/node/online"))) {
+		const std::vector<unsigned> cpus = parseList(
+				readLine(
+						"/sys/devices/system/node/node" + std::to_string(node)
+								+ "/cpulist"));
+		if (nodeCpus.size() <= node) {
+			nodeCpus.resize(node + 1);
+		}
+		for (unsigned cpu : cpus) {
+			for (unsigned allowedCpu : allowed) {
+				if (cpu == allowedCpu) {
+					nodeCpus[node].push_back(cpu);
+				}
+			}
+		}
+	}
+
+	std::size_t assigned = 0;
+	for (const std::vector<unsigned>& cpus : nodeCpus) {
+		assigned += cpus.size();
+	}
+	if (assigned != allowed.size()) {
+		//no or partial NUMA information, a single node
+		nodeCpus.assign(1, allowed);
+	}
+
+	CpuTopology topology;
+	topology.numberOfNodes = nodeCpus.size();
+	for (std::size_t i = 0; topology.cpus.size() < allowed.size(); ++i) {
+		for (unsigned node = 0; node < nodeCpus.size(); ++node) {
+			if (i < nodeCpus[node].size()) {
+				topology.cpus.push_back(nodeCpus[node][i]);
+				topology.nodes.push_back(node);
+			}
+		}
+	}
+
+	return topology;
+}
+
+}
+
+unsigned CpuTopology::nodeOf(unsigned cpu) const {
+	for (std::size_t i = 0; i < cpus.size(); ++i) {
+		if (cpus[i] == cpu) {
+			return nodes[i];
+		}
+	}
+	return 0;
+}
+
+const CpuTopology& CpuTopology::local() {
+	static const CpuTopology topology = readTopology();
+	return topology;
+}
+
+bool pinThread(std::thread& thread, unsigned cpu) {
+#ifdef __linux__
+	if (cpu >= CPU_SETSIZE) {
+		return false;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set)
+			== 0;
+#else
+	(void) thread;
+	(void) cpu;
+	return false;
+#endif
+}
@@ -0,0 +1,29 @@
+#ifndef UTIL_AFFINITY_H_
+#define UTIL_AFFINITY_H_
+
+#include <thread>
+#include <vector>
+
+/** CPUs the process may run on and their NUMA nodes, read from sysfs on
+ * Linux. Without NUMA information all CPUs are on node 0. */
+struct CpuTopology {
+	/** Allowed CPUs, taking turns between the nodes, so that threads
+	 * pinned along this order spread over all nodes. */
+	std::vector<unsigned> cpus;
+	/** Node of cpus[i]. */
+	std::vector<unsigned> nodes;
+	/** Highest node number plus one. */
+	unsigned numberOfNodes;
+
+	/** Node of cpu, 0 for CPUs not in cpus. */
+	unsigned nodeOf(unsigned cpu) const;
+
+	/** Topology of the process, read on first use. */
+	static const CpuTopology& local();
+};
+
+/** Pins thread to cpu with pthread_setaffinity_np. Returns false where
+ * this is not supported or not allowed, the thread then keeps floating. */
+bool pinThread(std::thread& thread, unsigned cpu);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef UTIL_CACHEMISSCOUNTER_H_
+#define UTIL_CACHEMISSCOUNTER_H_
+
+#include <cstdint>
+
+/** Counts the last level cache misses of the calling thread and of the
+ * threads it starts afterwards, with a perf_event hardware counter on
+ * Linux. Where perf events are not supported or not permitted (see
+ * /proc/sys/kernel/perf_event_paranoid), available() is false and stop()
+ * returns 0. */
+class CacheMissCounter {
+private:
+	int fd_;
+
+public:
+	CacheMissCounter();
+	~CacheMissCounter();
+
+	CacheMissCounter(const CacheMissCounter&) = delete;
+	CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+	bool available() const;
+	/** Resets the count and starts counting. */
+	void start();
+	/** Stops counting and returns the misses since start(). */
+	std::uint64_t stop();
+};
+
+#endif
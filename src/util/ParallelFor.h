@@ -0,0 +1,146 @@
+#ifndef UTIL_PARALLELFOR_H_
+#define UTIL_PARALLELFOR_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Range of loop indices owned by one worker of parallelFor. The owner
+ * takes indices from the front, thieves split off the back half. */
+struct WorkRange {
+	std::mutex lock;
+	/** Changed under lock only, atomic for the unlocked peek of thieves. */
+	std::atomic<std::size_t> begin;
+	std::atomic<std::size_t> end;
+};
+
+/** Takes the next index of the worker's own range, false if it is
+ * empty. */
+inline bool takeOwnWork(WorkRange& own, std::size_t& index) {
+	std::lock_guard<std::mutex> guard(own.lock);
+	if (own.begin == own.end) {
+		return false;
+	}
+	index = own.begin++;
+	return true;
+}
+
+/** Moves the back half of the largest other range into the worker's own
+ * range, false if no work is left anywhere. */
+inline bool stealWork(std::vector<WorkRange>& ranges, unsigned worker) {
+	while (true) {
+		unsigned victim = worker;
+		std::size_t largest = 0;
+		for (unsigned other = 0; other < ranges.size(); ++other) {
+			//unlocked peek, the split below re-checks under the lock
+			std::size_t begin = ranges[other].begin;
+			std::size_t end = ranges[other].end;
+			std::size_t remaining = begin < end ? end - begin : 0;
+			if (other != worker && remaining > largest) {
+				largest = remaining;
+				victim = other;
+			}
+		}
+		if (victim == worker) {
+			return false;
+		}
+
+		std::size_t begin;
+		std::size_t end;
+		{
+			std::lock_guard<std::mutex> guard(ranges[victim].lock);
+			end = ranges[victim].end;
+			if (ranges[victim].begin == end) {
+				continue;
+			}
+			begin = end - (end - ranges[victim].begin + 1) / 2;
+			ranges[victim].end = begin;
+		}
+
+		std::lock_guard<std::mutex> guard(ranges[worker].lock);
+		ranges[worker].begin = begin;
+		ranges[worker].end = end;
+		return true;
+	}
+}
+
+/** Hands [0, count) to the first participants ranges in contiguous
+ * parts, the other ranges are left empty. */
+inline void splitWork(std::vector<WorkRange>& ranges, std::size_t count,
+		unsigned participants) {
+	for (unsigned worker = 0; worker < ranges.size(); ++worker) {
+		const unsigned part = worker < participants ? worker : participants;
+		ranges[worker].begin = count * part / participants;
+		ranges[worker].end =
+				worker < participants ?
+						count * (part + 1) / participants : count;
+	}
+}
+
+/** Loop of one parallelFor worker: its own range, then stolen ones. */
+template<class Body>
+void workOn(std::vector<WorkRange>& ranges, unsigned worker, Body& body) {
+	std::size_t index;
+	do {
+		while (takeOwnWork(ranges[worker], index)) {
+			body(index);
+		}
+	} while (stealWork(ranges, worker));
+}
+
+/** Calls body(i) for every i in [0, count) on up to numberOfThreads
+ * threads, the calling thread being one of them. Every thread starts on
+ * a contiguous range of indices and, once it is done, steals half of the
+ * largest remaining range, so iterations of uneven cost (e.g. grid
+ * queries in dense and sparse regions) stay balanced. The first exception
+ * thrown by body is rethrown after all threads have finished. The threads
+ * are started per call, see ThreadPool for long-lived ones. */
+template<class Body>
+void parallelFor(std::size_t count, unsigned numberOfThreads, Body body) {
+	assert(numberOfThreads > 0);
+
+	if (numberOfThreads > count) {
+		numberOfThreads = count;
+	}
+	if (numberOfThreads <= 1) {
+		for (std::size_t i = 0; i < count; ++i) {
+			body(i);
+		}
+		return;
+	}
+
+	std::vector<WorkRange> ranges(numberOfThreads);
+	splitWork(ranges, count, numberOfThreads);
+
+	std::mutex errorLock;
+	std::exception_ptr error;
+	auto work = [&](unsigned worker) {
+		try {
+			workOn(ranges, worker, body);
+		} catch (...) {
+			std::lock_guard<std::mutex> guard(errorLock);
+			if (!error) {
+				error = std::current_exception();
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned worker = 1; worker < numberOfThreads; ++worker) {
+		workers.push_back(std::thread(work, worker));
+	}
+	work(0);
+	for (std::thread& thread : workers) {
+		thread.join();
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+#endif
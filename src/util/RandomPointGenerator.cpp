@@ -3,7 +3,6 @@
 
 #include <cassert>
 #include <stdexcept>
-#include <thread>
 
 void RandomPointGenerator::initUniform(MBR& m, std::size_t dimension) {
 	uniform_.reserve(dimension);
@@ -87,33 +86,22 @@ PointContainer RandomPointGenerator::generatePoints(std::size_t numberOfPoints,
 		if (numberOfGeneratorThreads_ == 1) {
 			genUniformPts(randPoints, numberOfPoints, dimension, mbr);
 		} else {
-			std::vector<std::thread> mapThreads;
-
 			std::size_t step = numberOfPoints / numberOfGeneratorThreads_;
 			std::size_t lastFullStepOffset = (numberOfGeneratorThreads_ - 1)
 					* step;
 			std::size_t endStep = numberOfPoints - lastFullStepOffset;
 
-			for (unsigned threadId = 0;
-					threadId < numberOfGeneratorThreads_ - 1; ++threadId) {
-				mapThreads.push_back(
-						std::thread(&RandomPointGenerator::genUniformPts, this,
-								std::ref(randPoints), step, dimension,
-								std::ref(mbr), step * dimension * threadId));
+			auto genChunk = [&](std::size_t chunk) {
+				genUniformPts(randPoints,
+						chunk + 1 == numberOfGeneratorThreads_ ? endStep : step,
+						dimension, mbr, step * dimension * chunk);
+			};
+			if (threadPool_) {
+				threadPool_->parallelFor(numberOfGeneratorThreads_, genChunk);
+			} else {
+				parallelFor(numberOfGeneratorThreads_,
+						numberOfGeneratorThreads_, genChunk);
 			}
-
-			mapThreads.push_back(
-					std::thread(&RandomPointGenerator::genUniformPts, this,
-							std::ref(randPoints), endStep, dimension,
-							std::ref(mbr),
-							step * dimension
-									* (numberOfGeneratorThreads_ - 1)));
-
-			for (unsigned threadId = 0; threadId < numberOfGeneratorThreads_;
-					++threadId) {
-				mapThreads[threadId].join();
-			}
-
 		}
 		break;
 	default:
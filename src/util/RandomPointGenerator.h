@@ -2,6 +2,7 @@
 #define UTIL_RANDOMPOINTGENERATOR_H_
 
 #include "../model/MBR.h"
+#include "ThreadPool.h"
 
 #include <random>
 #include <vector>
@@ -15,6 +16,7 @@ private:
 
 	bool checkMBR_;
 	std::size_t numberOfGeneratorThreads_ = 1;
+	ThreadPool* threadPool_ = nullptr;
 	void initUniform(MBR& m, std::size_t dimension);
 	void initGauss(double mean, double stddev);
 	void initGaussCluster(std::size_t dimension, double stddev);
@@ -59,6 +61,11 @@ public:
 	std::size_t getNumberOfGeneratorThreads() {
 		return numberOfGeneratorThreads_;
 	}
+	/** Runs the generator threads on pool instead of starting them per
+	 * call, nullptr to start them again. */
+	void setThreadPool(ThreadPool* pool) {
+		threadPool_ = pool;
+	}
 };
 
 #endif
@@ -0,0 +1,145 @@
+#include "ThreadPool.h"
+#include "Affinity.h"
+
+#include <cassert>
+
+namespace {
+/** Pool whose loop the current thread is working on. */
+thread_local const ThreadPool* activePool = nullptr;
+}
+
+ThreadPool::ThreadPool(unsigned numberOfThreads, bool pinned) :
+		ranges_(numberOfThreads), firstWorker_(pinned ? 0 : 1), steal_(true), body_(
+				nullptr), generation_(0), pendingWorkers_(0), stop_(false) {
+	assert(numberOfThreads > 0);
+
+	const std::vector<unsigned>& cpus = CpuTopology::local().cpus;
+	if (pinned) {
+		cpus_.assign(numberOfThreads, -1);
+	}
+	for (unsigned worker = firstWorker_; worker < numberOfThreads; ++worker) {
+		workers_.push_back(std::thread(&ThreadPool::workerLoop, this, worker));
+		if (pinned) {
+			const unsigned cpu = cpus[worker % cpus.size()];
+			cpus_[worker] = pinThread(workers_.back(), cpu) ? cpu : -1;
+		}
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+
+	for (std::thread& worker : workers_) {
+		worker.join();
+	}
+}
+
+unsigned ThreadPool::size() const {
+	return ranges_.size();
+}
+
+int ThreadPool::cpu(unsigned thread) const {
+	return thread < cpus_.size() ? cpus_[thread] : -1;
+}
+
+bool ThreadPool::isRunningHere() const {
+	return activePool == this;
+}
+
+void ThreadPool::forEachThread(const std::function<void(unsigned)>& body) {
+	std::function<void(std::size_t)> each = [&](std::size_t thread) {
+		body(static_cast<unsigned>(thread));
+	};
+
+	if (workers_.empty() || isRunningHere()) {
+		for (unsigned thread = 0; thread < size(); ++thread) {
+			each(thread);
+		}
+		return;
+	}
+
+	run(size(), each, false);
+}
+
+void ThreadPool::run(std::size_t count,
+		const std::function<void(std::size_t)>& body, bool steal) {
+	std::lock_guard<std::mutex> job(jobLock_);
+	const unsigned participants = count < size() ? count : size();
+	splitWork(ranges_, count, participants);
+	steal_ = steal;
+
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		body_ = &body;
+		error_ = nullptr;
+		pendingWorkers_ = workers_.size();
+		++generation_;
+	}
+	wake_.notify_all();
+
+	if (firstWorker_ > 0) {
+		const ThreadPool* outerPool = activePool;
+		activePool = this;
+		work(0);
+		activePool = outerPool;
+	}
+
+	std::unique_lock<std::mutex> guard(lock_);
+	done_.wait(guard, [this]() {
+		return pendingWorkers_ == 0;
+	});
+	body_ = nullptr;
+
+	if (error_) {
+		std::exception_ptr error = error_;
+		error_ = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void ThreadPool::workerLoop(unsigned worker) {
+	activePool = this;
+	std::size_t seenGeneration = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> guard(lock_);
+			wake_.wait(guard, [&]() {
+				return stop_ || generation_ != seenGeneration;
+			});
+			if (stop_) {
+				return;
+			}
+			seenGeneration = generation_;
+		}
+
+		work(worker);
+
+		std::lock_guard<std::mutex> guard(lock_);
+		if (--pendingWorkers_ == 0) {
+			done_.notify_one();
+		}
+	}
+}
+
+void ThreadPool::work(unsigned worker) {
+	try {
+		if (steal_) {
+			workOn(ranges_, worker, *body_);
+		} else {
+			std::size_t index;
+			while (takeOwnWork(ranges_[worker], index)) {
+				(*body_)(index);
+			}
+		}
+	} catch (...) {
+		std::lock_guard<std::mutex> guard(lock_);
+		if (!error_) {
+			error_ = std::current_exception();
+		}
+	}
+}
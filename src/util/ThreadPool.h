@@ -0,0 +1,94 @@
+#ifndef UTIL_THREADPOOL_H_
+#define UTIL_THREADPOOL_H_
+
+#include "ParallelFor.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Long-lived threads for parallelFor loops, so that short loops (e.g. the
+ * map phase of a single query) do not pay for starting and joining
+ * threads. Every thread owns a range of loop indices and steals from the
+ * others when it runs dry, as in ::parallelFor. Threads can be pinned to
+ * CPUs, so that data placed by thread t (see forEachThread) stays on the
+ * NUMA node of the thread that starts on the same part of later loops. */
+class ThreadPool {
+private:
+	std::vector<std::thread> workers_;
+	/** One range per thread, the caller of parallelFor works on the
+	 * first. */
+	std::vector<WorkRange> ranges_;
+	/** CPU of the thread working on each range, empty unless pinned. */
+	std::vector<int> cpus_;
+	/** Range of the first started thread, 0 if the caller of a loop does
+	 * not take part, as in pinned pools. */
+	unsigned firstWorker_;
+	/** Whether idle threads of the current loop steal. */
+	bool steal_;
+	/** Serializes parallelFor calls of different threads. */
+	std::mutex jobLock_;
+	/** Guards the fields below, which hand a loop to the workers. */
+	std::mutex lock_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+	const std::function<void(std::size_t)>* body_;
+	std::size_t generation_;
+	unsigned pendingWorkers_;
+	bool stop_;
+	std::exception_ptr error_;
+
+	void run(std::size_t count, const std::function<void(std::size_t)>& body,
+			bool steal);
+	void workerLoop(unsigned worker);
+	void work(unsigned worker);
+	/** Whether the calling thread is running a loop of this pool. */
+	bool isRunningHere() const;
+
+public:
+	/** Pool of numberOfThreads threads including the caller of
+	 * parallelFor, i.e. numberOfThreads - 1 workers are started. A pinned
+	 * pool starts numberOfThreads workers pinned along CpuTopology::cpus
+	 * instead, the caller only waits for them. Where pinning fails, the
+	 * workers float. */
+	explicit ThreadPool(unsigned numberOfThreads, bool pinned = false);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/** Number of threads working on a loop, including the caller. */
+	unsigned size() const;
+	/** CPU the thread starting on the given part of a loop is pinned to,
+	 * -1 if it floats. */
+	int cpu(unsigned thread) const;
+
+	/** Calls body(i) for every i in [0, count) on the pool, see
+	 * ::parallelFor. Calls from different threads run one after the other,
+	 * calls from inside a loop of the same pool run sequentially on the
+	 * calling thread. */
+	template<class Body>
+	void parallelFor(std::size_t count, Body body);
+	/** Calls body(thread) once on every thread, without stealing. Thread t
+	 * is the one that starts on the t-th of size() contiguous parts of the
+	 * indices of parallelFor. */
+	void forEachThread(const std::function<void(unsigned)>& body);
+};
+
+template<class Body>
+void ThreadPool::parallelFor(std::size_t count, Body body) {
+	if (count <= 1 || workers_.empty() || isRunningHere()) {
+		for (std::size_t i = 0; i < count; ++i) {
+			body(i);
+		}
+		return;
+	}
+
+	run(count, std::function<void(std::size_t)>(body), true);
+}
+
+#endif
@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+#include "grid/CellOrder.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+class CellOrderTest: public ::testing::Test {
+protected:
+	/** Row-major coordinates of a cell, the first dimension varies
+	 * fastest. */
+	static std::vector<std::size_t> coordinatesOf(std::size_t cell,
+			const std::vector<std::size_t>& cellsPerDimension) {
+		std::vector<std::size_t> coordinates;
+		for (std::size_t cells : cellsPerDimension) {
+			coordinates.push_back(cell % cells);
+			cell /= cells;
+		}
+		return coordinates;
+	}
+
+	static void expectPermutation(const std::vector<unsigned>& ranks) {
+		std::vector<unsigned> sorted(ranks);
+		std::sort(sorted.begin(), sorted.end());
+		for (std::size_t i = 0; i < sorted.size(); ++i) {
+			ASSERT_EQ(i, sorted[i]);
+		}
+	}
+};
+
+TEST_F(CellOrderTest, row_major_order_is_the_identity) {
+	EXPECT_TRUE(cellRanks(ROW_MAJOR, { 4, 5, 6 }).empty());
+}
+
+TEST_F(CellOrderTest, morton_order_interleaves_the_coordinate_bits) {
+	//2 x 2 cells: (0,0) (1,0) (0,1) (1,1) in row-major order, the Z
+	//visits (0,0) (0,1) (1,0) (1,1)
+	std::vector<unsigned> ranks = cellRanks(MORTON, { 2, 2 });
+	std::vector<unsigned> expected = { 0, 2, 1, 3 };
+	EXPECT_EQ(expected, ranks);
+
+	expectPermutation(cellRanks(MORTON, { 5, 3, 7 }));
+}
+
+TEST_F(CellOrderTest, consecutive_hilbert_cells_share_a_face) {
+	const std::vector<std::size_t> cellsPerDimension = { 8, 8, 8 };
+	std::vector<unsigned> ranks = cellRanks(HILBERT, cellsPerDimension);
+	expectPermutation(ranks);
+
+	std::vector<std::size_t> cellAt(ranks.size());
+	for (std::size_t cell = 0; cell < ranks.size(); ++cell) {
+		cellAt[ranks[cell]] = cell;
+	}
+	for (std::size_t rank = 1; rank < cellAt.size(); ++rank) {
+		std::vector<std::size_t> previous = coordinatesOf(cellAt[rank - 1],
+				cellsPerDimension);
+		std::vector<std::size_t> current = coordinatesOf(cellAt[rank],
+				cellsPerDimension);
+		std::size_t steps = 0;
+		for (std::size_t d = 0; d < current.size(); ++d) {
+			steps += std::labs(static_cast<long>(current[d])
+					- static_cast<long>(previous[d]));
+		}
+		ASSERT_EQ(1u, steps);
+	}
+
+	//uneven grids keep the order of the enclosing power of two grid
+	expectPermutation(cellRanks(HILBERT, { 5, 3, 7 }));
+}
+
+TEST_F(CellOrderTest, keys_beyond_64_bits_are_rejected) {
+	std::vector<std::size_t> cellsPerDimension(33, 4);
+	EXPECT_THROW(cellRanks(MORTON, cellsPerDimension), std::invalid_argument);
+	EXPECT_THROW(cellRanks(HILBERT, cellsPerDimension), std::invalid_argument);
+}
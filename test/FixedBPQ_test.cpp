@@ -0,0 +1,76 @@
+#include "gtest/gtest.h"
+#include "knn/BPQ.h"
+#include "knn/FixedBPQ.h"
+#include "model/PointArrayAccessor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+class FixedBPQTest: public ::testing::Test {
+protected:
+	static const unsigned NUMBER_OF_CANDIDATES = 20000;
+	static const unsigned SEED = 12345;
+
+	std::vector<double> distances_;
+
+	virtual void SetUp() {
+		std::default_random_engine engine(SEED);
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		distances_.resize(NUMBER_OF_CANDIDATES);
+		for (auto& d : distances_) {
+			d = uniform(engine);
+		}
+	}
+};
+
+TEST_F(FixedBPQTest, keeps_the_k_smallest_distances_in_descending_pop_order) {
+	std::vector<double> sorted(distances_);
+	std::sort(sorted.begin(), sorted.end());
+	FixedBPQ<std::uint32_t> queue(1);
+
+	for (std::size_t k : { 1, 2, 3, 4, 5, 17, 100, 5000 }) {
+		queue.reset(k);
+		for (std::size_t i = 0; i < distances_.size(); ++i) {
+			if (distances_[i] < queue.max_dist()) {
+				queue.push(i, distances_[i]);
+			}
+		}
+
+		ASSERT_EQ(k, queue.size());
+		ASSERT_EQ(sorted[k - 1], queue.max_dist());
+		for (std::size_t rank = k; rank > 0; --rank) {
+			ASSERT_EQ(sorted[rank - 1], queue.topDistance());
+			ASSERT_EQ(sorted[rank - 1], distances_[queue.topIndex()]);
+			queue.pop();
+		}
+		ASSERT_TRUE(queue.empty());
+	}
+}
+
+TEST_F(FixedBPQTest, matches_BPQ_and_is_reusable) {
+	double dummyPoint[1] = { 0.0 };
+	FixedBPQ<std::uint64_t> queue(10);
+
+	for (int run = 0; run < 2; ++run) {
+		BPQ<PointArrayAccessor> expected(10);
+		queue.reset();
+		for (std::size_t i = 0; i < distances_.size(); ++i) {
+			if (distances_[i] < expected.max_dist()) {
+				expected.push(PointArrayAccessor { dummyPoint, 0, 1 },
+						distances_[i]);
+			}
+			if (distances_[i] < queue.max_dist()) {
+				queue.push(i, distances_[i]);
+			}
+		}
+
+		ASSERT_EQ(expected.size(), queue.size());
+		while (!expected.empty()) {
+			ASSERT_EQ(expected.topDistance(), queue.topDistance());
+			expected.pop();
+			queue.pop();
+		}
+	}
+}
@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include "grid/Grid.h"
+#include "grid/GridD.h"
 #include "knn/BPQ.h"
 #include "knn/Metrics.h"
 #include "model/PointArrayAccessor.h"
@@ -10,6 +11,9 @@
 #include <array>
 #include <cmath>
 #include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <typeinfo>
 #include <utility>
 #include <vector>
 
@@ -144,7 +148,7 @@ TEST_F(GridTest, A_Grid_computes_cell_numbers_for_coordinates_correctly) {
 
 TEST_F(GridTest, A_Grid_throws_expections_if_points_outside_of_the_grid_are_inserted) {
 	double point_outside_of_grid[] = { -1.0, -2.0, -3.0 };
-	EXPECT_THROW(g1_->insert(point_outside_of_grid, false), std::runtime_error);
+	EXPECT_THROW(g1_->insertPoint(point_outside_of_grid), std::runtime_error);
 }
 
 class GridKnnTest: public ::testing::Test {
@@ -229,6 +233,56 @@ TEST_F(GridInsertTest, Grid_handles_parallel_inserts_properly) {
 	EXPECT_EQ(kNN_test_grid_->numberOfPoints_, NUMBER_OF_TEST_POINTS);
 }
 
+TEST_F(GridInsertTest, pooled_parallel_insert_keeps_point_ids) {
+	ThreadPool pool(4);
+	const unsigned threadLoad = NUMBER_OF_TEST_POINTS * DIMENSION / 8;
+	Grid grid(DIMENSION, points_.data(), NUMBER_OF_TEST_POINTS * DIMENSION,
+			Grid::CELL_FILL_OPTIMUM_DEFAULT,
+			Grid::MAX_NUMBER_OF_THREADS_DEFAULT, threadLoad, &pool);
+
+	std::size_t sumOfPointsInCells = 0;
+	for (std::size_t cell = 0; cell < grid.grid_.size(); ++cell) {
+		PointContainer& pc = grid.grid_[cell];
+		ASSERT_EQ(pc.size(), grid.cellIds_[cell].size());
+
+		for (std::size_t p_idx = 0; p_idx < pc.size(); ++p_idx) {
+			const double* inserted =
+					&points_.data()[grid.cellIds_[cell][p_idx] * DIMENSION];
+			for (std::size_t d = 0; d < DIMENSION; ++d) {
+				ASSERT_EQ(inserted[d], pc.data()[p_idx * DIMENSION + d]);
+			}
+		}
+		sumOfPointsInCells += pc.size();
+	}
+	EXPECT_EQ(static_cast<std::size_t>(NUMBER_OF_TEST_POINTS),
+			sumOfPointsInCells);
+}
+
+TEST_F(GridInsertTest, parallel_insert_orders_cells_like_a_sequential_one) {
+	Grid sequential(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION, Grid::CELL_FILL_OPTIMUM_DEFAULT,
+			1, std::numeric_limits<unsigned>::max());
+
+	ASSERT_EQ(sequential.cellIds_.size(), kNN_test_grid_->cellIds_.size());
+	for (std::size_t cell = 0; cell < sequential.cellIds_.size(); ++cell) {
+		ASSERT_EQ(sequential.cellIds_[cell], kNN_test_grid_->cellIds_[cell]);
+	}
+}
+
+TEST_F(GridKnnTest, parallel_insert_into_small_cells_orders_cells_like_a_sequential_one) {
+	//about as many cells as points leave few chunks to count them
+	Grid sequential(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION, 1, 1,
+			std::numeric_limits<unsigned>::max());
+	Grid parallel(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION, 1, 8, DIMENSION);
+
+	ASSERT_EQ(sequential.cellIds_.size(), parallel.cellIds_.size());
+	for (std::size_t cell = 0; cell < sequential.cellIds_.size(); ++cell) {
+		ASSERT_EQ(sequential.cellIds_[cell], parallel.cellIds_[cell]);
+	}
+}
+
 ///////////////////////////////////
 /////////// kNN Tests /////////////
 ///////////////////////////////////
@@ -330,6 +384,27 @@ TEST_F(GridKnnTest, getHyperSquareEnvironment_returns_all_cells_eventually) {
 	EXPECT_EQ(sum_of_points, kNN_test_grid_->numberOfPoints_);
 }
 
+TEST_F(GridKnnTest, ring_table_enumerates_the_bounded_rings) {
+	Grid& grid = *kNN_test_grid_;
+	ASSERT_GT(grid.ringStarts_.size(), 2u);
+	std::vector<unsigned> cartesian;
+	std::vector<unsigned> expected;
+	std::vector<unsigned> actual;
+
+	for (unsigned cell = 0; cell < grid.numberOfCells(); cell += 7) {
+		grid.getCartesian(cell, cartesian);
+		for (int ring = 0; ring + 1 < static_cast<int>(grid.ringStarts_.size());
+				++ring) {
+			expected.clear();
+			grid.boundedRingCells(ring, cell, cartesian, expected);
+			grid.ringCells(ring, cell, cartesian, actual);
+
+			std::sort(actual.begin(), actual.end());
+			ASSERT_EQ(expected, actual);
+		}
+	}
+}
+
 TEST_F(GridKnnTest, kNN_radius_of_valid_points_is_enlarged_correctly) {
 	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
 	PointArrayAccessor query(queryCoords, 0, DIMENSION);
@@ -354,6 +429,20 @@ TEST_F(GridKnnTest, kNN_lookup_ends_with_k_results) {
 	EXPECT_EQ(static_cast<std::size_t>(MAX_K), result.size());
 }
 
+TEST_F(GridKnnTest, kNN_lookup_for_k_0_finds_nothing) {
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+	Grid quantized(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION);
+	quantized.setQuantization(true, INT16);
+
+	for (Grid* grid : { kNN_test_grid_, &quantized }) {
+		EXPECT_TRUE(grid->kNearestNeighbors(0, &query).empty());
+		EXPECT_EQ(0u, grid->kNearestNeighborIds(0, &query, nullptr,
+				nullptr));
+	}
+}
+
 TEST_F(GridKnnTest, grid_produces_same_results_as_naive_approach) {
 	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
 
@@ -422,3 +511,334 @@ TEST_F(GridKnnTest, grid_produces_same_results_as_naive_approach) {
 	}
 	error_abort: ;
 }
+
+TEST_F(GridKnnTest, factory_creates_dimension_specialized_grid) {
+	Grid* grid = Grid::create(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION, 1024);
+
+	EXPECT_TRUE(typeid(*grid) == typeid(GridD<DIMENSION>));
+	EXPECT_EQ(grid->cellsPerDimension_, kNN_test_grid_->cellsPerDimension_);
+
+	delete (grid);
+}
+
+TEST_F(GridKnnTest, dimension_specialized_grid_produces_same_results) {
+	GridD<DIMENSION> gridD(points_.data(), NUMBER_OF_TEST_POINTS * DIMENSION,
+			1024);
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+
+	for (unsigned current_k : { 1u, 10u, 100u, 1000u, MAX_K }) {
+		for (unsigned queryNumber = 0; queryNumber < NUMBER_OF_QUERIES;
+				++queryNumber) {
+			auto query = queries[queryNumber];
+			double* coords = query.getData() + query.getOffset();
+
+			EXPECT_EQ(kNN_test_grid_->cellNumber(coords),
+					gridD.cellNumberOf<DIMENSION>(coords));
+
+			auto expected = kNN_test_grid_->kNearestNeighbors(current_k,
+					&query);
+			auto actual = gridD.kNearestNeighbors(current_k, &query);
+
+			ASSERT_EQ(expected.size(), actual.size());
+			while (!(expected.empty())) {
+				ASSERT_DOUBLE_EQ(expected.topDistance(), actual.topDistance());
+				expected.pop();
+				actual.pop();
+			}
+		}
+	}
+}
+
+/** Compares grid and naive scan results of a metric policy. */
+template<class Metric>
+void expectGridMatchesNaive(PointContainer& points, PointContainer& queries,
+		std::size_t dimension, std::size_t cellFillOptimum,
+		GRID_TRAVERSAL traversal = RING) {
+	const std::size_t numberOfPoints = points.size();
+	BasicNaiveKnn<Metric> naive(points.data(), dimension, numberOfPoints);
+	BasicGrid<Metric> grid(dimension, points.data(), numberOfPoints * dimension,
+			cellFillOptimum);
+	grid.setTraversal(traversal);
+
+	for (unsigned k : { 1u, 10u, 100u }) {
+		for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+			auto query = queries[q_idx];
+			auto expected = naive.kNearestNeighbors(k, &query);
+			auto actual = grid.kNearestNeighbors(k, &query);
+
+			ASSERT_EQ(expected.size(), actual.size());
+			while (!(expected.empty())) {
+				ASSERT_DOUBLE_EQ(expected.topDistance(), actual.topDistance());
+				expected.pop();
+				actual.pop();
+			}
+		}
+	}
+}
+
+TEST_F(GridKnnTest, grid_prunes_correctly_for_all_metrics) {
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+
+	expectGridMatchesNaive<Manhattan>(points_, queries, DIMENSION, 64);
+	expectGridMatchesNaive<Chebyshev>(points_, queries, DIMENSION, 64);
+	expectGridMatchesNaive<Minkowski<3>>(points_, queries, DIMENSION, 64);
+	expectGridMatchesNaive<Minkowski<4>>(points_, queries, DIMENSION, 64);
+	expectGridMatchesNaive<Cosine>(points_, queries, DIMENSION, 64);
+}
+
+TEST_F(GridKnnTest, best_first_traversal_prunes_correctly_for_all_metrics) {
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+
+	expectGridMatchesNaive<SquaredEuclidean>(points_, queries, DIMENSION, 16,
+			BEST_FIRST);
+	expectGridMatchesNaive<Manhattan>(points_, queries, DIMENSION, 16,
+			BEST_FIRST);
+	expectGridMatchesNaive<Chebyshev>(points_, queries, DIMENSION, 16,
+			BEST_FIRST);
+	expectGridMatchesNaive<Minkowski<3>>(points_, queries, DIMENSION, 16,
+			BEST_FIRST);
+	expectGridMatchesNaive<Cosine>(points_, queries, DIMENSION, 16,
+			BEST_FIRST);
+}
+
+TEST_F(GridKnnTest, best_first_traversal_finds_the_ring_neighbors) {
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+	Grid bestFirst(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION, 16);
+	bestFirst.setTraversal(BEST_FIRST);
+	ASSERT_EQ(BEST_FIRST, bestFirst.traversal());
+	std::vector<std::size_t> expectedIds(MAX_K), ids(MAX_K);
+	std::vector<double> expectedDistances(MAX_K), distances(MAX_K);
+
+	for (bool quantized : { false, true }) {
+		bestFirst.setQuantization(quantized, INT16);
+		for (unsigned k : { 1u, 10u, 1000u, MAX_K }) {
+			for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+				auto query = queries[q_idx];
+				std::size_t expected = kNN_test_grid_->kNearestNeighborIds(k,
+						&query, expectedIds.data(), expectedDistances.data());
+				ASSERT_EQ(expected, bestFirst.kNearestNeighborIds(k, &query,
+						ids.data(), distances.data()));
+				for (std::size_t i = 0; i < expected; ++i) {
+					ASSERT_DOUBLE_EQ(expectedDistances[i], distances[i]);
+				}
+			}
+		}
+	}
+}
+
+TEST_F(GridKnnTest, single_precision_grid_produces_same_results) {
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+	Grid singlePrecision(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION);
+	singlePrecision.setSinglePrecision(true);
+
+	for (unsigned k : { 1u, 10u, 100u }) {
+		for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+			auto query = queries[q_idx];
+			auto expected = kNN_test_grid_->kNearestNeighbors(k, &query);
+			auto actual = singlePrecision.kNearestNeighbors(k, &query);
+
+			ASSERT_EQ(expected.size(), actual.size());
+			while (!(expected.empty())) {
+				ASSERT_DOUBLE_EQ(expected.topDistance(), actual.topDistance());
+				expected.pop();
+				actual.pop();
+			}
+		}
+	}
+}
+
+TEST_F(GridKnnTest, quantized_grid_produces_same_results) {
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+	Grid quantized(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION);
+	quantized.setQuantization(true, INT16);
+	EXPECT_GT(quantized.quantizedMemoryUsage(), 0u);
+
+	for (unsigned k : { 1u, 10u, 100u }) {
+		for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+			auto query = queries[q_idx];
+			auto expected = kNN_test_grid_->kNearestNeighbors(k, &query);
+			auto actual = quantized.kNearestNeighbors(k, &query);
+
+			ASSERT_EQ(expected.size(), actual.size());
+			while (!(expected.empty())) {
+				ASSERT_DOUBLE_EQ(expected.topDistance(), actual.topDistance());
+				expected.pop();
+				actual.pop();
+			}
+		}
+	}
+
+	BasicGrid<Manhattan> manhattan(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION);
+	EXPECT_THROW(manhattan.setQuantization(true), std::invalid_argument);
+}
+
+TEST_F(GridKnnTest, compact_layout_produces_same_results) {
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+	Grid compact(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION);
+	const std::size_t perCellBytes = compact.cellMemoryUsage();
+	compact.setCompactLayout(true);
+	EXPECT_LT(compact.cellMemoryUsage(), perCellBytes);
+	EXPECT_THROW(compact.insertPoint(points_.data()), std::logic_error);
+	std::vector<std::size_t> expectedIds(100), ids(100);
+	std::vector<double> expectedDistances(100), distances(100);
+
+	auto expectSameNeighbors = [&](Grid& grid) {
+		for (unsigned k : { 1u, 10u, 100u }) {
+			for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+				auto query = queries[q_idx];
+				std::size_t expected = kNN_test_grid_->kNearestNeighborIds(k,
+						&query, expectedIds.data(), expectedDistances.data());
+				ASSERT_EQ(expected, grid.kNearestNeighborIds(k, &query,
+						ids.data(), distances.data()));
+				for (std::size_t i = 0; i < expected; ++i) {
+					ASSERT_EQ(expectedIds[i], ids[i]);
+					ASSERT_DOUBLE_EQ(expectedDistances[i], distances[i]);
+				}
+			}
+		}
+	};
+
+	expectSameNeighbors(compact);
+	compact.setSinglePrecision(true);
+	expectSameNeighbors(compact);
+	compact.setQuantization(true, INT16);
+	expectSameNeighbors(compact);
+
+	compact.setCompactLayout(false);
+	expectSameNeighbors(compact);
+	EXPECT_EQ(static_cast<std::size_t>(NUMBER_OF_TEST_POINTS),
+			compact.numberOfPoints_);
+}
+
+TEST_F(GridKnnTest, cell_orders_produce_same_results) {
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+	Grid ordered(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION);
+	std::vector<std::size_t> expectedIds(100), ids(100);
+	std::vector<double> expectedDistances(100), distances(100);
+
+	auto expectSameNeighbors = [&]() {
+		for (unsigned k : { 1u, 10u, 100u }) {
+			for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+				auto query = queries[q_idx];
+				std::size_t expected = kNN_test_grid_->kNearestNeighborIds(k,
+						&query, expectedIds.data(), expectedDistances.data());
+				ASSERT_EQ(expected, ordered.kNearestNeighborIds(k, &query,
+						ids.data(), distances.data()));
+				for (std::size_t i = 0; i < expected; ++i) {
+					ASSERT_EQ(expectedIds[i], ids[i]);
+					ASSERT_EQ(expectedDistances[i], distances[i]);
+				}
+			}
+		}
+	};
+
+	for (CELL_ORDER order : { MORTON, HILBERT }) {
+		ordered.setCellOrder(order);
+		ASSERT_EQ(order, ordered.cellOrder());
+		expectSameNeighbors();
+		ordered.setCompactLayout(true);
+		expectSameNeighbors();
+		ordered.setCompactLayout(false);
+	}
+	ordered.setCompactLayout(true);
+	ordered.setCellOrder(ROW_MAJOR);
+	expectSameNeighbors();
+}
+
+TEST_F(GridKnnTest, inserts_drop_the_quantized_codes) {
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+	auto inserted = genQueries(100);
+	Grid exact(DIMENSION, points_.data(), NUMBER_OF_TEST_POINTS * DIMENSION);
+	Grid quantized(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION);
+	for (Grid* grid : { &exact, &quantized }) {
+		grid->insert(inserted.data(), 50 * DIMENSION, NUMBER_OF_TEST_POINTS);
+	}
+	quantized.setQuantization(true, INT16);
+	quantized.insertPoint(&inserted.data()[50 * DIMENSION]);
+	EXPECT_EQ(0u, quantized.quantizedMemoryUsage());
+	quantized.setQuantization(true, INT16);
+	quantized.insert(&inserted.data()[51 * DIMENSION], 49 * DIMENSION);
+	EXPECT_EQ(0u, quantized.quantizedMemoryUsage());
+	exact.insert(&inserted.data()[50 * DIMENSION], 50 * DIMENSION);
+
+	for (bool quantize : { false, true }) {
+		quantized.setQuantization(quantize, INT16);
+		for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+			auto query = queries[q_idx];
+			auto expected = exact.kNearestNeighbors(10, &query);
+			auto actual = quantized.kNearestNeighbors(10, &query);
+
+			ASSERT_EQ(expected.size(), actual.size());
+			while (!(expected.empty())) {
+				ASSERT_DOUBLE_EQ(expected.topDistance(), actual.topDistance());
+				expected.pop();
+				actual.pop();
+			}
+		}
+	}
+}
+
+TEST_F(GridKnnTest, index_based_results_identify_the_naive_neighbors) {
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	Grid quantized(DIMENSION, points_.data(),
+			NUMBER_OF_TEST_POINTS * DIMENSION);
+	quantized.setQuantization(true, INT16);
+	std::vector<std::size_t> expectedIds(1000), ids(1000);
+	std::vector<double> expectedDistances(1000), distances(1000);
+
+	for (unsigned k : { 1u, 10u, 1000u }) {
+		for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+			auto query = queries[q_idx];
+			std::size_t expected = naive.kNearestNeighborIds(k, &query,
+					expectedIds.data(), expectedDistances.data());
+			ASSERT_EQ(static_cast<std::size_t>(k), expected);
+
+			for (Grid* grid : { kNN_test_grid_, &quantized }) {
+				ASSERT_EQ(expected, grid->kNearestNeighborIds(k, &query,
+						ids.data(), distances.data(), true));
+				for (std::size_t i = 0; i < expected; ++i) {
+					ASSERT_DOUBLE_EQ(std::sqrt(expectedDistances[i]),
+							distances[i]);
+					ASSERT_DOUBLE_EQ(expectedDistances[i],
+							Metrics::squared_euclidean(
+									&points_.data()[ids[i] * DIMENSION],
+									query.getData() + query.getOffset(),
+									DIMENSION));
+				}
+			}
+		}
+	}
+}
+
+TEST_F(GridKnnTest, batch_matches_single_queries) {
+	const unsigned k = 10;
+	const unsigned numberOfThreads = 4;
+	auto queries = genQueries(NUMBER_OF_QUERIES);
+	std::vector<std::size_t> expectedIds(k);
+	std::vector<double> expectedDistances(k);
+	std::vector<std::size_t> ids(queries.size() * k);
+	std::vector<double> distances(queries.size() * k);
+
+	kNN_test_grid_->kNearestNeighborIdsBatch(k, queries, numberOfThreads,
+			ids.data(), distances.data());
+
+	for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+		auto query = queries[q_idx];
+		ASSERT_EQ(static_cast<std::size_t>(k),
+				kNN_test_grid_->kNearestNeighborIds(k, &query,
+						expectedIds.data(), expectedDistances.data()));
+		for (std::size_t i = 0; i < k; ++i) {
+			ASSERT_EQ(expectedIds[i], ids[q_idx * k + i]);
+			ASSERT_EQ(expectedDistances[i], distances[q_idx * k + i]);
+		}
+	}
+}
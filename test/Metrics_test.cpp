@@ -2,7 +2,13 @@
 #include "knn/Metrics.h"
 #include "model/PointArrayAccessor.h"
 
-#include "cmath"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
 
 class MetricsTest: public ::testing::Test {
 protected:
@@ -29,3 +35,236 @@ TEST_F(MetricsTest, squared_euclidean) {
 TEST_F(MetricsTest, euclidean) {
 	ASSERT_DOUBLE_EQ(std::sqrt(3.0), Metrics::euclidean(&p1_, &p2_));
 }
+
+class MetricsKernelTest: public ::testing::Test {
+protected:
+	static const unsigned NUMBER_OF_POINTS = 2000;
+	static const unsigned SEED = 12345;
+
+	std::vector<SIMD_LEVEL> supportedLevels() {
+		std::vector<SIMD_LEVEL> levels;
+		SIMD_LEVEL detected = Metrics::detectSimdLevel();
+		for (int level = SCALAR; level <= detected; ++level) {
+			levels.push_back(static_cast<SIMD_LEVEL>(level));
+		}
+		return levels;
+	}
+
+	std::vector<double> randomCoordinates(std::size_t size) {
+		std::default_random_engine engine(SEED);
+		std::uniform_real_distribution<double> uniform(-100.0, 100.0);
+		std::vector<double> coords(size);
+		for (auto& c : coords) {
+			c = uniform(engine);
+		}
+		return coords;
+	}
+};
+
+TEST_F(MetricsKernelTest, scalar_kernel_is_bit_identical_to_accessor_implementation) {
+	for (std::size_t dim : { 1, 2, 3, 5, 8, 13 }) {
+		auto coords = randomCoordinates((NUMBER_OF_POINTS + 1) * dim);
+		PointArrayAccessor query(coords.data(), 0, dim);
+		auto kernel = Metrics::squaredEuclideanKernel(SCALAR);
+
+		for (std::size_t p = 1; p <= NUMBER_OF_POINTS; ++p) {
+			PointArrayAccessor point(coords.data(), p * dim, dim);
+			ASSERT_EQ(Metrics::squared_euclidean(&point, &query),
+					kernel(&coords[p * dim], coords.data(), dim));
+		}
+	}
+}
+
+TEST_F(MetricsKernelTest, simd_kernels_preserve_distance_ordering) {
+	for (std::size_t dim : { 1, 2, 3, 4, 7, 8, 9, 16, 31, 64, 128 }) {
+		auto coords = randomCoordinates((NUMBER_OF_POINTS + 1) * dim);
+		PointArrayAccessor query(coords.data(), 0, dim);
+
+		std::vector<double> reference(NUMBER_OF_POINTS);
+		for (std::size_t p = 0; p < NUMBER_OF_POINTS; ++p) {
+			PointArrayAccessor point(coords.data(), (p + 1) * dim, dim);
+			reference[p] = Metrics::squared_euclidean(&point, &query);
+		}
+		std::vector<std::size_t> expectedOrder(NUMBER_OF_POINTS);
+		std::iota(expectedOrder.begin(), expectedOrder.end(), 0);
+		std::sort(expectedOrder.begin(), expectedOrder.end(),
+				[&](std::size_t a, std::size_t b) {
+					return reference[a] < reference[b];
+				});
+
+		for (SIMD_LEVEL level : supportedLevels()) {
+			auto kernel = Metrics::squaredEuclideanKernel(level);
+			std::vector<double> actual(NUMBER_OF_POINTS);
+			for (std::size_t p = 0; p < NUMBER_OF_POINTS; ++p) {
+				actual[p] = kernel(&coords[(p + 1) * dim], coords.data(), dim);
+				//lane-wise accumulation only reorders the additions
+				ASSERT_NEAR(reference[p], actual[p], reference[p] * 1e-12);
+			}
+
+			std::vector<std::size_t> actualOrder(NUMBER_OF_POINTS);
+			std::iota(actualOrder.begin(), actualOrder.end(), 0);
+			std::sort(actualOrder.begin(), actualOrder.end(),
+					[&](std::size_t a, std::size_t b) {
+						return actual[a] < actual[b];
+					});
+			EXPECT_EQ(expectedOrder, actualOrder) << "SIMD level: " << level
+					<< ", dimension: " << dim;
+		}
+	}
+}
+
+TEST_F(MetricsKernelTest, bounded_kernels_abandon_only_above_threshold) {
+	for (std::size_t dim : { 3, 16, 17, 31, 64, 128 }) {
+		auto coords = randomCoordinates((NUMBER_OF_POINTS + 1) * dim);
+
+		for (SIMD_LEVEL level : supportedLevels()) {
+			auto kernel = Metrics::squaredEuclideanKernel(level);
+			auto bounded = Metrics::boundedSquaredEuclideanKernel(level);
+			//distance to the first point as threshold
+			double threshold = kernel(&coords[dim], coords.data(), dim);
+
+			for (std::size_t p = 1; p <= NUMBER_OF_POINTS; ++p) {
+				double full = kernel(&coords[p * dim], coords.data(), dim);
+				double partial = bounded(&coords[p * dim], coords.data(), dim,
+						threshold);
+
+				if (full <= threshold) {
+					ASSERT_EQ(full, partial);
+				} else {
+					ASSERT_GT(partial, threshold);
+					ASSERT_LE(partial, full * (1.0 + 1e-12));
+				}
+				ASSERT_EQ(full, bounded(&coords[p * dim], coords.data(), dim,
+						std::numeric_limits<double>::infinity()));
+			}
+		}
+	}
+}
+
+TEST_F(MetricsKernelTest, metric_kernels_match_scalar_definitions) {
+	for (std::size_t dim : { 1, 3, 4, 7, 8, 9, 16, 31, 64 }) {
+		auto coords = randomCoordinates((NUMBER_OF_POINTS + 1) * dim);
+		const double* q = coords.data();
+
+		for (std::size_t p_idx = 1; p_idx <= NUMBER_OF_POINTS; ++p_idx) {
+			const double* p = &coords[p_idx * dim];
+			double manhattan = 0.0, chebyshev = 0.0, minkowski = 0.0;
+			double dot = 0.0, pNorm = 0.0, qNorm = 0.0;
+
+			for (std::size_t d = 0; d < dim; ++d) {
+				double diff = std::fabs(p[d] - q[d]);
+				manhattan += diff;
+				chebyshev = std::max(chebyshev, diff);
+				minkowski += diff * diff * diff;
+				dot += p[d] * q[d];
+				pNorm += p[d] * p[d];
+				qNorm += q[d] * q[d];
+			}
+			double cosine = 1.0 - dot / std::sqrt(pNorm * qNorm);
+
+			for (SIMD_LEVEL level : supportedLevels()) {
+				ASSERT_NEAR(manhattan, Metrics::manhattanKernel(level)(p, q, dim),
+						manhattan * 1e-12);
+				ASSERT_EQ(chebyshev, Metrics::chebyshevKernel(level)(p, q, dim));
+				ASSERT_NEAR(minkowski,
+						Metrics::minkowskiKernel(level)(p, q, dim, 3),
+						minkowski * 1e-12);
+				ASSERT_NEAR(cosine, Metrics::cosineKernel(level)(p, q, dim),
+						1e-12);
+			}
+		}
+	}
+}
+
+TEST_F(MetricsKernelTest, single_precision_kernels_widen_to_double) {
+	for (std::size_t dim : { 1, 3, 4, 7, 8, 9, 16, 31, 64 }) {
+		auto coords = randomCoordinates((NUMBER_OF_POINTS + 1) * dim);
+		std::vector<float> floats(coords.begin(), coords.end());
+		const double* q = coords.data();
+
+		for (std::size_t p_idx = 1; p_idx <= NUMBER_OF_POINTS; ++p_idx) {
+			const float* p = &floats[p_idx * dim];
+			double expected = 0.0;
+			for (std::size_t d = 0; d < dim; ++d) {
+				double diff = p[d] - q[d];
+				expected += diff * diff;
+			}
+
+			for (SIMD_LEVEL level : supportedLevels()) {
+				ASSERT_NEAR(expected,
+						Metrics::squaredEuclideanSinglePrecisionKernel(level)(p,
+								q, dim), expected * 1e-12);
+			}
+		}
+	}
+}
+
+TEST_F(MetricsKernelTest, integer_kernels_are_exact) {
+	std::default_random_engine engine(SEED);
+	std::uniform_int_distribution<int> int8Codes(-127, 127);
+	std::uniform_int_distribution<int> int16Codes(-16383, 16383);
+
+	//8200 dimensions exceed one int8 flush block
+	for (std::size_t dim : { 1, 3, 8, 15, 16, 17, 33, 64, 8200 }) {
+		std::vector<std::int8_t> p8(dim), q8(dim);
+		std::vector<std::int16_t> p16(dim), q16(dim);
+		double expected8 = 0.0, expected16 = 0.0;
+
+		for (std::size_t d = 0; d < dim; ++d) {
+			p8[d] = int8Codes(engine);
+			q8[d] = d % 2 ? -127 : 127;
+			p16[d] = int16Codes(engine);
+			q16[d] = d % 2 ? -16383 : 16383;
+			expected8 += static_cast<double>(p8[d] - q8[d]) * (p8[d] - q8[d]);
+			expected16 += static_cast<double>(p16[d] - q16[d])
+					* (p16[d] - q16[d]);
+		}
+
+		for (SIMD_LEVEL level : supportedLevels()) {
+			ASSERT_EQ(expected8,
+					Metrics::int8SquaredEuclideanKernel(level)(p8.data(),
+							q8.data(), dim));
+			ASSERT_EQ(expected16,
+					Metrics::int16SquaredEuclideanKernel(level)(p16.data(),
+							q16.data(), dim));
+		}
+	}
+}
+
+TEST_F(MetricsKernelTest, tile_kernels_are_bit_identical_to_scalar_kernel) {
+	const std::size_t tile = Metrics::QUERY_TILE;
+	auto scalar = Metrics::squaredEuclideanKernel(SCALAR);
+
+	for (std::size_t dim : { 1, 3, 8, 17 }) {
+		auto queries = randomCoordinates(tile * dim);
+		auto points = randomCoordinates(NUMBER_OF_POINTS * dim);
+		std::vector<double> queryTile(tile * dim);
+		for (std::size_t q = 0; q < tile; ++q) {
+			for (std::size_t d = 0; d < dim; ++d) {
+				queryTile[d * tile + q] = queries[q * dim + d];
+			}
+		}
+
+		for (SIMD_LEVEL level : supportedLevels()) {
+			std::vector<double> distances(NUMBER_OF_POINTS * tile);
+			Metrics::squaredEuclideanTileKernel(level)(points.data(),
+					NUMBER_OF_POINTS, queryTile.data(), dim, distances.data());
+
+			for (std::size_t p = 0; p < NUMBER_OF_POINTS; ++p) {
+				for (std::size_t q = 0; q < tile; ++q) {
+					ASSERT_EQ(scalar(&points[p * dim], &queries[q * dim], dim),
+							distances[p * tile + q]) << "SIMD level: " << level
+							<< ", dimension: " << dim;
+				}
+			}
+		}
+	}
+}
+
+TEST_F(MetricsKernelTest, simd_level_is_capped_at_detected_level) {
+	SIMD_LEVEL before = Metrics::simdLevel();
+	EXPECT_LE(Metrics::setSimdLevel(AVX512), Metrics::detectSimdLevel());
+	EXPECT_EQ(SCALAR, Metrics::setSimdLevel(SCALAR));
+	Metrics::setSimdLevel(before);
+	EXPECT_EQ(before, Metrics::simdLevel());
+}
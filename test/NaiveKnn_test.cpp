@@ -1,12 +1,17 @@
 #include "gtest/gtest.h"
 #include "knn/NaiveKnn.h"
+#include "knn/NaiveKnnD.h"
 #include "knn/Metrics.h"
 #include "model/PointArrayAccessor.h"
 #include "util/RandomPointGenerator.h"
 #include "util/FileHandler.h"
 
 #include "iostream"
+#include "limits"
 #include "string"
+#include "memory"
+#include "typeinfo"
+#include "vector"
 
 class NaiveKnnTest: public ::testing::Test {
 protected:
@@ -42,6 +47,24 @@ TEST_F(NaiveKnnTest, k_1000_contains_1000_results) {
 	ASSERT_EQ(static_cast<std::size_t>(K), result.size());
 }
 
+TEST_F(NaiveKnnTest, k_0_finds_nothing) {
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	NaiveKnnD<DIMENSION> specialized(points_.data(), NUMBER_OF_TEST_POINTS);
+	PointContainer queries(DIMENSION, points_.data(), 3);
+
+	for (NaiveKnn* processor : { &naive,
+			static_cast<NaiveKnn*>(&specialized) }) {
+		ASSERT_TRUE(processor->kNearestNeighbors(0, &query).empty());
+		ASSERT_EQ(0u, processor->kNearestNeighborIds(0, &query, nullptr,
+				nullptr));
+		for (auto& result : processor->kNearestNeighborsBatch(0, queries)) {
+			ASSERT_TRUE(result.empty());
+		}
+	}
+}
+
 TEST_F(NaiveKnnTest, k_1000) {
 	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
 	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
@@ -61,3 +84,282 @@ TEST_F(NaiveKnnTest, k_1000) {
 		actualResult.pop();
 	}
 }
+
+TEST_F(NaiveKnnTest, factory_creates_dimension_specialized_processor) {
+	NaiveKnn* specialized = NaiveKnn::create(points_.data(), DIMENSION,
+			NUMBER_OF_TEST_POINTS);
+	NaiveKnn* runtime = NaiveKnn::create(points_.data(),
+			MAX_FIXED_DIMENSION + 1, DIMENSION);
+
+	EXPECT_TRUE(dynamic_cast<NaiveKnnD<DIMENSION>*>(specialized) != nullptr);
+	EXPECT_TRUE(typeid(*runtime) == typeid(NaiveKnn));
+
+	delete (specialized);
+	delete (runtime);
+}
+
+TEST_F(NaiveKnnTest, dimension_specialized_processor_produces_same_results) {
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	NaiveKnnD<DIMENSION> naiveD(points_.data(), NUMBER_OF_TEST_POINTS);
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+
+	auto expected = naive.kNearestNeighbors(K, &query);
+	auto actual = naiveD.kNearestNeighbors(K, &query);
+
+	ASSERT_EQ(expected.size(), actual.size());
+	while (!(expected.empty())) {
+		ASSERT_DOUBLE_EQ(expected.topDistance(), actual.topDistance());
+		expected.pop();
+		actual.pop();
+	}
+}
+
+TEST_F(NaiveKnnTest, blocked_batch_produces_same_results_as_single_queries) {
+	RandomPointGenerator rg(SEED);
+	double mbrCoords[] = { -90.0, 0.5, -48.0, 100.0, 6.5, 40.0 };
+	MBR m = MBR(DIMENSION);
+	m = m.createMBR(mbrCoords, 2 * DIMENSION);
+	//13 queries: one full tile and one padded tile
+	PointContainer queries = rg.generatePoints(13, RandomPointGenerator::UNIFORM,
+			m);
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+
+	for (unsigned k : { 1u, 10u, K }) {
+		auto batchResults = naive.kNearestNeighborsBatch(k, queries);
+		ASSERT_EQ(queries.size(), batchResults.size());
+
+		for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+			auto query = queries[q_idx];
+			auto expected = naive.kNearestNeighbors(k, &query);
+			auto& actual = batchResults[q_idx];
+
+			ASSERT_EQ(expected.size(), actual.size());
+			while (!(expected.empty())) {
+				ASSERT_DOUBLE_EQ(expected.topDistance(), actual.topDistance());
+				expected.pop();
+				actual.pop();
+			}
+		}
+	}
+}
+
+TEST_F(NaiveKnnTest, blocked_batch_handles_high_dimensions) {
+	const std::size_t dimension = 17;
+	const std::size_t numberOfPoints = NUMBER_OF_TEST_POINTS / dimension;
+	PointContainer queries(dimension, points_.data(), 9);
+	NaiveKnn naive(points_.data(), dimension, numberOfPoints);
+
+	auto batchResults = naive.kNearestNeighborsBatch(K, queries);
+
+	for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+		auto query = queries[q_idx];
+		auto expected = naive.kNearestNeighbors(K, &query);
+		auto& actual = batchResults[q_idx];
+
+		ASSERT_EQ(expected.size(), actual.size());
+		while (!(expected.empty())) {
+			//single queries use the lane-wise SIMD kernel
+			ASSERT_NEAR(expected.topDistance(), actual.topDistance(),
+					expected.topDistance() * 1e-12);
+			expected.pop();
+			actual.pop();
+		}
+	}
+}
+
+TEST_F(NaiveKnnTest, norm_expansion_batch_produces_same_results_as_single_queries) {
+	const std::size_t dimension = 32;
+	const std::size_t numberOfPoints = NUMBER_OF_TEST_POINTS / dimension;
+	PointContainer references(dimension, points_.data(), numberOfPoints);
+	PointContainer queries(dimension, points_.data() + dimension * 7 + 1, 11);
+	references.computeSquaredNorms();
+	ASSERT_TRUE(references.hasSquaredNorms());
+
+	NaiveKnn naive(references.data(), dimension, numberOfPoints);
+	naive.setSquaredNorms(references.squaredNorms().data());
+
+	for (unsigned k : { 1u, 10u, K }) {
+		auto batchResults = naive.kNearestNeighborsBatch(k, queries);
+		ASSERT_EQ(queries.size(), batchResults.size());
+
+		for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+			auto query = queries[q_idx];
+			auto expected = naive.kNearestNeighbors(k, &query);
+			auto& actual = batchResults[q_idx];
+
+			ASSERT_EQ(expected.size(), actual.size());
+			while (!(expected.empty())) {
+				//re-ranked with the single query kernel
+				ASSERT_DOUBLE_EQ(expected.topDistance(), actual.topDistance());
+				expected.pop();
+				actual.pop();
+			}
+		}
+	}
+
+	references.addPoint(points_.data());
+	ASSERT_FALSE(references.hasSquaredNorms());
+}
+
+TEST_F(NaiveKnnTest, single_precision_scan_reranks_to_double_precision_results) {
+	const std::size_t dimension = 16;
+	const std::size_t numberOfPoints = NUMBER_OF_TEST_POINTS / dimension;
+	PointContainer references(dimension, points_.data(), numberOfPoints);
+	PointContainer queries(dimension, points_.data() + dimension * 7 + 1, 11);
+	references.computeSinglePrecision();
+	ASSERT_TRUE(references.hasSinglePrecision());
+
+	NaiveKnn naive(references.data(), dimension, numberOfPoints);
+	NaiveKnn singlePrecision(references.data(), dimension, numberOfPoints);
+	singlePrecision.setSinglePrecisionPoints(
+			references.singlePrecision().data());
+
+	for (unsigned k : { 1u, 10u, K }) {
+		for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+			auto query = queries[q_idx];
+			auto expected = naive.kNearestNeighbors(k, &query);
+			auto actual = singlePrecision.kNearestNeighbors(k, &query);
+
+			ASSERT_EQ(expected.size(), actual.size());
+			while (!(expected.empty())) {
+				//re-ranked with the double precision kernel
+				ASSERT_DOUBLE_EQ(expected.topDistance(), actual.topDistance());
+				expected.pop();
+				actual.pop();
+			}
+		}
+	}
+
+	references.addPoint(points_.data());
+	ASSERT_FALSE(references.hasSinglePrecision());
+}
+
+TEST_F(NaiveKnnTest, quantized_scan_refines_to_exact_results) {
+	const std::size_t dimension = 16;
+	const std::size_t numberOfPoints = NUMBER_OF_TEST_POINTS / dimension;
+	PointContainer references(dimension, points_.data(), numberOfPoints);
+	PointContainer queries(dimension, points_.data() + dimension * 7 + 1, 11);
+	MBR mbr = MBR(dimension).createMBR(references.data(),
+			numberOfPoints * dimension);
+
+	NaiveKnn naive(references.data(), dimension, numberOfPoints);
+	NaiveKnn quantized(references.data(), dimension, numberOfPoints);
+
+	for (QUANTIZATION quantization : { INT8, INT16 }) {
+		std::unique_ptr<QuantizedPoints> codes(
+				QuantizedPoints::create(quantization, mbr, references.data(),
+						numberOfPoints));
+		quantized.setQuantizedPoints(codes.get());
+		EXPECT_LT(codes->memoryUsage(),
+				numberOfPoints * dimension * sizeof(double) / 3);
+
+		for (unsigned k : { 1u, 10u }) {
+			for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+				auto query = queries[q_idx];
+				auto expected = naive.kNearestNeighbors(k, &query);
+				auto actual = quantized.kNearestNeighbors(k, &query);
+
+				ASSERT_EQ(expected.size(), actual.size());
+				while (!(expected.empty())) {
+					//refined with the double precision kernel
+					ASSERT_DOUBLE_EQ(expected.topDistance(),
+							actual.topDistance());
+					expected.pop();
+					actual.pop();
+				}
+			}
+		}
+	}
+}
+
+TEST_F(NaiveKnnTest, small_k_collector_returns_the_closest_of_a_large_k_scan) {
+	NaiveKnnD<DIMENSION> naive(points_.data(), NUMBER_OF_TEST_POINTS);
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+
+	auto large = naive.kNearestNeighbors(K, &query);
+	std::vector<double> ascending;
+	while (!(large.empty())) {
+		ascending.insert(ascending.begin(), large.topDistance());
+		large.pop();
+	}
+
+	for (unsigned k : { 1u, 7u, 32u }) {
+		auto actual = naive.kNearestNeighbors(k, &query);
+
+		ASSERT_EQ(static_cast<std::size_t>(k), actual.size());
+		for (unsigned rank = k; rank > 0; --rank) {
+			ASSERT_EQ(ascending[rank - 1], actual.topDistance());
+			actual.pop();
+		}
+	}
+}
+
+TEST_F(NaiveKnnTest, selection_path_produces_same_results_as_heap) {
+	NaiveKnn heap(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	NaiveKnn selection(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	heap.setSelectionPointsPerK(0);
+	selection.setSelectionPointsPerK(NUMBER_OF_TEST_POINTS);
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+
+	for (unsigned k : { 33u, K, 50000u }) {
+		auto expected = heap.kNearestNeighbors(k, &query);
+		auto actual = selection.kNearestNeighbors(k, &query);
+
+		ASSERT_EQ(static_cast<std::size_t>(k), actual.size());
+		while (!(expected.empty())) {
+			ASSERT_EQ(expected.topDistance(), actual.topDistance());
+			expected.pop();
+			actual.pop();
+		}
+	}
+}
+
+TEST_F(NaiveKnnTest, index_based_results_are_sorted_and_match_the_queue) {
+	NaiveKnnD<DIMENSION> naive(points_.data(), NUMBER_OF_TEST_POINTS);
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+	std::vector<std::size_t> ids(K);
+	std::vector<double> distances(K);
+
+	for (unsigned k : { 1u, 32u, 100u, K }) {
+		auto expected = naive.kNearestNeighbors(k, &query);
+
+		ASSERT_EQ(static_cast<std::size_t>(k),
+				naive.kNearestNeighborIds(k, &query, ids.data(),
+						distances.data()));
+		for (std::size_t rank = k; rank > 0; --rank) {
+			ASSERT_EQ(expected.topDistance(), distances[rank - 1]);
+			ASSERT_DOUBLE_EQ(expected.topDistance(),
+					Metrics::squared_euclidean(
+							&points_.data()[ids[rank - 1] * DIMENSION],
+							queryCoords, DIMENSION));
+			expected.pop();
+		}
+	}
+}
+
+TEST_F(NaiveKnnTest, batch_pads_rows_beyond_the_indexed_points) {
+	const unsigned numberOfPoints = 5;
+	const unsigned k = 8;
+	NaiveKnn naive(points_.data(), DIMENSION, numberOfPoints);
+	PointContainer queries(DIMENSION, points_.data(), 3);
+	std::vector<std::size_t> ids(queries.size() * k);
+	std::vector<double> distances(queries.size() * k);
+
+	naive.kNearestNeighborIdsBatch(k, queries, 2, ids.data(),
+			distances.data());
+
+	for (std::size_t q_idx = 0; q_idx < queries.size(); ++q_idx) {
+		//every query is an indexed point
+		ASSERT_EQ(q_idx, ids[q_idx * k]);
+		ASSERT_EQ(0.0, distances[q_idx * k]);
+		for (std::size_t i = numberOfPoints; i < k; ++i) {
+			ASSERT_EQ(NO_NEIGHBOR, ids[q_idx * k + i]);
+			ASSERT_EQ(std::numeric_limits<double>::infinity(),
+					distances[q_idx * k + i]);
+		}
+	}
+}
@@ -5,9 +5,12 @@
 #include "naive-map-reduce/NaiveMapReduce.h"
 #include "util/RandomPointGenerator.h"
 #include "util/FileHandler.h"
+#include "util/Affinity.h"
 
+#include "algorithm"
 #include "iostream"
 #include "string"
+#include "vector"
 
 class NaiveMapReduceKnnTest: public ::testing::Test {
 protected:
@@ -72,6 +75,134 @@ TEST_F(NaiveMapReduceKnnTest, distributed_run_produces_same_results_as_single_th
 	}
 }
 
+TEST_F(NaiveMapReduceKnnTest, distributed_selection_produces_same_results_as_heap) {
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	naive.setSelectionPointsPerK(0);
+	NaiveMapReduce naiveMapReduce(points_.data(), DIMENSION,
+			NUMBER_OF_TEST_POINTS, MAX_THREADS, MAX_THREAD_LOAD,
+			MAX_SINGLE_THREADED, KNN_STRATEGY::NAIVE);
+	naiveMapReduce.setSelectionPointsPerK(NUMBER_OF_TEST_POINTS);
+
+	auto naiveResult = naive.kNearestNeighbors(K, &query);
+	auto naiveMapReduceResult = naiveMapReduce.kNearestNeighbors(K, &query);
+
+	ASSERT_EQ(naiveResult.size(), naiveMapReduceResult.size());
+	while (!(naiveResult.empty())) {
+		ASSERT_EQ(naiveResult.topDistance(),
+				naiveMapReduceResult.topDistance());
+		naiveResult.pop();
+		naiveMapReduceResult.pop();
+	}
+}
+
+TEST_F(NaiveMapReduceKnnTest, index_based_results_match_single_threaded) {
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+	std::vector<std::size_t> expectedIds(K), ids(K);
+	std::vector<double> expectedDistances(K), distances(K);
+
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	ASSERT_EQ(static_cast<std::size_t>(K),
+			naive.kNearestNeighborIds(K, &query, expectedIds.data(),
+					expectedDistances.data()));
+
+	for (KNN_STRATEGY strategy : { KNN_STRATEGY::NAIVE, KNN_STRATEGY::GRID }) {
+		NaiveMapReduce naiveMapReduce(points_.data(), DIMENSION,
+				NUMBER_OF_TEST_POINTS, MAX_THREADS, MAX_THREAD_LOAD,
+				MAX_SINGLE_THREADED, strategy);
+
+		ASSERT_EQ(static_cast<std::size_t>(K),
+				naiveMapReduce.kNearestNeighborIds(K, &query, ids.data(),
+						distances.data()));
+		for (std::size_t i = 0; i < K; ++i) {
+			ASSERT_DOUBLE_EQ(expectedDistances[i], distances[i]);
+			ASSERT_DOUBLE_EQ(distances[i],
+					Metrics::squared_euclidean(
+							&points_.data()[ids[i] * DIMENSION], queryCoords,
+							DIMENSION));
+		}
+	}
+}
+
+TEST_F(NaiveMapReduceKnnTest, shared_bound_keeps_results_of_pruned_chunks) {
+	//chunks scanned after a close one are pruned below k candidates
+	double queryCoords[DIMENSION] = { -99.0, 6.5, 42.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+	std::vector<std::size_t> ids(K);
+	std::vector<double> distances(K);
+
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	NaiveMapReduce naiveMapReduce(points_.data(), DIMENSION,
+			NUMBER_OF_TEST_POINTS, MAX_THREADS, MAX_THREAD_LOAD,
+			MAX_SINGLE_THREADED, KNN_STRATEGY::NAIVE);
+
+	for (unsigned k : { 10u, K }) {
+		auto naiveResult = naive.kNearestNeighbors(k, &query);
+		auto naiveMapReduceResult = naiveMapReduce.kNearestNeighbors(k,
+				&query);
+		ASSERT_EQ(naiveResult.size(), naiveMapReduceResult.size());
+
+		std::size_t found = naiveMapReduce.kNearestNeighborIds(k, &query,
+				ids.data(), distances.data());
+		ASSERT_EQ(static_cast<std::size_t>(k), found);
+
+		for (std::size_t i = k; i-- > 0;) {
+			ASSERT_DOUBLE_EQ(naiveResult.topDistance(),
+					naiveMapReduceResult.topDistance());
+			ASSERT_DOUBLE_EQ(naiveResult.topDistance(), distances[i]);
+			naiveResult.pop();
+			naiveMapReduceResult.pop();
+		}
+	}
+}
+
+TEST_F(NaiveMapReduceKnnTest, results_of_both_strategies_are_the_neighbors) {
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+
+	for (KNN_STRATEGY strategy : { KNN_STRATEGY::NAIVE, KNN_STRATEGY::GRID }) {
+		NaiveMapReduce naiveMapReduce(points_.data(), DIMENSION,
+				NUMBER_OF_TEST_POINTS, MAX_THREADS, MAX_THREAD_LOAD,
+				MAX_SINGLE_THREADED, strategy);
+		auto result = naiveMapReduce.kNearestNeighbors(K, &query);
+
+		ASSERT_EQ(static_cast<std::size_t>(K), result.size());
+		while (!result.empty()) {
+			PointArrayAccessor point = result.topPoint();
+			ASSERT_EQ(points_.data(), point.getData());
+			ASSERT_DOUBLE_EQ(result.topDistance(),
+					Metrics::squared_euclidean(
+							point.getData() + point.getOffset(), queryCoords,
+							DIMENSION));
+			result.pop();
+		}
+	}
+}
+
+TEST(MergeNeighborsTest, merges_sorted_runs_into_the_k_closest) {
+	std::vector<std::vector<Neighbor>> runs = {
+			{ { 1.0, 10 }, { 4.0, 11 }, { 9.0, 12 } },
+			{ },
+			{ { 2.0, 20 }, { 3.0, 21 } },
+			{ { 0.5, 30 }, { 3.0, 31 }, { 5.0, 32 } } };
+	std::vector<Neighbor> merged;
+
+	mergeNeighbors(5, runs, merged);
+
+	const std::size_t expectedIds[] = { 30, 10, 20, 21, 31 };
+	ASSERT_EQ(static_cast<std::size_t>(5), merged.size());
+	for (std::size_t i = 0; i < merged.size(); ++i) {
+		ASSERT_EQ(expectedIds[i], merged[i].id);
+	}
+
+	mergeNeighbors(20, runs, merged);
+	ASSERT_EQ(static_cast<std::size_t>(8), merged.size());
+	ASSERT_TRUE(std::is_sorted(merged.begin(), merged.end(), closerThan));
+}
+
 TEST_F(NaiveMapReduceKnnTest, NaiveMR_using_Grid_vs_Naive_approach_end_with_same_results) {
 	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
 	NaiveMapReduce naiveMapReduceNaive(points_.data(), DIMENSION,
@@ -99,3 +230,169 @@ TEST_F(NaiveMapReduceKnnTest, NaiveMR_using_Grid_vs_Naive_approach_end_with_same
 		resultGrid.pop();
 	}
 }
+
+TEST_F(NaiveMapReduceKnnTest, batch_matches_single_threaded) {
+	const std::size_t numberOfQueries = 3;
+	double queryCoords[numberOfQueries * DIMENSION] = { 1.0, 1.0, 1.0, -50.0,
+			3.0, 20.0, 99.0, 6.0, -49.0 };
+	PointContainer queries(DIMENSION, queryCoords, numberOfQueries);
+	std::vector<std::size_t> expectedIds(K);
+	std::vector<double> expectedDistances(K);
+	std::vector<std::size_t> ids(numberOfQueries * K);
+	std::vector<double> distances(numberOfQueries * K);
+
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	NaiveMapReduce naiveMapReduce(points_.data(), DIMENSION,
+			NUMBER_OF_TEST_POINTS, MAX_THREADS, MAX_THREAD_LOAD,
+			MAX_SINGLE_THREADED);
+
+	for (unsigned numberOfThreads : { 2u, 8u }) {
+		naiveMapReduce.kNearestNeighborIdsBatch(K, queries, numberOfThreads,
+				ids.data(), distances.data());
+
+		for (std::size_t q_idx = 0; q_idx < numberOfQueries; ++q_idx) {
+			auto query = queries[q_idx];
+			naive.kNearestNeighborIds(K, &query, expectedIds.data(),
+					expectedDistances.data());
+			for (std::size_t i = 0; i < K; ++i) {
+				//tile distances are the scalar kernel's, single queries use
+				//the vectorized kernel (see squared_euclidean_tile)
+				ASSERT_DOUBLE_EQ(expectedDistances[i], distances[q_idx * K + i]);
+				ASSERT_EQ(Metrics::squaredEuclideanKernel(SCALAR)(
+						&points_.data()[ids[q_idx * K + i] * DIMENSION],
+						&queryCoords[q_idx * DIMENSION], DIMENSION),
+						distances[q_idx * K + i]);
+			}
+		}
+	}
+}
+
+TEST_F(NaiveMapReduceKnnTest, batch_map_reduces_groups_of_queries) {
+	//more queries than fit the candidate budget of one group
+	const std::size_t numberOfQueries = 2
+			* NaiveMapReduce::BATCH_CANDIDATES_MAX / (MAX_THREADS * K) + 3;
+	RandomPointGenerator rg(SEED + 1);
+	double mbrCoords[] = { -100.0, 0.0, -50.0, 100.0, 7.0, 42.1235896 };
+	MBR m = MBR(DIMENSION);
+	m = m.createMBR(mbrCoords, 2 * DIMENSION);
+	PointContainer queries = rg.generatePoints(numberOfQueries,
+			RandomPointGenerator::UNIFORM, m);
+	std::vector<std::size_t> expectedIds(K);
+	std::vector<double> expectedDistances(K);
+	std::vector<std::size_t> ids(numberOfQueries * K);
+	std::vector<double> distances(numberOfQueries * K);
+
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	NaiveMapReduce naiveMapReduce(points_.data(), DIMENSION,
+			NUMBER_OF_TEST_POINTS, MAX_THREADS, MAX_THREAD_LOAD,
+			MAX_SINGLE_THREADED);
+	naiveMapReduce.kNearestNeighborIdsBatch(K, queries, MAX_THREADS,
+			ids.data(), distances.data());
+
+	for (std::size_t q_idx = 0; q_idx < numberOfQueries; ++q_idx) {
+		auto query = queries[q_idx];
+		naive.kNearestNeighborIds(K, &query, expectedIds.data(),
+				expectedDistances.data());
+		for (std::size_t i = 0; i < K; ++i) {
+			const std::size_t id = ids[q_idx * K + i];
+			ASSERT_DOUBLE_EQ(expectedDistances[i], distances[q_idx * K + i]);
+			ASSERT_DOUBLE_EQ(distances[q_idx * K + i],
+					Metrics::squared_euclidean(&points_.data()[id * DIMENSION],
+							&queries.data()[q_idx * DIMENSION], DIMENSION));
+		}
+	}
+}
+
+TEST_F(NaiveMapReduceKnnTest, batch_for_k_0_finds_nothing) {
+	PointContainer queries(DIMENSION, points_.data(), 10);
+	NaiveMapReduce naiveMapReduce(points_.data(), DIMENSION,
+			NUMBER_OF_TEST_POINTS, MAX_THREADS, MAX_THREAD_LOAD,
+			MAX_SINGLE_THREADED);
+
+	naiveMapReduce.kNearestNeighborIdsBatch(0, queries, MAX_THREADS,
+			nullptr, nullptr);
+}
+
+TEST_F(NaiveMapReduceKnnTest, k_0_finds_nothing) {
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+	NaiveMapReduce naiveMapReduce(points_.data(), DIMENSION,
+			NUMBER_OF_TEST_POINTS, MAX_THREADS, MAX_THREAD_LOAD,
+			MAX_SINGLE_THREADED);
+
+	ASSERT_TRUE(naiveMapReduce.kNearestNeighbors(0, &query).empty());
+	ASSERT_EQ(0u, naiveMapReduce.kNearestNeighborIds(0, &query, nullptr,
+			nullptr));
+}
+
+TEST_F(NaiveMapReduceKnnTest, numa_aware_scans_find_the_same_neighbors) {
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+	std::vector<std::size_t> expectedIds(K), ids(K);
+	std::vector<double> expectedDistances(K), distances(K);
+
+	NaiveMapReduce naiveMapReduce(points_.data(), DIMENSION,
+			NUMBER_OF_TEST_POINTS, MAX_THREADS, MAX_THREAD_LOAD,
+			MAX_SINGLE_THREADED);
+	naiveMapReduce.kNearestNeighborIds(K, &query, expectedIds.data(),
+			expectedDistances.data());
+
+	naiveMapReduce.setNumaAware(true);
+	naiveMapReduce.kNearestNeighborIds(K, &query, ids.data(),
+			distances.data());
+	ASSERT_EQ(expectedIds, ids);
+	ASSERT_EQ(expectedDistances, distances);
+
+	std::vector<double> bandwidth = naiveMapReduce.nodeBandwidth();
+	ASSERT_EQ(static_cast<std::size_t>(CpuTopology::local().numberOfNodes),
+			bandwidth.size());
+	BPQ<PointArrayAccessor> placed = naiveMapReduce.kNearestNeighbors(K,
+			&query);
+
+	naiveMapReduce.setNumaAware(false);
+	naiveMapReduce.kNearestNeighborIds(K, &query, ids.data(),
+			distances.data());
+	ASSERT_EQ(expectedIds, ids);
+	//results of the placed copy stay valid
+	ASSERT_DOUBLE_EQ(placed.topDistance(),
+			Metrics::squared_euclidean(placed.topPoint(), &query));
+}
+
+TEST_F(NaiveMapReduceKnnTest, partition_grids_are_reused_until_invalidated) {
+	double queryCoords[DIMENSION] = { 1.0, 1.0, 1.0 };
+	PointArrayAccessor query(queryCoords, 0, DIMENSION);
+	std::vector<std::size_t> expectedIds(K), ids(K);
+	std::vector<double> expectedDistances(K), distances(K);
+
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	NaiveMapReduce naiveMapReduce(points_.data(), DIMENSION,
+			NUMBER_OF_TEST_POINTS, MAX_THREADS, MAX_THREAD_LOAD,
+			MAX_SINGLE_THREADED, KNN_STRATEGY::GRID);
+	naiveMapReduce.buildPartitionGrids(10);
+
+	//grids built for k = 10 answer other k as well
+	for (unsigned k : { 1u, 10u, K }) {
+		naive.kNearestNeighborIds(k, &query, expectedIds.data(),
+				expectedDistances.data());
+		ASSERT_EQ(static_cast<std::size_t>(k),
+				naiveMapReduce.kNearestNeighborIds(k, &query, ids.data(),
+						distances.data()));
+		for (std::size_t i = 0; i < k; ++i) {
+			ASSERT_DOUBLE_EQ(expectedDistances[i], distances[i]);
+		}
+	}
+
+	//move a point onto the query, only rebuilt grids see it
+	const std::size_t moved = NUMBER_OF_TEST_POINTS / 2;
+	std::copy(queryCoords, queryCoords + DIMENSION,
+			&points_.data()[moved * DIMENSION]);
+	naiveMapReduce.kNearestNeighborIds(1, &query, ids.data(),
+			distances.data());
+	ASSERT_NE(moved, ids[0]);
+
+	naiveMapReduce.invalidatePartitionGrids();
+	naiveMapReduce.kNearestNeighborIds(1, &query, ids.data(),
+			distances.data());
+	ASSERT_EQ(moved, ids[0]);
+	ASSERT_EQ(0.0, distances[0]);
+}
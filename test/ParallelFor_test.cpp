@@ -0,0 +1,46 @@
+#include "gtest/gtest.h"
+#include "util/ParallelFor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+class ParallelForTest: public ::testing::Test {
+protected:
+	static const std::size_t COUNT = 1000;
+	static const unsigned THREADS = 4;
+};
+
+TEST_F(ParallelForTest, visits_every_index_once_with_uneven_work) {
+	std::vector<std::atomic<int>> visits(COUNT);
+	for (auto& v : visits) {
+		v = 0;
+	}
+
+	parallelFor(COUNT, THREADS, [&](std::size_t i) {
+		//the first range is expensive, its owner needs thieves
+		if (i < COUNT / THREADS) {
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+		++visits[i];
+	});
+
+	for (std::size_t i = 0; i < COUNT; ++i) {
+		ASSERT_EQ(1, visits[i]);
+	}
+}
+
+TEST_F(ParallelForTest, rethrows_exceptions_of_the_body) {
+	std::atomic<std::size_t> calls(0);
+
+	ASSERT_THROW(parallelFor(COUNT, THREADS, [&](std::size_t i) {
+		++calls;
+		if (i == COUNT / 2) {
+			throw std::runtime_error("failed iteration");
+		}
+	}), std::runtime_error);
+	ASSERT_LE(calls.load(), static_cast<std::size_t>(COUNT));
+}
@@ -0,0 +1,89 @@
+#include "gtest/gtest.h"
+#include "knn/NaiveKnn.h"
+#include "knn/PqKnn.h"
+#include "knn/Metrics.h"
+#include "model/PointArrayAccessor.h"
+#include "util/RandomPointGenerator.h"
+
+#include <stdexcept>
+#include <vector>
+
+class PqKnnTest: public ::testing::Test {
+protected:
+	PointContainer points_;
+	static const unsigned NUMBER_OF_TEST_POINTS = 20000;
+	static const unsigned DIMENSION = 32;
+	static const unsigned SUBSPACES = 8;
+	static const unsigned NUMBER_OF_QUERIES = 20;
+	static const unsigned K = 10;
+	static const unsigned SEED = 12345;
+
+	virtual void SetUp() {
+		RandomPointGenerator rg(SEED);
+		std::vector<double> mbrCoords(2 * DIMENSION, 0.0);
+		std::fill(mbrCoords.begin() + DIMENSION, mbrCoords.end(), 100.0);
+
+		MBR m = MBR(DIMENSION);
+		m = m.createMBR(mbrCoords.data(), 2 * DIMENSION);
+		points_ = rg.generatePoints(NUMBER_OF_TEST_POINTS,
+				RandomPointGenerator::GAUSS_CLUSTER, m, 0.0, 5.0, 20);
+	}
+
+	virtual void TearDown() {
+	}
+};
+
+TEST_F(PqKnnTest, rejects_invalid_number_of_subspaces) {
+	EXPECT_THROW(PqKnn(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS, 0),
+			std::invalid_argument);
+	EXPECT_THROW(
+			PqKnn(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS, DIMENSION + 1),
+			std::invalid_argument);
+}
+
+TEST_F(PqKnnTest, code_distances_match_reconstructed_points) {
+	//uneven subspaces: 32 dimensions in 5 subspaces
+	PqKnn pq(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS, 5);
+	pq.setRerank(false);
+	EXPECT_LT(pq.memoryUsage(),
+			NUMBER_OF_TEST_POINTS * DIMENSION * sizeof(double) / 8);
+
+	std::vector<double> reconstructed(DIMENSION);
+	for (std::size_t q_idx = 0; q_idx < NUMBER_OF_QUERIES; ++q_idx) {
+		auto query = points_[q_idx * 997];
+		auto result = pq.kNearestNeighbors(K, &query);
+		ASSERT_EQ(std::size_t { K }, result.size());
+
+		while (!result.empty()) {
+			auto point = result.topPoint();
+			pq.decode(point.getOffset() / DIMENSION, reconstructed.data());
+			ASSERT_NEAR(
+					Metrics::squared_euclidean(reconstructed.data(),
+							query.getData() + query.getOffset(), DIMENSION),
+					result.topDistance(), 1e-9 * result.topDistance());
+			result.pop();
+		}
+	}
+}
+
+TEST_F(PqKnnTest, reranked_results_have_high_recall) {
+	NaiveKnn naive(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS);
+	PqKnn pq(points_.data(), DIMENSION, NUMBER_OF_TEST_POINTS, SUBSPACES);
+	std::size_t hits = 0;
+
+	for (std::size_t q_idx = 0; q_idx < NUMBER_OF_QUERIES; ++q_idx) {
+		auto query = points_[q_idx * 997 + 1];
+		auto expected = naive.kNearestNeighbors(K, &query);
+		auto actual = pq.kNearestNeighbors(K, &query);
+		ASSERT_EQ(std::size_t { K }, actual.size());
+
+		//re-ranked distances are exact, so they can not beat the truth
+		ASSERT_GE(actual.topDistance(), expected.topDistance());
+		while (!actual.empty()) {
+			hits += actual.topDistance() <= expected.topDistance();
+			actual.pop();
+		}
+	}
+
+	EXPECT_GE(hits, 0.9 * K * NUMBER_OF_QUERIES);
+}
@@ -0,0 +1,76 @@
+#include "gtest/gtest.h"
+#include "knn/BPQ.h"
+#include "knn/SmallKQueue.h"
+#include "model/PointArrayAccessor.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+class SmallKQueueTest: public ::testing::Test {
+protected:
+	static const unsigned NUMBER_OF_CANDIDATES = 20000;
+	static const unsigned SEED = 12345;
+
+	std::vector<double> distances_;
+	std::vector<double> points_;
+
+	virtual void SetUp() {
+		std::default_random_engine engine(SEED);
+		std::uniform_real_distribution<double> uniform(0.0, 1.0);
+		distances_.resize(NUMBER_OF_CANDIDATES);
+		for (auto& d : distances_) {
+			d = uniform(engine);
+		}
+		//the point of candidate i is its distance
+		points_ = distances_;
+	}
+};
+
+TEST_F(SmallKQueueTest, keeps_the_k_smallest_distances_in_ascending_order) {
+	std::vector<double> sorted(distances_);
+	std::sort(sorted.begin(), sorted.end());
+
+	for (std::size_t k : { 1, 2, 3, 8, 17, 31, 32 }) {
+		SmallKQueue<PointArrayAccessor> queue(k);
+		for (std::size_t i = 0; i < distances_.size(); ++i) {
+			if (distances_[i] < queue.max_dist()) {
+				queue.push(PointArrayAccessor { points_.data(), i, 1 },
+						distances_[i]);
+			}
+		}
+
+		ASSERT_EQ(k, queue.size());
+		ASSERT_EQ(sorted[k - 1], queue.max_dist());
+		for (std::size_t rank = 0; rank < k; ++rank) {
+			ASSERT_EQ(sorted[rank], queue.distance(rank));
+			ASSERT_EQ(sorted[rank], queue.point(rank)[0]);
+		}
+	}
+}
+
+TEST_F(SmallKQueueTest, converts_to_the_same_BPQ_as_a_BPQ_scan) {
+	for (std::size_t k : { 1, 10, 32 }) {
+		BPQ<PointArrayAccessor> expected(k);
+		SmallKQueue<PointArrayAccessor> queue(k);
+		for (std::size_t i = 0; i < distances_.size(); ++i) {
+			PointArrayAccessor point { points_.data(), i, 1 };
+			if (distances_[i] < expected.max_dist()) {
+				expected.push(point, distances_[i]);
+			}
+			if (distances_[i] < queue.max_dist()) {
+				queue.push(point, distances_[i]);
+			}
+		}
+
+		BPQ<PointArrayAccessor> actual = queue.toBPQ();
+		ASSERT_EQ(expected.size(), actual.size());
+		ASSERT_EQ(expected.max_dist(), actual.max_dist());
+		while (!expected.empty()) {
+			ASSERT_EQ(expected.topDistance(), actual.topDistance());
+			ASSERT_EQ(expected.topPoint()[0], actual.topPoint()[0]);
+			expected.pop();
+			actual.pop();
+		}
+	}
+}
@@ -0,0 +1,110 @@
+#include "gtest/gtest.h"
+#include "util/ThreadPool.h"
+#include "util/Affinity.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+class ThreadPoolTest: public ::testing::Test {
+protected:
+	static const std::size_t COUNT = 1000;
+	static const unsigned THREADS = 4;
+};
+
+TEST_F(ThreadPoolTest, runs_consecutive_loops_on_the_same_threads) {
+	ThreadPool pool(THREADS);
+	ASSERT_EQ(static_cast<unsigned>(THREADS), pool.size());
+
+	for (unsigned loop = 0; loop < 100; ++loop) {
+		std::vector<std::atomic<int>> visits(COUNT);
+		for (auto& v : visits) {
+			v = 0;
+		}
+
+		pool.parallelFor(COUNT, [&](std::size_t i) {
+			++visits[i];
+		});
+
+		for (std::size_t i = 0; i < COUNT; ++i) {
+			ASSERT_EQ(1, visits[i]);
+		}
+	}
+}
+
+TEST_F(ThreadPoolTest, nested_loops_run_on_the_calling_thread) {
+	ThreadPool pool(THREADS);
+	std::atomic<std::size_t> calls(0);
+
+	pool.parallelFor(THREADS, [&](std::size_t) {
+		const std::thread::id outer = std::this_thread::get_id();
+		pool.parallelFor(COUNT, [&](std::size_t) {
+			EXPECT_EQ(outer, std::this_thread::get_id());
+			++calls;
+		});
+	});
+
+	ASSERT_EQ(THREADS * COUNT, calls.load());
+}
+
+TEST_F(ThreadPoolTest, rethrows_exceptions_and_stays_usable) {
+	ThreadPool pool(THREADS);
+	std::atomic<std::size_t> calls(0);
+
+	ASSERT_THROW(pool.parallelFor(COUNT, [&](std::size_t i) {
+		if (i == COUNT / 2) {
+			throw std::runtime_error("failed iteration");
+		}
+	}), std::runtime_error);
+
+	pool.parallelFor(COUNT, [&](std::size_t) {
+		++calls;
+	});
+	ASSERT_EQ(static_cast<std::size_t>(COUNT), calls.load());
+}
+
+TEST_F(ThreadPoolTest, for_each_thread_runs_once_on_every_thread) {
+	for (bool pinned : { false, true }) {
+		ThreadPool pool(THREADS, pinned);
+		std::vector<std::thread::id> threads(THREADS);
+
+		pool.forEachThread([&](unsigned thread) {
+			threads[thread] = std::this_thread::get_id();
+		});
+
+		std::sort(threads.begin(), threads.end());
+		ASSERT_TRUE(
+				std::unique(threads.begin(), threads.end()) == threads.end());
+		ASSERT_TRUE(
+				std::find(threads.begin(), threads.end(), std::thread::id())
+						== threads.end());
+	}
+}
+
+TEST_F(ThreadPoolTest, pinned_pool_uses_cpus_of_the_topology) {
+	const CpuTopology& topology = CpuTopology::local();
+	ASSERT_FALSE(topology.cpus.empty());
+	ASSERT_EQ(topology.cpus.size(), topology.nodes.size());
+	for (unsigned node : topology.nodes) {
+		ASSERT_LT(node, topology.numberOfNodes);
+	}
+
+	ThreadPool pool(THREADS, true);
+	std::atomic<std::size_t> calls(0);
+	pool.parallelFor(COUNT, [&](std::size_t) {
+		++calls;
+	});
+	ASSERT_EQ(static_cast<std::size_t>(COUNT), calls.load());
+
+	for (unsigned thread = 0; thread < THREADS; ++thread) {
+		const int cpu = pool.cpu(thread);
+		ASSERT_TRUE(
+				cpu == -1
+						|| std::find(topology.cpus.begin(),
+								topology.cpus.end(), static_cast<unsigned>(cpu))
+								!= topology.cpus.end());
+	}
+}